@@ -1,4 +1,5 @@
 #include <cmath>
+#include <new>
 #include "rt_math.h"
 #include "EdgePreservingDecomposition.h"
 #ifdef _OPENMP
@@ -223,7 +224,7 @@ bool MultiDiagonalSymmetricMatrix::CreateDiagonal(int index, int StartRow)
     if(DiagBuffer != nullptr) {
         Diagonals[index] = (DiagBuffer + (index * (n + padding)) + ((index + 16) * 16));
     } else {
-        Diagonals[index] = new float[DiagonalLength(StartRow)];
+        Diagonals[index] = new (std::nothrow) float[DiagonalLength(StartRow)];
 
         if(Diagonals[index] == nullptr) {
             printf("Error in MultiDiagonalSymmetricMatrix::CreateDiagonal: memory allocation failed. Out of memory?\n");
@@ -544,6 +545,7 @@ bool MultiDiagonalSymmetricMatrix::CreateIncompleteCholeskyFactorization(int Max
 void MultiDiagonalSymmetricMatrix::KillIncompleteCholeskyFactorization()
 {
     delete IncompleteCholeskyFactorization;
+    IncompleteCholeskyFactorization = nullptr;
 }
 
 void MultiDiagonalSymmetricMatrix::CholeskyBackSolve(float* RESTRICT x, float* RESTRICT b)
@@ -646,6 +648,470 @@ void MultiDiagonalSymmetricMatrix::CholeskyBackSolve(float* RESTRICT x, float* R
     }
 }
 
+namespace
+{
+
+//Grids are coarsened as long as both sides of the coarse grid have at least this many nodes.
+constexpr int MultigridMinimumSize = 16;
+//Damping of the Jacobi smoother. The largest eigenvalue of D^-1 A is about 1.5 for these stencils.
+constexpr float MultigridOmega = 0.8f;
+//Jacobi sweeps before and after each coarse grid correction.
+constexpr int MultigridSweeps = 2;
+
+//Entry of a matrix with diagonals 0, 1, w - 1, w, w + 1 between node (x, y) and its neighbour at (x + dx, y + dy), or 0 if that's off the grid.
+template<bool CheckBounds = true>
+inline float MultigridEntry(float **d, int w, int h, int x, int y, int dx, int dy)
+{
+    if(CheckBounds && (x + dx < 0 || x + dx >= w || y + dy < 0 || y + dy >= h)) {
+        return 0.0f;
+    }
+
+    const int f = y * w + x;
+    const int lower = rtengine::min(f, f + dy * w + dx);
+
+    if(dy == 0) {
+        return dx == 0 ? d[0][f] : d[1][lower];
+    }
+
+    return dx == 0 ? d[3][lower] : (dx == dy ? d[4][lower] : d[2][lower]);
+}
+
+//Interpolation weights of fine node (x, y) if it's on a coarse row or column, zero otherwise.
+template<bool CheckBounds>
+inline void MultigridLineWeights(float **d, float* RESTRICT p, int w, int h, int x, int y)
+{
+    float* RESTRICT pf = p + 4 * (y * w + x);
+    pf[0] = pf[1] = pf[2] = pf[3] = 0.0f;
+
+    if(!(x & 1) && !(y & 1)) {
+        pf[0] = 1.0f;
+    } else if(!(y & 1)) {
+        float low = 0.0f, centre = 0.0f, high = 0.0f;
+
+        for(int dy = -1; dy <= 1; dy++) {
+            low += MultigridEntry<CheckBounds>(d, w, h, x, y, -1, dy);
+            centre += MultigridEntry<CheckBounds>(d, w, h, x, y, 0, dy);
+            high += MultigridEntry<CheckBounds>(d, w, h, x, y, 1, dy);
+        }
+
+        pf[0] = -low / centre;
+        pf[1] = -high / centre;
+    } else if(!(x & 1)) {
+        float low = 0.0f, centre = 0.0f, high = 0.0f;
+
+        for(int dx = -1; dx <= 1; dx++) {
+            low += MultigridEntry<CheckBounds>(d, w, h, x, y, dx, -1);
+            centre += MultigridEntry<CheckBounds>(d, w, h, x, y, dx, 0);
+            high += MultigridEntry<CheckBounds>(d, w, h, x, y, dx, 1);
+        }
+
+        pf[0] = -low / centre;
+        pf[2] = -high / centre;
+    }
+}
+
+//Interpolation weights of fine node (x, y), both odd, from the weights of its eight neighbours.
+template<bool CheckBounds>
+inline void MultigridCellWeights(float **d, float* RESTRICT p, int w, int h, int x, int y)
+{
+    float* RESTRICT pf = p + 4 * (y * w + x);
+    const float centre = d[0][y * w + x];
+
+    for(int dy = -1; dy <= 1; dy++) {
+        for(int dx = -1; dx <= 1; dx++) {
+            const float a = MultigridEntry<CheckBounds>(d, w, h, x, y, dx, dy);
+
+            if((dx == 0 && dy == 0) || a == 0.0f) {
+                continue;
+            }
+
+            //The neighbour interpolates from the corners of this node's coarse cell only.
+            const float* RESTRICT pg = p + 4 * ((y + dy) * w + x + dx);
+            const int i0 = (x + dx) / 2 - x / 2;
+            const int j0 = (y + dy) / 2 - y / 2;
+
+            for(int j = 0; j + j0 < 2; j++) {
+                for(int i = 0; i + i0 < 2; i++) {
+                    pf[2 * (j + j0) + i + i0] -= a * pg[2 * j + i] / centre;
+                }
+            }
+        }
+    }
+}
+
+//Row of the Galerkin product for coarse node (I, J): the entry between coarse nodes K and L is the sum of P[f][K] A[f][g] P[g][L]
+//over fine nodes f and g. Fills sum[L.y - J + 1][L.x - I + 1] for the lower half of L. Without CheckBounds, all fine nodes within
+//two of (2 I, 2 J) have to lie on the grid.
+template<bool CheckBounds>
+inline void MultigridGalerkinRow(float **d, const float* RESTRICT p, int w, int h, int I, int J, float sum[3][3])
+{
+    for(int fy = 2 * J - 1; fy <= 2 * J + 1; fy++) {
+        for(int fx = 2 * I - 1; fx <= 2 * I + 1; fx++) {
+            if(CheckBounds && (fx < 0 || fx >= w || fy < 0 || fy >= h)) {
+                continue;
+            }
+
+            //K is corner (1, 1) of fine nodes left of or above it and corner (0, 0) of the others.
+            const float wf = p[4 * (fy * w + fx) + (fy < 2 * J ? 2 : 0) + (fx < 2 * I ? 1 : 0)];
+
+            if(wf == 0.0f) {
+                continue;
+            }
+
+            for(int dy = -1; dy <= 1; dy++) {
+                const int gy = fy + dy;
+
+                if(gy / 2 > J) {
+                    continue;
+                }
+
+                for(int dx = -1; dx <= 1; dx++) {
+                    const float a = wf * MultigridEntry<CheckBounds>(d, w, h, fx, fy, dx, dy);
+
+                    if(a == 0.0f) {
+                        continue;
+                    }
+
+                    const int gx = fx + dx;
+                    const float* RESTRICT pg = p + 4 * (gy * w + gx);
+                    float* RESTRICT row = sum[gy / 2 - J + 1] + gx / 2 - I + 1;
+                    row[0] += a * pg[0];
+
+                    if(gx & 1) {
+                        row[1] += a * pg[1];
+                    }
+
+                    if((gy & 1) && gy / 2 < J) {
+                        row[3] += a * pg[2];
+
+                        if(gx & 1) {
+                            row[4] += a * pg[3];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+MultiDiagonalSymmetricMatrix *MultigridCreateMatrix(int w, int h)
+{
+    MultiDiagonalSymmetricMatrix *A = new (std::nothrow) MultiDiagonalSymmetricMatrix(w * h, DIAGONALS);
+
+    if(A == nullptr) {
+        return nullptr;
+    }
+
+    if(!(
+                A->CreateDiagonal(0, 0) &&
+                A->CreateDiagonal(1, 1) &&
+                A->CreateDiagonal(2, w - 1) &&
+                A->CreateDiagonal(3, w) &&
+                A->CreateDiagonal(4, w + 1))) {
+        delete A;
+        return nullptr;
+    }
+
+    return A;
+}
+
+}
+
+MultigridPreconditioner::MultigridPreconditioner(MultiDiagonalSymmetricMatrix *A, int w, int h) : Levels(nullptr), NumberOfLevels(0), Allocated(false)
+{
+    int levels = 1;
+
+    for(int lw = w, lh = h; (lw + 1) / 2 >= MultigridMinimumSize && (lh + 1) / 2 >= MultigridMinimumSize; lw = (lw + 1) / 2, lh = (lh + 1) / 2) {
+        levels++;
+    }
+
+    //Allocation failures leave Allocated false, so that CreateBlur falls back to the incomplete Cholesky factorization.
+    Levels = new (std::nothrow) Level[levels];
+
+    if(Levels == nullptr) {
+        printf("Error in MultigridPreconditioner construction: out of memory.\n");
+        return;
+    }
+
+    NumberOfLevels = levels;
+    memset(Levels, 0, NumberOfLevels * sizeof(Level));
+    bool success = true;
+
+    for(int l = 0; l < NumberOfLevels && success; l++) {
+        Level &lv = Levels[l];
+        lv.w = l == 0 ? w : (Levels[l - 1].w + 1) / 2;
+        lv.h = l == 0 ? h : (Levels[l - 1].h + 1) / 2;
+        const int ln = lv.w * lv.h;
+
+        if(l == 0) {
+            lv.A = A;
+        } else {
+            lv.A = MultigridCreateMatrix(lv.w, lv.h);
+            lv.x = new (std::nothrow) float[ln];
+            lv.b = new (std::nothrow) float[ln];
+            success = lv.A != nullptr && lv.x != nullptr && lv.b != nullptr;
+        }
+
+        if(l < NumberOfLevels - 1) {
+            lv.JacobiWeights = new (std::nothrow) float[ln];
+            lv.Interpolation = new (std::nothrow) float[4 * ln];
+            lv.r = new (std::nothrow) float[ln];
+            success = success && lv.JacobiWeights != nullptr && lv.Interpolation != nullptr && lv.r != nullptr;
+        }
+    }
+
+    if(!success) {
+        printf("Error in MultigridPreconditioner construction: out of memory.\n");
+    }
+
+    Allocated = success;
+}
+
+MultigridPreconditioner::~MultigridPreconditioner()
+{
+    for(int l = 0; l < NumberOfLevels; l++) {
+        Level &lv = Levels[l];
+
+        if(lv.A != nullptr) {
+            if(l == NumberOfLevels - 1) {
+                lv.A->KillIncompleteCholeskyFactorization();
+            }
+
+            if(l > 0) {
+                delete lv.A;
+            }
+        }
+
+        delete[] lv.JacobiWeights;
+        delete[] lv.Interpolation;
+        delete[] lv.x;
+        delete[] lv.b;
+        delete[] lv.r;
+    }
+
+    delete[] Levels;
+}
+
+/* The interpolation is operator dependent, as in Dendy's black box multigrid: the edge stopping function of the tone mapping
+varies over orders of magnitude, and interpolating across an edge like in a smooth region makes the coarse grid correction next
+to useless there. Fine node (x, y) gets its value from the coarse nodes (x / 2, y / 2) + (i, j) with i, j in {0, 1}, weighted by
+Interpolation[4 * (y * w + x) + 2 * j + i]. Nodes on coarse rows or columns use the stencil collapsed onto that line, the
+remaining ones solve their own row of the equations given their eight interpolated neighbours. */
+void MultigridPreconditioner::CreateInterpolation(const Level &Fine)
+{
+    const int fw = Fine.w, fh = Fine.h;
+    float **d = Fine.A->Diagonals;
+    float* RESTRICT p = Fine.Interpolation;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = 0; y < fh; y++) {
+            for(int x = 0; x < fw; x++) {
+                if(y > 0 && y < fh - 1 && x > 0 && x < fw - 1) {
+                    MultigridLineWeights<false>(d, p, fw, fh, x, y);
+                } else {
+                    MultigridLineWeights<true>(d, p, fw, fh, x, y);
+                }
+            }
+        }
+
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = 1; y < fh; y += 2) {
+            for(int x = 1; x < fw; x += 2) {
+                if(y < fh - 1 && x < fw - 1) {
+                    MultigridCellWeights<false>(d, p, fw, fh, x, y);
+                } else {
+                    MultigridCellWeights<true>(d, p, fw, fh, x, y);
+                }
+            }
+        }
+    }
+}
+
+bool MultigridPreconditioner::Update()
+{
+    if(!Allocated) {
+        return false;
+    }
+
+    for(int l = 0; l < NumberOfLevels - 1; l++) {
+        const Level &fine = Levels[l];
+        const Level &coarse = Levels[l + 1];
+        const int fw = fine.w, fh = fine.h, cw = coarse.w, ch = coarse.h;
+        float **fd = fine.A->Diagonals;
+        float **cd = coarse.A->Diagonals;
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+
+        for(int j = 0; j < fw * fh; j++) {
+            fine.JacobiWeights[j] = MultigridOmega / fd[0][j];
+        }
+
+        CreateInterpolation(fine);
+        const float* RESTRICT p = fine.Interpolation;
+
+        for(int i = 1; i < DIAGONALS; i++) {
+            memset(cd[i], 0, coarse.A->DiagonalLength(coarse.A->StartRows[i]) * sizeof(float));
+        }
+
+        //Galerkin product. Every coarse node gathers its own row of the lower triangle, so the rows can be done in parallel.
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+
+        for(int J = 0; J < ch; J++) {
+            for(int I = 0; I < cw; I++) {
+                float sum[3][3] = {}; //Indexed by [L.y - J + 1][L.x - I + 1], only the lower half is used.
+
+                if(I > 0 && J > 0 && 2 * I + 2 < fw && 2 * J + 2 < fh) {
+                    MultigridGalerkinRow<false>(fd, p, fw, fh, I, J, sum);
+                } else {
+                    MultigridGalerkinRow<true>(fd, p, fw, fh, I, J, sum);
+                }
+
+                const int K = J * cw + I;
+                cd[0][K] = sum[1][1];
+
+                if(I > 0) {
+                    cd[1][K - 1] = sum[1][0];
+                }
+
+                if(J > 0) {
+                    cd[3][K - cw] = sum[0][1];
+
+                    if(I < cw - 1) {
+                        cd[2][K - cw + 1] = sum[0][2];
+                    }
+
+                    if(I > 0) {
+                        cd[4][K - cw - 1] = sum[0][0];
+                    }
+                }
+            }
+        }
+    }
+
+    MultiDiagonalSymmetricMatrix *coarsest = Levels[NumberOfLevels - 1].A;
+    coarsest->KillIncompleteCholeskyFactorization();
+    return coarsest->CreateIncompleteCholeskyFactorization(1);
+}
+
+void MultigridPreconditioner::Smooth(const Level &Fine, float *x, float *b)
+{
+    const int ln = Fine.w * Fine.h;
+    Fine.A->VectorProduct(Fine.r, x);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for(int j = 0; j < ln; j++) {
+        x[j] += Fine.JacobiWeights[j] * (b[j] - Fine.r[j]);
+    }
+}
+
+void MultigridPreconditioner::Cycle(int l, float *x, float *b)
+{
+    const Level &fine = Levels[l];
+
+    if(l == NumberOfLevels - 1) {
+        fine.A->CholeskyBackSolve(x, b);
+        return;
+    }
+
+    const Level &coarse = Levels[l + 1];
+    const int fw = fine.w, fh = fine.h, cw = coarse.w, ch = coarse.h;
+    const float* RESTRICT p = fine.Interpolation;
+    float* RESTRICT r = fine.r;
+
+    //Pre smoothing, starting from x = 0.
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for(int j = 0; j < fw * fh; j++) {
+        x[j] = fine.JacobiWeights[j] * b[j];
+    }
+
+    for(int i = 1; i < MultigridSweeps; i++) {
+        Smooth(fine, x, b);
+    }
+
+    //Restrict the residual with the transpose of the interpolation.
+    fine.A->VectorProduct(r, x);
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int j = 0; j < fw * fh; j++) {
+            r[j] = b[j] - r[j];
+        }
+
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int J = 0; J < ch; J++) {
+            for(int I = 0; I < cw; I++) {
+                float sum = 0.0f;
+
+                for(int fy = rtengine::max(2 * J - 1, 0); fy <= rtengine::min(2 * J + 1, fh - 1); fy++) {
+                    for(int fx = rtengine::max(2 * I - 1, 0); fx <= rtengine::min(2 * I + 1, fw - 1); fx++) {
+                        sum += p[4 * (fy * fw + fx) + (fy < 2 * J ? 2 : 0) + (fx < 2 * I ? 1 : 0)] * r[fy * fw + fx];
+                    }
+                }
+
+                coarse.b[J * cw + I] = sum;
+            }
+        }
+    }
+
+    Cycle(l + 1, coarse.x, coarse.b);
+
+    //Interpolate the correction. Weights towards coarse nodes beyond the last row or column are zero.
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for(int fy = 0; fy < fh; fy++) {
+        const float* RESTRICT row0 = coarse.x + (fy / 2) * cw;
+        const float* RESTRICT row1 = coarse.x + rtengine::min(fy / 2 + 1, ch - 1) * cw;
+
+        for(int fx = 0; fx < fw; fx++) {
+            const float* RESTRICT pf = p + 4 * (fy * fw + fx);
+            const int cx0 = fx / 2;
+            const int cx1 = rtengine::min(cx0 + 1, cw - 1);
+            x[fy * fw + fx] += pf[0] * row0[cx0] + pf[1] * row0[cx1] + pf[2] * row1[cx0] + pf[3] * row1[cx1];
+        }
+    }
+
+    //Post smoothing, the same number of sweeps keeps the V-cycle symmetric.
+    for(int i = 0; i < MultigridSweeps; i++) {
+        Smooth(fine, x, b);
+    }
+}
+
+void MultigridPreconditioner::Solve(float *Product, float *x)
+{
+    Cycle(0, Product, x);
+}
+
 EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height) : a0(nullptr) , a_1(nullptr), a_w(nullptr), a_w_1(nullptr), a_w1(nullptr)
 {
     w = width;
@@ -827,7 +1293,23 @@ float *EdgePreservingDecomposition::CreateBlur(float *Source, float Scale, float
         delete[] a;
     }
 
-    //Solve & return.
+    //Solve & return. The multigrid preconditioner converges in a fraction of the iterates, so stop once the residual is well
+    //below what shows after the exponentiation in CompressDynamicRange. The matrix is the identity plus a positive semidefinite
+    //part, so the rms error of the solution doesn't exceed the rms residual.
+    //The hierarchy only lives for this solve, it would otherwise hold about 24 bytes per pixel plus the coarse levels between blurs.
+    {
+        MultigridPreconditioner multigrid(A, w, h);
+
+        if(multigrid.Update()) {
+            if(!UseBlurForEdgeStop) {
+                memcpy(Blur, Source, n * sizeof(float));
+            }
+
+            SparseConjugateGradient(MultigridPreconditioner::PassThroughVectorProduct, Source, n, false, Blur, 1e-3f, (void *)&multigrid, Iterates, MultigridPreconditioner::PassThroughSolve);
+            return Blur;
+        }
+    }
+
     bool success = A->CreateIncompleteCholeskyFactorization(1); //Fill-in of 1 seems to work really good. More doesn't really help and less hurts (slightly).
 
     if(!success) {
@@ -134,6 +134,58 @@ public:
 
 };
 
+/* Geometric multigrid V-cycle for the matrices of EdgePreservingDecomposition, meant as the Preconditioner of SparseConjugateGradient.
+Each coarse grid keeps every second node of the finer one in both directions. Its matrix is the Galerkin product of the finer
+matrix with an interpolation from the four surrounding coarse nodes, so it has the same five diagonals and every level can use
+MultiDiagonalSymmetricMatrix.
+Damped Jacobi smooths on all but the coarsest level, which is solved with an incomplete Cholesky factorization. Unlike that
+factorization on the full grid, everything but the small coarsest level runs in parallel.
+
+The levels are allocated at construction and refilled by Update whenever the finest matrix changes. Pass the object itself as
+the pass through variable of SparseConjugateGradient, together with PassThroughVectorProduct and PassThroughSolve. */
+class MultigridPreconditioner :
+    public rtengine::NonCopyable
+{
+public:
+    //A is the finest matrix, w x h nodes with diagonals starting at rows 0, 1, w - 1, w and w + 1. It's not owned.
+    MultigridPreconditioner(MultiDiagonalSymmetricMatrix *A, int w, int h);
+    ~MultigridPreconditioner();
+
+    //Recomputes the coarse matrices from the current contents of A. Returns false if a level couldn't be allocated or factorized.
+    bool Update();
+
+    //Approximates the solution of A Product = x with one V-cycle.
+    void Solve(float *Product, float *x);
+
+    static void PassThroughVectorProduct(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->Levels[0].A->VectorProduct(Product, x);
+    };
+
+    static void PassThroughSolve(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->Solve(Product, x);
+    };
+
+private:
+    struct Level {
+        int w, h;
+        MultiDiagonalSymmetricMatrix *A;    //Owned on all but the finest level.
+        float *JacobiWeights;               //Damping over the main diagonal. All levels but the coarsest.
+        float *Interpolation;               //Four weights per node, from the next coarser level. All levels but the coarsest.
+        float *x, *b;                       //Coarse levels only.
+        float *r;                           //All levels but the coarsest.
+    };
+
+    void CreateInterpolation(const Level &Fine);
+    void Cycle(int l, float *x, float *b);
+    void Smooth(const Level &Fine, float *x, float *b);
+
+    Level *Levels;
+    int NumberOfLevels;
+    bool Allocated;
+};
+
 class EdgePreservingDecomposition :
     public rtengine::NonCopyable
 {
@@ -23,6 +23,8 @@
 ////////////////////////////////////////////////////////////////
 
 #include <cmath>
+#include <memory>
+#include <vector>
 
 #include <fftw3.h>
 
@@ -31,6 +33,7 @@
 #include "cplx_wavelet_dec.h"
 #include "color.h"
 #include "curves.h"
+#include "fftwplancache.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -711,6 +714,12 @@ BENCHFUN
         }
 
         bool memoryAllocationFailed = false;
+        // When streaming in place, a failed try is resumed with fewer threads at the first row not yet written back to dst.
+        // carry holds what the rows of tiles above it added to the overlap with the next row of tiles.
+        bool streamedInPlace = false;
+        int flushedRows = 0;
+        std::vector<float> carry;
+        int threadLimit = options.rgbDenoiseThreadLimit;
 
         do {
             ++numTries;
@@ -721,34 +730,65 @@ BENCHFUN
 
             int numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip;
 
-            Tile_calc(tilesize, overlap, (options.rgbDenoiseThreadLimit == 0 && !ponder) ? (numTries == 1 ? 0 : 2) : 2, imwidth, imheight, numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip);
+            // in streaming mode the image is always split into tiles, so the per thread buffers only depend on the tile size
+            const bool streamTiles = options.rgbDenoiseStreamTiles && !ponder;
+
+#ifdef _OPENMP
+            if (numTries == 2 && streamTiles) {
+                // the tile size doesn't change when streaming, so use fewer threads to need less memory
+                threadLimit = std::max(1, (threadLimit > 0 ? threadLimit : omp_get_max_threads()) / 2);
+            }
+#endif
+
+            Tile_calc(tilesize, overlap, (options.rgbDenoiseThreadLimit == 0 && !ponder && !streamTiles) ? (numTries == 1 ? 0 : 2) : 2, imwidth, imheight, numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip);
             memoryAllocationFailed = false;
             const int numtiles = numtiles_W * numtiles_H;
 
             //output buffer
             Imagefloat * dsttmp;
+            // When streaming in place, rows are written back to dst once no later tile reads or blends into them,
+            // so dsttmp only holds the rows of the current row of tiles instead of a full size copy
+            const bool streamInPlace = streamTiles && numtiles > 1 && dst == src;
+            streamedInPlace = streamInPlace;
 
             if (numtiles == 1) {
                 dsttmp = dst;
             } else {
-                dsttmp = new Imagefloat(imwidth, imheight);
+                // tiles are read from src only, so we can accumulate them directly in dst if it is a different image
+                dsttmp = dst != src ? dst : new Imagefloat(imwidth, streamInPlace ? std::min<int>(tileheight, imheight) : imheight);
 #ifdef _OPENMP
                 #pragma omp parallel for
 #endif
 
-                for (int i = 0; i < imheight; ++i) {
+                for (int i = 0; i < dsttmp->getHeight(); ++i) {
                     for (int j = 0; j < imwidth; ++j) {
                         dsttmp->r(i, j) = 0.f;
                         dsttmp->g(i, j) = 0.f;
                         dsttmp->b(i, j) = 0.f;
                     }
                 }
+
+                if (streamInPlace) {
+                    const int carryRows = std::max(0, dsttmp->getHeight() - tileHskip);
+                    carry.resize(3 * carryRows * imwidth);
+
+                    if (flushedRows > 0) {
+                        // resuming after a failed try
+                        for (int i = 0; i < carryRows; ++i) {
+                            for (int j = 0; j < imwidth; ++j) {
+                                dsttmp->r(i, j) = carry[i * imwidth + j];
+                                dsttmp->g(i, j) = carry[(carryRows + i) * imwidth + j];
+                                dsttmp->b(i, j) = carry[(2 * carryRows + i) * imwidth + j];
+                            }
+                        }
+                    }
+                }
             }
 
             //now we have tile dimensions, overlaps
             //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-            // According to FFTW-Doc 'it is safe to execute the same plan in parallel by multiple threads', so we now create 4 plans
+            // According to FFTW-Doc 'it is safe to execute the same plan in parallel by multiple threads', so we now get 4 plans
             // outside the parallel region and use them inside the parallel region.
 
             // calculate max size of numblox_W.
@@ -756,27 +796,17 @@ BENCHFUN
             // calculate min size of numblox_W.
             int min_numblox_W = ceil((static_cast<float>((MIN(imwidth, ((numtiles_W - 1) * tileWskip) + tilewidth)) - ((numtiles_W - 1) * tileWskip))) / (offset)) + 2 * blkrad;
 
-            // these are needed only for creation of the plans and will be freed before entering the parallel loop
+            // the plans are owned by the plan cache and reused for all images with the same tile layout
             fftwf_plan plan_forward_blox[2];
             fftwf_plan plan_backward_blox[2];
 
             if (denoiseLuminance) {
-                float *Lbloxtmp  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-                float *fLbloxtmp = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-
-                int nfwd[2] = {TS, TS};
-
-                //for DCT:
-                fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
-                fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
-
-                // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-                plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                fftwf_free(Lbloxtmp);
-                fftwf_free(fLbloxtmp);
+                FFTWPlanCache& fftwPlans = FFTWPlanCache::getInstance();
+                // DCT an entire row of tiles with one plan
+                plan_forward_blox[0]  = fftwPlans.getBlockDCT(TS, max_numblox_W, true);
+                plan_backward_blox[0] = fftwPlans.getBlockDCT(TS, max_numblox_W, false);
+                plan_forward_blox[1]  = fftwPlans.getBlockDCT(TS, min_numblox_W, true);
+                plan_backward_blox[1] = fftwPlans.getBlockDCT(TS, min_numblox_W, false);
             }
 
 #ifndef _OPENMP
@@ -785,8 +815,8 @@ BENCHFUN
             // Calculate number of tiles. If less than omp_get_max_threads(), then limit num_threads to number of tiles
             int numthreads = MIN(numtiles, omp_get_max_threads());
 
-            if (options.rgbDenoiseThreadLimit > 0) {
-                numthreads = MIN(numthreads, options.rgbDenoiseThreadLimit);
+            if (threadLimit > 0) {
+                numthreads = MIN(numthreads, threadLimit);
             }
 
 #ifdef _OPENMP
@@ -799,8 +829,8 @@ BENCHFUN
                 omp_set_nested(true);
             }
 
-            if (options.rgbDenoiseThreadLimit > 0)
-                while (denoiseNestedLevels * numthreads > options.rgbDenoiseThreadLimit) {
+            if (threadLimit > 0)
+                while (denoiseNestedLevels * numthreads > threadLimit) {
                     denoiseNestedLevels--;
                 }
 
@@ -867,109 +897,161 @@ BENCHFUN
                     noisevarchrom = new float[((tileheight + 1) / 2) * ((tilewidth + 1) / 2)];
                 }
 
+                // per thread tile buffers, reused for all tiles of this thread
+                std::unique_ptr<LabImage> labdnBuffer;
+                array2D<float> LinBuffer;
+                array2D<float> Ldetail;
+                array2D<float> totwt;
+
+                // streaming in place processes one row of tiles per pass, otherwise all tiles are processed in one pass
+                const int passHeight = streamInPlace ? tileHskip : imheight;
+
+                for (int passTop = streamInPlace ? flushedRows : 0; passTop < imheight; passTop += passHeight) {
+                    const int passBottom = std::min<int>(imheight, passTop + passHeight);
+                    // first image row held in dsttmp
+                    const int dstTop = streamInPlace ? passTop : 0;
 #ifdef _OPENMP
-                #pragma omp for schedule(dynamic) collapse(2)
-#endif
-
-                for (int tiletop = 0; tiletop < imheight; tiletop += tileHskip) {
-                    for (int tileleft = 0; tileleft < imwidth ; tileleft += tileWskip) {
-                        //printf("titop=%d tileft=%d\n",tiletop/tileHskip, tileleft/tileWskip);
-                        pos = (tiletop / tileHskip) * numtiles_W + tileleft / tileWskip ;
-                        int tileright = MIN(imwidth, tileleft + tilewidth);
-                        int tilebottom = MIN(imheight, tiletop + tileheight);
-                        int width  = tileright - tileleft;
-                        int height = tilebottom - tiletop;
-                        int width2 = (width + 1) / 2;
-                        float realred, realblue;
-                        float interm_med = dnparams.chroma / 10.0;
-                        float intermred, intermblue;
-
-                        if (dnparams.redchro > 0.) {
-                            intermred = dnparams.redchro / 10.0;
-                        } else {
-                            intermred = dnparams.redchro / 7.0;     //increase slower than linear for more sensit
-                        }
+                    #pragma omp for schedule(dynamic) collapse(2)
+#endif
 
-                        if (dnparams.bluechro > 0.) {
-                            intermblue = dnparams.bluechro / 10.0;
-                        } else {
-                            intermblue = dnparams.bluechro / 7.0;     //increase slower than linear for more sensit
-                        }
+                    for (int tiletop = passTop; tiletop < passBottom; tiletop += tileHskip) {
+                        for (int tileleft = 0; tileleft < imwidth ; tileleft += tileWskip) {
+                            //printf("titop=%d tileft=%d\n",tiletop/tileHskip, tileleft/tileWskip);
+                            pos = (tiletop / tileHskip) * numtiles_W + tileleft / tileWskip ;
+                            int tileright = MIN(imwidth, tileleft + tilewidth);
+                            int tilebottom = MIN(imheight, tiletop + tileheight);
+                            int width  = tileright - tileleft;
+                            int height = tilebottom - tiletop;
+                            int width2 = (width + 1) / 2;
+                            float realred, realblue;
+                            float interm_med = dnparams.chroma / 10.0;
+                            float intermred, intermblue;
+
+                            if (dnparams.redchro > 0.) {
+                                intermred = dnparams.redchro / 10.0;
+                            } else {
+                                intermred = dnparams.redchro / 7.0;     //increase slower than linear for more sensit
+                            }
 
-                        if (ponder && kall == 2) {
-                            interm_med = ch_M[pos] / 10.f;
-                            intermred = max_r[pos] / 10.f;
-                            intermblue = max_b[pos] / 10.f;
-                        }
+                            if (dnparams.bluechro > 0.) {
+                                intermblue = dnparams.bluechro / 10.0;
+                            } else {
+                                intermblue = dnparams.bluechro / 7.0;     //increase slower than linear for more sensit
+                            }
 
-                        if (ponder && kall == 0) {
-                            interm_med = 0.01f;
-                            intermred = 0.f;
-                            intermblue = 0.f;
-                        }
+                            if (ponder && kall == 2) {
+                                interm_med = ch_M[pos] / 10.f;
+                                intermred = max_r[pos] / 10.f;
+                                intermblue = max_b[pos] / 10.f;
+                            }
+
+                            if (ponder && kall == 0) {
+                                interm_med = 0.01f;
+                                intermred = 0.f;
+                                intermblue = 0.f;
+                            }
 
-                        realred = interm_med + intermred;
+                            realred = interm_med + intermred;
 
-                        if (realred <= 0.f) {
-                            realred = 0.001f;
-                        }
+                            if (realred <= 0.f) {
+                                realred = 0.001f;
+                            }
 
-                        realblue = interm_med + intermblue;
+                            realblue = interm_med + intermblue;
 
-                        if (realblue <= 0.f) {
-                            realblue = 0.001f;
-                        }
+                            if (realblue <= 0.f) {
+                                realblue = 0.001f;
+                            }
 
-                        const float noisevarab_r = SQR(realred);
-                        const float noisevarab_b = SQR(realblue);
+                            const float noisevarab_r = SQR(realred);
+                            const float noisevarab_b = SQR(realblue);
 
-                        //input L channel
-                        array2D<float> *Lin = nullptr;
-                        //wavelet denoised image
-                        LabImage * labdn = new LabImage(width, height);
+                            //input L channel
+                            array2D<float> *Lin = nullptr;
+                            //wavelet denoised image
+                            if (!labdnBuffer || labdnBuffer->W != width || labdnBuffer->H != height) {
+                                labdnBuffer.reset(new LabImage(width, height));
+                            }
+
+                            LabImage * labdn = labdnBuffer.get();
 
-                        //fill tile from image; convert RGB to "luma/chroma"
-                        const float maxNoiseVarab = max(noisevarab_b, noisevarab_r);
+                            //fill tile from image; convert RGB to "luma/chroma"
+                            const float maxNoiseVarab = max(noisevarab_b, noisevarab_r);
 
-                        if (isRAW) {//image is raw; use channel differences for chroma channels
+                            if (isRAW) {//image is raw; use channel differences for chroma channels
 
-                            if (!denoiseMethodRgb) { //lab mode
-                                //modification Jacques feb 2013 and july 2014
+                                if (!denoiseMethodRgb) { //lab mode
+                                    //modification Jacques feb 2013 and july 2014
 #ifdef _OPENMP
-                                #pragma omp parallel for schedule(dynamic,16) num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+                                    #pragma omp parallel for schedule(dynamic,16) num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
 #endif
 
-                                for (int i = tiletop; i < tilebottom; ++i) {
-                                    const int i1 = i - tiletop;
+                                    for (int i = tiletop; i < tilebottom; ++i) {
+                                        const int i1 = i - tiletop;
 
-                                    for (int j = tileleft; j < tileright; ++j) {
-                                        const int j1 = j - tileleft;
+                                        for (int j = tileleft; j < tileright; ++j) {
+                                            const int j1 = j - tileleft;
 
-                                        const float R_ = Color::denoiseIGammaTab[gain * src->r(i, j)];
-                                        const float G_ = Color::denoiseIGammaTab[gain * src->g(i, j)];
-                                        const float B_ = Color::denoiseIGammaTab[gain * src->b(i, j)];
+                                            const float R_ = Color::denoiseIGammaTab[gain * src->r(i, j)];
+                                            const float G_ = Color::denoiseIGammaTab[gain * src->g(i, j)];
+                                            const float B_ = Color::denoiseIGammaTab[gain * src->b(i, j)];
 
-                                        //apply gamma noise standard (slider)
-                                        labdn->L[i1][j1] = R_ < 65535.f ? gamcurve[R_] : Color::gammanf(R_ / 65535.f, gam) * 32768.f;
-                                        labdn->a[i1][j1] = G_ < 65535.f ? gamcurve[G_] : Color::gammanf(G_ / 65535.f, gam) * 32768.f;
-                                        labdn->b[i1][j1] = B_ < 65535.f ? gamcurve[B_] : Color::gammanf(B_ / 65535.f, gam) * 32768.f;
+                                            //apply gamma noise standard (slider)
+                                            labdn->L[i1][j1] = R_ < 65535.f ? gamcurve[R_] : Color::gammanf(R_ / 65535.f, gam) * 32768.f;
+                                            labdn->a[i1][j1] = G_ < 65535.f ? gamcurve[G_] : Color::gammanf(G_ / 65535.f, gam) * 32768.f;
+                                            labdn->b[i1][j1] = B_ < 65535.f ? gamcurve[B_] : Color::gammanf(B_ / 65535.f, gam) * 32768.f;
 
-                                        if (((i1 | j1) & 1) == 0) {
-                                            if (numTries == 1) {
-                                                noisevarlum[(i1 >> 1) * width2 + (j1 >> 1)] = useNoiseLCurve ? lumcalc[i >> 1][j >> 1] : noisevarL;
-                                                noisevarchrom[(i1 >> 1) * width2 + (j1 >> 1)] = useNoiseCCurve ? maxNoiseVarab * ccalc[i >> 1][j >> 1] : 1.f;
-                                            } else {
-                                                noisevarlum[(i1 >> 1) * width2 + (j1 >> 1)] = lumcalc[i >> 1][j >> 1];
-                                                noisevarchrom[(i1 >> 1) * width2 + (j1 >> 1)] = ccalc[i >> 1][j >> 1];
+                                            if (((i1 | j1) & 1) == 0) {
+                                                if (numTries == 1) {
+                                                    noisevarlum[(i1 >> 1) * width2 + (j1 >> 1)] = useNoiseLCurve ? lumcalc[i >> 1][j >> 1] : noisevarL;
+                                                    noisevarchrom[(i1 >> 1) * width2 + (j1 >> 1)] = useNoiseCCurve ? maxNoiseVarab * ccalc[i >> 1][j >> 1] : 1.f;
+                                                } else {
+                                                    noisevarlum[(i1 >> 1) * width2 + (j1 >> 1)] = lumcalc[i >> 1][j >> 1];
+                                                    noisevarchrom[(i1 >> 1) * width2 + (j1 >> 1)] = ccalc[i >> 1][j >> 1];
+                                                }
                                             }
+
+                                            //end chroma
                                         }
+                                        //true conversion xyz=>Lab
+                                        Color::RGB2Lab(labdn->L[i1], labdn->a[i1], labdn->b[i1], labdn->L[i1], labdn->a[i1], labdn->b[i1], wpfast, width);
+                                    }
+                                } else {//RGB mode
+#ifdef _OPENMP
+                                    #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+#endif
+
+                                    for (int i = tiletop; i < tilebottom; ++i) {
+                                        int i1 = i - tiletop;
+
+                                        for (int j = tileleft; j < tileright; ++j) {
+                                            int j1 = j - tileleft;
 
-                                        //end chroma
+                                            float X = gain * src->r(i, j);
+                                            float Y = gain * src->g(i, j);
+                                            float Z = gain * src->b(i, j);
+                                            //conversion colorspace to determine luminance with no gamma
+                                            X = X < 65535.f ? gamcurve[X] : (Color::gammaf(X / 65535.f, gam, gamthresh, gamslope) * 32768.f);
+                                            Y = Y < 65535.f ? gamcurve[Y] : (Color::gammaf(Y / 65535.f, gam, gamthresh, gamslope) * 32768.f);
+                                            Z = Z < 65535.f ? gamcurve[Z] : (Color::gammaf(Z / 65535.f, gam, gamthresh, gamslope) * 32768.f);
+                                            //end chroma
+                                            labdn->L[i1][j1] = Y;
+                                            labdn->a[i1][j1] = (X - Y);
+                                            labdn->b[i1][j1] = (Y - Z);
+
+                                            if (((i1 | j1) & 1) == 0) {
+                                                if (numTries == 1) {
+                                                    noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = useNoiseLCurve ? lumcalc[i >> 1][j >> 1] : noisevarL;
+                                                    noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = useNoiseCCurve ? maxNoiseVarab * ccalc[i >> 1][j >> 1] : 1.f;
+                                                } else {
+                                                    noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = lumcalc[i >> 1][j >> 1];
+                                                    noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = ccalc[i >> 1][j >> 1];
+                                                }
+                                            }
+                                        }
                                     }
-                                    //true conversion xyz=>Lab
-                                    Color::RGB2Lab(labdn->L[i1], labdn->a[i1], labdn->b[i1], labdn->L[i1], labdn->a[i1], labdn->b[i1], wpfast, width);
                                 }
-                            } else {//RGB mode
+                            } else {//image is not raw; use Lab parametrization
 #ifdef _OPENMP
                                 #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
 #endif
@@ -979,274 +1061,202 @@ BENCHFUN
 
                                     for (int j = tileleft; j < tileright; ++j) {
                                         int j1 = j - tileleft;
+                                        float L, a, b;
+                                        float rLum = src->r(i, j) ; //for denoise curves
+                                        float gLum = src->g(i, j) ;
+                                        float bLum = src->b(i, j) ;
+
+                                        //use gamma sRGB, not good if TIF (JPG) Output profil not with gamma sRGB  (eg : gamma =1.0, or 1.8...)
+                                        //very difficult to solve !
+                                        // solution ==> save TIF with gamma sRGB and re open
+                                        float rtmp = Color::igammatab_srgb[ src->r(i, j) ];
+                                        float gtmp = Color::igammatab_srgb[ src->g(i, j) ];
+                                        float btmp = Color::igammatab_srgb[ src->b(i, j) ];
+                                        //modification Jacques feb 2013
+                                        // gamma slider different from raw
+                                        rtmp = rtmp < 65535.f ? gamcurve[rtmp] : (Color::gammanf(rtmp / 65535.f, gam) * 32768.f);
+                                        gtmp = gtmp < 65535.f ? gamcurve[gtmp] : (Color::gammanf(gtmp / 65535.f, gam) * 32768.f);
+                                        btmp = btmp < 65535.f ? gamcurve[btmp] : (Color::gammanf(btmp / 65535.f, gam) * 32768.f);
+
+                                        float X, Y, Z;
+                                        Color::rgbxyz(rtmp, gtmp, btmp, X, Y, Z, wp);
 
-                                        float X = gain * src->r(i, j);
-                                        float Y = gain * src->g(i, j);
-                                        float Z = gain * src->b(i, j);
-                                        //conversion colorspace to determine luminance with no gamma
-                                        X = X < 65535.f ? gamcurve[X] : (Color::gammaf(X / 65535.f, gam, gamthresh, gamslope) * 32768.f);
-                                        Y = Y < 65535.f ? gamcurve[Y] : (Color::gammaf(Y / 65535.f, gam, gamthresh, gamslope) * 32768.f);
-                                        Z = Z < 65535.f ? gamcurve[Z] : (Color::gammaf(Z / 65535.f, gam, gamthresh, gamslope) * 32768.f);
-                                        //end chroma
-                                        labdn->L[i1][j1] = Y;
-                                        labdn->a[i1][j1] = (X - Y);
-                                        labdn->b[i1][j1] = (Y - Z);
+                                        //convert Lab
+                                        Color::XYZ2Lab(X, Y, Z, L, a, b);
+                                        labdn->L[i1][j1] = L;
+                                        labdn->a[i1][j1] = a;
+                                        labdn->b[i1][j1] = b;
 
                                         if (((i1 | j1) & 1) == 0) {
-                                            if (numTries == 1) {
-                                                noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = useNoiseLCurve ? lumcalc[i >> 1][j >> 1] : noisevarL;
-                                                noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = useNoiseCCurve ? maxNoiseVarab * ccalc[i >> 1][j >> 1] : 1.f;
-                                            } else {
-                                                noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = lumcalc[i >> 1][j >> 1];
-                                                noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = ccalc[i >> 1][j >> 1];
+                                            float Llum, alum, blum;
+
+                                            if (useNoiseLCurve || useNoiseCCurve) {
+                                                float XL, YL, ZL;
+                                                Color::rgbxyz(rLum, gLum, bLum, XL, YL, ZL, wp);
+                                                Color::XYZ2Lab(XL, YL, ZL, Llum, alum, blum);
                                             }
-                                        }
-                                    }
-                                }
-                            }
-                        } else {//image is not raw; use Lab parametrization
-#ifdef _OPENMP
-                            #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
-#endif
-
-                            for (int i = tiletop; i < tilebottom; ++i) {
-                                int i1 = i - tiletop;
-
-                                for (int j = tileleft; j < tileright; ++j) {
-                                    int j1 = j - tileleft;
-                                    float L, a, b;
-                                    float rLum = src->r(i, j) ; //for denoise curves
-                                    float gLum = src->g(i, j) ;
-                                    float bLum = src->b(i, j) ;
-
-                                    //use gamma sRGB, not good if TIF (JPG) Output profil not with gamma sRGB  (eg : gamma =1.0, or 1.8...)
-                                    //very difficult to solve !
-                                    // solution ==> save TIF with gamma sRGB and re open
-                                    float rtmp = Color::igammatab_srgb[ src->r(i, j) ];
-                                    float gtmp = Color::igammatab_srgb[ src->g(i, j) ];
-                                    float btmp = Color::igammatab_srgb[ src->b(i, j) ];
-                                    //modification Jacques feb 2013
-                                    // gamma slider different from raw
-                                    rtmp = rtmp < 65535.f ? gamcurve[rtmp] : (Color::gammanf(rtmp / 65535.f, gam) * 32768.f);
-                                    gtmp = gtmp < 65535.f ? gamcurve[gtmp] : (Color::gammanf(gtmp / 65535.f, gam) * 32768.f);
-                                    btmp = btmp < 65535.f ? gamcurve[btmp] : (Color::gammanf(btmp / 65535.f, gam) * 32768.f);
-
-                                    float X, Y, Z;
-                                    Color::rgbxyz(rtmp, gtmp, btmp, X, Y, Z, wp);
-
-                                    //convert Lab
-                                    Color::XYZ2Lab(X, Y, Z, L, a, b);
-                                    labdn->L[i1][j1] = L;
-                                    labdn->a[i1][j1] = a;
-                                    labdn->b[i1][j1] = b;
-
-                                    if (((i1 | j1) & 1) == 0) {
-                                        float Llum, alum, blum;
-
-                                        if (useNoiseLCurve || useNoiseCCurve) {
-                                            float XL, YL, ZL;
-                                            Color::rgbxyz(rLum, gLum, bLum, XL, YL, ZL, wp);
-                                            Color::XYZ2Lab(XL, YL, ZL, Llum, alum, blum);
-                                        }
 
-                                        if (useNoiseLCurve) {
-                                            float kN = Llum;
-                                            float epsi = 0.01f;
+                                            if (useNoiseLCurve) {
+                                                float kN = Llum;
+                                                float epsi = 0.01f;
 
-                                            if (kN < 2.f) {
-                                                kN = 2.f;
-                                            }
+                                                if (kN < 2.f) {
+                                                    kN = 2.f;
+                                                }
+
+                                                if (kN > 32768.f) {
+                                                    kN = 32768.f;
+                                                }
 
-                                            if (kN > 32768.f) {
-                                                kN = 32768.f;
+                                                float kinterm = epsi + noiseLCurve[xdivf(kN, 15) * 500.f];
+                                                float ki = kinterm * 100.f;
+                                                ki += noiseluma;
+                                                noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = SQR((ki / 125.f) * (1.f + ki / 25.f));
+                                            } else {
+                                                noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = noisevarL;
                                             }
 
-                                            float kinterm = epsi + noiseLCurve[xdivf(kN, 15) * 500.f];
-                                            float ki = kinterm * 100.f;
-                                            ki += noiseluma;
-                                            noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = SQR((ki / 125.f) * (1.f + ki / 25.f));
-                                        } else {
-                                            noisevarlum[(i1 >> 1)*width2 + (j1 >> 1)] = noisevarL;
-                                        }
+                                            if (useNoiseCCurve) {
+                                                float aN = alum;
+                                                float bN = blum;
+                                                float cN = sqrtf(SQR(aN) + SQR(bN));
 
-                                        if (useNoiseCCurve) {
-                                            float aN = alum;
-                                            float bN = blum;
-                                            float cN = sqrtf(SQR(aN) + SQR(bN));
+                                                if (cN < 100.f) {
+                                                    cN = 100.f;    //avoid divided by zero ???
+                                                }
 
-                                            if (cN < 100.f) {
-                                                cN = 100.f;    //avoid divided by zero ???
+                                                float Cinterm = 1.f + ponderCC * 4.f * noiseCCurve[cN / 60.f];
+                                                noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = maxNoiseVarab * SQR(Cinterm);
+                                            } else {
+                                                noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = 1.f;
                                             }
-
-                                            float Cinterm = 1.f + ponderCC * 4.f * noiseCCurve[cN / 60.f];
-                                            noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = maxNoiseVarab * SQR(Cinterm);
-                                        } else {
-                                            noisevarchrom[(i1 >> 1)*width2 + (j1 >> 1)] = 1.f;
                                         }
                                     }
                                 }
                             }
-                        }
-
-                        //now perform basic wavelet denoise
-                        //arguments 4 and 5 of wavelet decomposition are max number of wavelet decomposition levels;
-                        //and whether to subsample the image after wavelet filtering.  Subsampling is coded as
-                        //binary 1 or 0 for each level, eg subsampling = 0 means no subsampling, 1 means subsample
-                        //the first level only, 7 means subsample the first three levels, etc.
-                        //actual implementation only works with subsampling set to 1
-                        float interm_medT = dnparams.chroma / 10.0;
-                        bool execwavelet = true;
-
-                        if (!denoiseLuminance && interm_medT < 0.05f && dnparams.median && (dnparams.methodmed == "Lab" || dnparams.methodmed == "Lonly")) {
-                            execwavelet = false;    //do not exec wavelet if sliders luminance and chroma are very small and median need
-                        }
 
-                        //we considered user don't want wavelet
-                        if (settings->leveldnautsimpl == 1 && dnparams.Cmethod != "MAN") {
-                            execwavelet = true;
-                        }
-
-                        if (settings->leveldnautsimpl == 0 && dnparams.C2method != "MANU") {
-                            execwavelet = true;
-                        }
-
-                        if (execwavelet) {//gain time if user choose only median  sliders L <=1  slider chrom master < 1
-                            wavelet_decomposition* Ldecomp;
-                            wavelet_decomposition* adecomp;
-
-                            int levwav = 5;
-                            float maxreal = max(realred, realblue);
-
-                            //increase the level of wavelet if user increase much or very much sliders
-                            if (maxreal < 8.f) {
-                                levwav = 5;
-                            } else if (maxreal < 10.f) {
-                                levwav = 6;
-                            } else if (maxreal < 15.f) {
-                                levwav = 7;
-                            } else {
-                                levwav = 8;    //maximum ==> I have increase Maxlevel in cplx_wavelet_dec.h from 8 to 9
-                            }
-
-                            if (nrQuality == QUALITY_HIGH) {
-                                levwav += settings->nrwavlevel;    //increase level for enhanced mode
-                            }
-
-                            if (levwav > 8) {
-                                levwav = 8;
+                            //now perform basic wavelet denoise
+                            //arguments 4 and 5 of wavelet decomposition are max number of wavelet decomposition levels;
+                            //and whether to subsample the image after wavelet filtering.  Subsampling is coded as
+                            //binary 1 or 0 for each level, eg subsampling = 0 means no subsampling, 1 means subsample
+                            //the first level only, 7 means subsample the first three levels, etc.
+                            //actual implementation only works with subsampling set to 1
+                            float interm_medT = dnparams.chroma / 10.0;
+                            bool execwavelet = true;
+
+                            if (!denoiseLuminance && interm_medT < 0.05f && dnparams.median && (dnparams.methodmed == "Lab" || dnparams.methodmed == "Lonly")) {
+                                execwavelet = false;    //do not exec wavelet if sliders luminance and chroma are very small and median need
                             }
 
-                            int minsizetile = min(tilewidth, tileheight);
-                            int maxlev2 = 8;
-
-                            if (minsizetile < 256) {
-                                maxlev2 = 7;
+                            //we considered user don't want wavelet
+                            if (settings->leveldnautsimpl == 1 && dnparams.Cmethod != "MAN") {
+                                execwavelet = true;
                             }
 
-                            if (minsizetile < 128) {
-                                maxlev2 = 6;
+                            if (settings->leveldnautsimpl == 0 && dnparams.C2method != "MANU") {
+                                execwavelet = true;
                             }
 
-                            if (minsizetile < 64) {
-                                maxlev2 = 5;
-                            }
+                            if (execwavelet) {//gain time if user choose only median  sliders L <=1  slider chrom master < 1
+                                wavelet_decomposition* Ldecomp;
+                                wavelet_decomposition* adecomp;
+
+                                int levwav = 5;
+                                float maxreal = max(realred, realblue);
+
+                                //increase the level of wavelet if user increase much or very much sliders
+                                if (maxreal < 8.f) {
+                                    levwav = 5;
+                                } else if (maxreal < 10.f) {
+                                    levwav = 6;
+                                } else if (maxreal < 15.f) {
+                                    levwav = 7;
+                                } else {
+                                    levwav = 8;    //maximum ==> I have increase Maxlevel in cplx_wavelet_dec.h from 8 to 9
+                                }
 
-                            levwav = min(maxlev2, levwav);
+                                if (nrQuality == QUALITY_HIGH) {
+                                    levwav += settings->nrwavlevel;    //increase level for enhanced mode
+                                }
 
-                            //  if (settings->verbose) printf("levwavelet=%i  noisevarA=%f noisevarB=%f \n",levwav, noisevarab_r, noisevarab_b);
-                            Ldecomp = new wavelet_decomposition(labdn->L[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+                                if (levwav > 8) {
+                                    levwav = 8;
+                                }
 
-                            if (Ldecomp->memoryAllocationFailed) {
-                                memoryAllocationFailed = true;
-                            }
+                                int minsizetile = min(tilewidth, tileheight);
+                                int maxlev2 = 8;
 
-                            float madL[8][3];
+                                if (minsizetile < 256) {
+                                    maxlev2 = 7;
+                                }
 
-                            if (!memoryAllocationFailed) {
-                                // precalculate madL, because it's used in adecomp and bdecomp
-                                int maxlvl = Ldecomp->maxlevel();
-#ifdef _OPENMP
-                                #pragma omp parallel for schedule(dynamic) collapse(2) num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
-#endif
+                                if (minsizetile < 128) {
+                                    maxlev2 = 6;
+                                }
 
-                                for (int lvl = 0; lvl < maxlvl; ++lvl) {
-                                    for (int dir = 1; dir < 4; ++dir) {
-                                        // compute median absolute deviation (MAD) of detail coefficients as robust noise estimator
-                                        int Wlvl_L = Ldecomp->level_W(lvl);
-                                        int Hlvl_L = Ldecomp->level_H(lvl);
+                                if (minsizetile < 64) {
+                                    maxlev2 = 5;
+                                }
 
-                                        float ** WavCoeffs_L = Ldecomp->level_coeffs(lvl);
+                                levwav = min(maxlev2, levwav);
 
-                                        if (!denoiseMethodRgb) {
-                                            madL[lvl][dir - 1] = SQR(Mad(WavCoeffs_L[dir], Wlvl_L * Hlvl_L));
-                                        } else {
-                                            madL[lvl][dir - 1] = SQR(MadRgb(WavCoeffs_L[dir], Wlvl_L * Hlvl_L));
-                                        }
+                                //  if (settings->verbose) printf("levwavelet=%i  noisevarA=%f noisevarB=%f \n",levwav, noisevarab_r, noisevarab_b);
+                                Ldecomp = new wavelet_decomposition(labdn->L[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
 
-                                    }
+                                if (Ldecomp->memoryAllocationFailed) {
+                                    memoryAllocationFailed = true;
                                 }
-                            }
 
-                            float chresid = 0.f;
-                            float chresidtemp = 0.f;
-                            float chmaxresid = 0.f;
-                            float chmaxresidtemp = 0.f;
+                                float madL[8][3];
 
-                            adecomp = new wavelet_decomposition(labdn->a[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+                                if (!memoryAllocationFailed) {
+                                    // precalculate madL, because it's used in adecomp and bdecomp
+                                    int maxlvl = Ldecomp->maxlevel();
+#ifdef _OPENMP
+                                    #pragma omp parallel for schedule(dynamic) collapse(2) num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+#endif
 
-                            if (adecomp->memoryAllocationFailed) {
-                                memoryAllocationFailed = true;
-                            }
+                                    for (int lvl = 0; lvl < maxlvl; ++lvl) {
+                                        for (int dir = 1; dir < 4; ++dir) {
+                                            // compute median absolute deviation (MAD) of detail coefficients as robust noise estimator
+                                            int Wlvl_L = Ldecomp->level_W(lvl);
+                                            int Hlvl_L = Ldecomp->level_H(lvl);
 
-                            if (!memoryAllocationFailed) {
-                                if (nrQuality == QUALITY_STANDARD) {
-                                    if (!WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
-                                        memoryAllocationFailed = true;
-                                    }
-                                } else { /*if (nrQuality==QUALITY_HIGH)*/
-                                    if (!WaveletDenoiseAll_BiShrinkAB(*Ldecomp, *adecomp, noisevarchrom, madL, nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
-                                        memoryAllocationFailed = true;
-                                    }
+                                            float ** WavCoeffs_L = Ldecomp->level_coeffs(lvl);
+
+                                            if (!denoiseMethodRgb) {
+                                                madL[lvl][dir - 1] = SQR(Mad(WavCoeffs_L[dir], Wlvl_L * Hlvl_L));
+                                            } else {
+                                                madL[lvl][dir - 1] = SQR(MadRgb(WavCoeffs_L[dir], Wlvl_L * Hlvl_L));
+                                            }
 
-                                    if (!memoryAllocationFailed) {
-                                        if (!WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) {
-                                            memoryAllocationFailed = true;
                                         }
                                     }
                                 }
-                            }
-
-                            if (!memoryAllocationFailed) {
-                                if (kall == 0) {
-                                    Noise_residualAB(*adecomp, chresid, chmaxresid, denoiseMethodRgb);
-                                    chresidtemp = chresid;
-                                    chmaxresidtemp = chmaxresid;
-                                }
 
-                                adecomp->reconstruct(labdn->a[0]);
-                            }
+                                float chresid = 0.f;
+                                float chresidtemp = 0.f;
+                                float chmaxresid = 0.f;
+                                float chmaxresidtemp = 0.f;
 
-                            delete adecomp;
+                                adecomp = new wavelet_decomposition(labdn->a[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
 
-                            if (!memoryAllocationFailed) {
-                                wavelet_decomposition* bdecomp = new wavelet_decomposition(labdn->b[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
-
-                                if (bdecomp->memoryAllocationFailed) {
+                                if (adecomp->memoryAllocationFailed) {
                                     memoryAllocationFailed = true;
                                 }
 
                                 if (!memoryAllocationFailed) {
                                     if (nrQuality == QUALITY_STANDARD) {
-                                        if (!WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
+                                        if (!WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
                                             memoryAllocationFailed = true;
                                         }
                                     } else { /*if (nrQuality==QUALITY_HIGH)*/
-                                        if (!WaveletDenoiseAll_BiShrinkAB(*Ldecomp, *bdecomp, noisevarchrom, madL, nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
+                                        if (!WaveletDenoiseAll_BiShrinkAB(*Ldecomp, *adecomp, noisevarchrom, madL, nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
                                             memoryAllocationFailed = true;
                                         }
 
                                         if (!memoryAllocationFailed) {
-                                            if (!WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) {
+                                            if (!WaveletDenoiseAllAB(*Ldecomp, *adecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_r, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) {
                                                 memoryAllocationFailed = true;
                                             }
                                         }
@@ -1255,384 +1265,462 @@ BENCHFUN
 
                                 if (!memoryAllocationFailed) {
                                     if (kall == 0) {
-                                        Noise_residualAB(*bdecomp, chresid, chmaxresid, denoiseMethodRgb);
-                                        chresid += chresidtemp;
-                                        chmaxresid += chmaxresidtemp;
-                                        chresid = sqrt(chresid / (6 * (levwav)));
-                                        highresi = chresid + 0.66f * (sqrt(chmaxresid) - chresid); //evaluate sigma
-                                        nresi = chresid;
+                                        Noise_residualAB(*adecomp, chresid, chmaxresid, denoiseMethodRgb);
+                                        chresidtemp = chresid;
+                                        chmaxresidtemp = chmaxresid;
                                     }
 
-                                    bdecomp->reconstruct(labdn->b[0]);
+                                    adecomp->reconstruct(labdn->a[0]);
                                 }
 
-                                delete bdecomp;
+                                delete adecomp;
 
                                 if (!memoryAllocationFailed) {
-                                    if (denoiseLuminance) {
-                                        int edge = 0;
+                                    wavelet_decomposition* bdecomp = new wavelet_decomposition(labdn->b[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+
+                                    if (bdecomp->memoryAllocationFailed) {
+                                        memoryAllocationFailed = true;
+                                    }
 
+                                    if (!memoryAllocationFailed) {
                                         if (nrQuality == QUALITY_STANDARD) {
-                                            if (!WaveletDenoiseAllL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) { //enhance mode
+                                            if (!WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
                                                 memoryAllocationFailed = true;
                                             }
                                         } else { /*if (nrQuality==QUALITY_HIGH)*/
-                                            if (!WaveletDenoiseAll_BiShrinkL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) { //enhance mode
+                                            if (!WaveletDenoiseAll_BiShrinkAB(*Ldecomp, *bdecomp, noisevarchrom, madL, nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) { //enhance mode
                                                 memoryAllocationFailed = true;
                                             }
 
                                             if (!memoryAllocationFailed) {
-                                                if (!WaveletDenoiseAllL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) {
+                                                if (!WaveletDenoiseAllAB(*Ldecomp, *bdecomp, noisevarchrom, madL,  nullptr, 0, noisevarab_b, useNoiseCCurve, autoch, denoiseMethodRgb, denoiseNestedLevels)) {
                                                     memoryAllocationFailed = true;
                                                 }
                                             }
                                         }
+                                    }
 
-                                        if (!memoryAllocationFailed) {
-                                            // copy labdn->L to Lin before it gets modified by reconstruction
-                                            Lin = new array2D<float>(width, height);
+                                    if (!memoryAllocationFailed) {
+                                        if (kall == 0) {
+                                            Noise_residualAB(*bdecomp, chresid, chmaxresid, denoiseMethodRgb);
+                                            chresid += chresidtemp;
+                                            chmaxresid += chmaxresidtemp;
+                                            chresid = sqrt(chresid / (6 * (levwav)));
+                                            highresi = chresid + 0.66f * (sqrt(chmaxresid) - chresid); //evaluate sigma
+                                            nresi = chresid;
+                                        }
+
+                                        bdecomp->reconstruct(labdn->b[0]);
+                                    }
+
+                                    delete bdecomp;
+
+                                    if (!memoryAllocationFailed) {
+                                        if (denoiseLuminance) {
+                                            int edge = 0;
+
+                                            if (nrQuality == QUALITY_STANDARD) {
+                                                if (!WaveletDenoiseAllL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) { //enhance mode
+                                                    memoryAllocationFailed = true;
+                                                }
+                                            } else { /*if (nrQuality==QUALITY_HIGH)*/
+                                                if (!WaveletDenoiseAll_BiShrinkL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) { //enhance mode
+                                                    memoryAllocationFailed = true;
+                                                }
+
+                                                if (!memoryAllocationFailed) {
+                                                    if (!WaveletDenoiseAllL(*Ldecomp, noisevarlum, madL, nullptr, edge, denoiseNestedLevels)) {
+                                                        memoryAllocationFailed = true;
+                                                    }
+                                                }
+                                            }
+
+                                            if (!memoryAllocationFailed) {
+                                                // copy labdn->L to Lin before it gets modified by reconstruction
+                                                LinBuffer(width, height);
+                                                Lin = &LinBuffer;
 #ifdef _OPENMP
-                                            #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+                                                #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
 #endif
 
-                                            for (int i = 0; i < height; ++i) {
-                                                for (int j = 0; j < width; ++j) {
-                                                    (*Lin)[i][j] = labdn->L[i][j];
+                                                for (int i = 0; i < height; ++i) {
+                                                    for (int j = 0; j < width; ++j) {
+                                                        (*Lin)[i][j] = labdn->L[i][j];
+                                                    }
                                                 }
-                                            }
 
-                                            Ldecomp->reconstruct(labdn->L[0]);
+                                                Ldecomp->reconstruct(labdn->L[0]);
+                                            }
                                         }
                                     }
                                 }
-                            }
-
-                            delete Ldecomp;
-                        }
 
-                        if (!memoryAllocationFailed) {
-                            //wavelet denoised L channel
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                            // now do detail recovery using block DCT to detect
-                            // patterns missed by wavelet denoise
-                            // blocks are not the same thing as tiles!
-
-                            // calculation for detail recovery blocks
-                            const int numblox_W = ceil((static_cast<float>(width)) / (offset)) + 2 * blkrad;
-                            const int numblox_H = ceil((static_cast<float>(height)) / (offset)) + 2 * blkrad;
+                                delete Ldecomp;
+                            }
 
+                            if (!memoryAllocationFailed) {
+                                //wavelet denoised L channel
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                // now do detail recovery using block DCT to detect
+                                // patterns missed by wavelet denoise
+                                // blocks are not the same thing as tiles!
 
+                                // calculation for detail recovery blocks
+                                const int numblox_W = ceil((static_cast<float>(width)) / (offset)) + 2 * blkrad;
+                                const int numblox_H = ceil((static_cast<float>(height)) / (offset)) + 2 * blkrad;
 
-                            // end of tiling calc
 
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                            // Main detail recovery algorithm: Block loop
-                            //DCT block data storage
 
-                            if (denoiseLuminance /*&& execwavelet*/) {
-                                //residual between input and denoised L channel
-                                array2D<float> Ldetail(width, height, ARRAY2D_CLEAR_DATA);
-                                //pixel weight
-                                array2D<float> totwt(width, height, ARRAY2D_CLEAR_DATA); //weight for combining DCT blocks
+                                // end of tiling calc
 
-                                if (numtiles == 1) {
-                                    for (int i = 0; i < denoiseNestedLevels * numthreads; ++i) {
-                                        LbloxArray[i]  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-                                        fLbloxArray[i] = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                // Main detail recovery algorithm: Block loop
+                                //DCT block data storage
+
+                                if (denoiseLuminance /*&& execwavelet*/) {
+                                    //residual between input and denoised L channel
+                                    Ldetail(width, height, ARRAY2D_CLEAR_DATA);
+                                    //pixel weight
+                                    totwt(width, height, ARRAY2D_CLEAR_DATA); //weight for combining DCT blocks
+
+                                    if (numtiles == 1) {
+                                        for (int i = 0; i < denoiseNestedLevels * numthreads; ++i) {
+                                            LbloxArray[i]  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
+                                            fLbloxArray[i] = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
+                                        }
                                     }
-                                }
 
 #ifdef _OPENMP
-                                int masterThread = omp_get_thread_num();
-                                #pragma omp parallel num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+                                    int masterThread = omp_get_thread_num();
+                                    #pragma omp parallel num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
 #endif
-                                {
+                                    {
 #ifdef _OPENMP
-                                    int subThread = masterThread * denoiseNestedLevels + omp_get_thread_num();
+                                        int subThread = masterThread * denoiseNestedLevels + omp_get_thread_num();
 #else
-                                    int subThread = 0;
+                                        int subThread = 0;
 #endif
-//                                    float blurbuffer[TS * TS] ALIGNED64;
-                                    float *Lblox = LbloxArray[subThread];
-                                    float *fLblox = fLbloxArray[subThread];
-                                    float pBuf[width + TS + 2 * blkrad * offset] ALIGNED16;
-//                                    float nbrwt[TS * TS] ALIGNED64;
+    //                                    float blurbuffer[TS * TS] ALIGNED64;
+                                        float *Lblox = LbloxArray[subThread];
+                                        float *fLblox = fLbloxArray[subThread];
+                                        float pBuf[width + TS + 2 * blkrad * offset] ALIGNED16;
+    //                                    float nbrwt[TS * TS] ALIGNED64;
 #ifdef _OPENMP
-                                    #pragma omp for
+                                        #pragma omp for
 #endif
 
-                                    for (int vblk = 0; vblk < numblox_H; ++vblk) {
-
-                                        int top = (vblk - blkrad) * offset;
-                                        float * datarow = pBuf + blkrad * offset;
+                                        for (int vblk = 0; vblk < numblox_H; ++vblk) {
 
-                                        for (int i = 0; i < TS; ++i) {
-                                            int row = top + i;
-                                            int rr = row;
+                                            int top = (vblk - blkrad) * offset;
+                                            float * datarow = pBuf + blkrad * offset;
 
-                                            if (row < 0) {
-                                                rr = MIN(-row, height - 1);
-                                            } else if (row >= height) {
-                                                rr = MAX(0, 2 * height - 2 - row);
-                                            }
-
-                                            for (int j = 0; j < labdn->W; ++j) {
-                                                datarow[j] = ((*Lin)[rr][j] - labdn->L[rr][j]);
-                                            }
-
-                                            for (int j = -blkrad * offset; j < 0; ++j) {
-                                                datarow[j] = datarow[MIN(-j, width - 1)];
-                                            }
+                                            for (int i = 0; i < TS; ++i) {
+                                                int row = top + i;
+                                                int rr = row;
 
-                                            for (int j = width; j < width + TS + blkrad * offset; ++j) {
-                                                datarow[j] = datarow[MAX(0, 2 * width - 2 - j)];
-                                            }//now we have a padded data row
-
-                                            //now fill this row of the blocks with Lab high pass data
-                                            for (int hblk = 0; hblk < numblox_W; ++hblk) {
-                                                int left = (hblk - blkrad) * offset;
-                                                int indx = (hblk) * TS; //index of block in malloc
+                                                if (row < 0) {
+                                                    rr = MIN(-row, height - 1);
+                                                } else if (row >= height) {
+                                                    rr = MAX(0, 2 * height - 2 - row);
+                                                }
 
-                                                if (top + i >= 0 && top + i < height) {
-                                                    int j;
+                                                for (int j = 0; j < labdn->W; ++j) {
+                                                    datarow[j] = ((*Lin)[rr][j] - labdn->L[rr][j]);
+                                                }
 
-                                                    for (j = 0; j < min((-left), TS); ++j) {
-                                                        Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
-                                                    }
+                                                for (int j = -blkrad * offset; j < 0; ++j) {
+                                                    datarow[j] = datarow[MIN(-j, width - 1)];
+                                                }
 
-                                                    for (; j < min(TS, width - left); ++j) {
-                                                        Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
-                                                        totwt[top + i][left + j] += tilemask_in[i][j] * tilemask_out[i][j];
+                                                for (int j = width; j < width + TS + blkrad * offset; ++j) {
+                                                    datarow[j] = datarow[MAX(0, 2 * width - 2 - j)];
+                                                }//now we have a padded data row
+
+                                                //now fill this row of the blocks with Lab high pass data
+                                                for (int hblk = 0; hblk < numblox_W; ++hblk) {
+                                                    int left = (hblk - blkrad) * offset;
+                                                    int indx = (hblk) * TS; //index of block in malloc
+
+                                                    if (top + i >= 0 && top + i < height) {
+                                                        int j;
+
+                                                        for (j = 0; j < min((-left), TS); ++j) {
+                                                            Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
+                                                        }
+
+                                                        for (; j < min(TS, width - left); ++j) {
+                                                            Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
+                                                            totwt[top + i][left + j] += tilemask_in[i][j] * tilemask_out[i][j];
+                                                        }
+
+                                                        for (; j < TS; ++j) {
+                                                            Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
+                                                        }
+                                                    } else {
+                                                        for (int j = 0; j < TS; ++j) {
+                                                            Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
+                                                        }
                                                     }
 
-                                                    for (; j < TS; ++j) {
-                                                        Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
-                                                    }
-                                                } else {
-                                                    for (int j = 0; j < TS; ++j) {
-                                                        Lblox[(indx + i)*TS + j] = tilemask_in[i][j] * datarow[left + j]; // luma data
-                                                    }
                                                 }
 
+                                            }//end of filling block row
+
+                                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                            //fftwf_print_plan (plan_forward_blox);
+                                            if (numblox_W == max_numblox_W) {
+                                                fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
+                                            } else {
+                                                fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
                                             }
 
-                                        }//end of filling block row
+                                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                            // now process the vblk row of blocks for noise reduction
 
-                                        //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                                        //fftwf_print_plan (plan_forward_blox);
-                                        if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
-                                        } else {
-                                            fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
-                                        }
 
-                                        //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                                        // now process the vblk row of blocks for noise reduction
+                                            for (int hblk = 0; hblk < numblox_W; ++hblk) {
+                                                RGBtile_denoise(fLblox, hblk, noisevar_Ldetail);
+                     //  RGBtile_denoise(fLblox, hblk, noisevar_Ldetail, nbrwt, blurbuffer);
+                                            }//end of horizontal block loop
 
+                                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-                                        for (int hblk = 0; hblk < numblox_W; ++hblk) {
-                                            RGBtile_denoise(fLblox, hblk, noisevar_Ldetail);
-                 //  RGBtile_denoise(fLblox, hblk, noisevar_Ldetail, nbrwt, blurbuffer);
-                                        }//end of horizontal block loop
+                                            //now perform inverse FT of an entire row of blocks
+                                            if (numblox_W == max_numblox_W) {
+                                                fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
+                                            } else {
+                                                fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
+                                            }
 
-                                        //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                            int topproc = (vblk - blkrad) * offset;
 
-                                        //now perform inverse FT of an entire row of blocks
-                                        if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
-                                        } else {
-                                            fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
-                                        }
+                                            //add row of blocks to output image tile
+                                            RGBoutput_tile_row(Lblox, Ldetail, tilemask_out, height, width, topproc);
 
-                                        int topproc = (vblk - blkrad) * offset;
+                                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-                                        //add row of blocks to output image tile
-                                        RGBoutput_tile_row(Lblox, Ldetail, tilemask_out, height, width, topproc);
+                                        }//end of vertical block loop
 
                                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-                                    }//end of vertical block loop
-
+                                    }
                                     //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-                                }
-                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-
 #ifdef _OPENMP
-                                #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
+                                    #pragma omp parallel for num_threads(denoiseNestedLevels) if (denoiseNestedLevels>1)
 #endif
 
-                                for (int i = 0; i < height; ++i) {
-                                    for (int j = 0; j < width; ++j) {
-                                        //may want to include masking threshold for large hipass data to preserve edges/detail
-                                        labdn->L[i][j] += Ldetail[i][j] / totwt[i][j]; //note that labdn initially stores the denoised hipass data
+                                    for (int i = 0; i < height; ++i) {
+                                        for (int j = 0; j < width; ++j) {
+                                            //may want to include masking threshold for large hipass data to preserve edges/detail
+                                            labdn->L[i][j] += Ldetail[i][j] / totwt[i][j]; //note that labdn initially stores the denoised hipass data
+                                        }
                                     }
                                 }
-                            }
 
-                            if ((metchoice == 1 || metchoice == 2 || metchoice == 3 || metchoice == 4) && dnparams.median) {
-                                float** tmL;
-                                int wid = labdn->W;
-                                int hei = labdn->H;
-                                tmL = new float*[hei];
+                                if ((metchoice == 1 || metchoice == 2 || metchoice == 3 || metchoice == 4) && dnparams.median) {
+                                    float** tmL;
+                                    int wid = labdn->W;
+                                    int hei = labdn->H;
+                                    tmL = new float*[hei];
 
-                                for (int i = 0; i < hei; ++i) {
-                                    tmL[i] = new float[wid];
-                                }
+                                    for (int i = 0; i < hei; ++i) {
+                                        tmL[i] = new float[wid];
+                                    }
 
-                                Median medianTypeL = Median::TYPE_3X3_SOFT;
-                                Median medianTypeAB = Median::TYPE_3X3_SOFT;
+                                    Median medianTypeL = Median::TYPE_3X3_SOFT;
+                                    Median medianTypeAB = Median::TYPE_3X3_SOFT;
 
-                                if (dnparams.medmethod == "soft") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_3X3_SOFT;
-                                    } else {
-                                        medianTypeL = Median::TYPE_3X3_SOFT;
-                                        medianTypeAB = Median::TYPE_3X3_SOFT;
-                                    }
-                                } else if (dnparams.medmethod == "33") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_3X3_STRONG;
-                                    } else {
-                                        medianTypeL = Median::TYPE_3X3_SOFT;
-                                        medianTypeAB = Median::TYPE_3X3_STRONG;
-                                    }
-                                } else if (dnparams.medmethod == "55soft") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_5X5_SOFT;
-                                    } else {
-                                        medianTypeL = Median::TYPE_3X3_SOFT;
-                                        medianTypeAB = Median::TYPE_5X5_SOFT;
-                                    }
-                                } else if (dnparams.medmethod == "55") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_5X5_STRONG;
-                                    } else {
-                                        medianTypeL = Median::TYPE_3X3_STRONG;
-                                        medianTypeAB = Median::TYPE_5X5_STRONG;
-                                    }
-                                } else if (dnparams.medmethod == "77") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_7X7;
-                                    } else {
-                                        medianTypeL = Median::TYPE_3X3_STRONG;
-                                        medianTypeAB = Median::TYPE_7X7;
+                                    if (dnparams.medmethod == "soft") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_3X3_SOFT;
+                                        } else {
+                                            medianTypeL = Median::TYPE_3X3_SOFT;
+                                            medianTypeAB = Median::TYPE_3X3_SOFT;
+                                        }
+                                    } else if (dnparams.medmethod == "33") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_3X3_STRONG;
+                                        } else {
+                                            medianTypeL = Median::TYPE_3X3_SOFT;
+                                            medianTypeAB = Median::TYPE_3X3_STRONG;
+                                        }
+                                    } else if (dnparams.medmethod == "55soft") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_5X5_SOFT;
+                                        } else {
+                                            medianTypeL = Median::TYPE_3X3_SOFT;
+                                            medianTypeAB = Median::TYPE_5X5_SOFT;
+                                        }
+                                    } else if (dnparams.medmethod == "55") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_5X5_STRONG;
+                                        } else {
+                                            medianTypeL = Median::TYPE_3X3_STRONG;
+                                            medianTypeAB = Median::TYPE_5X5_STRONG;
+                                        }
+                                    } else if (dnparams.medmethod == "77") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_7X7;
+                                        } else {
+                                            medianTypeL = Median::TYPE_3X3_STRONG;
+                                            medianTypeAB = Median::TYPE_7X7;
+                                        }
+                                    } else if (dnparams.medmethod == "99") {
+                                        if (metchoice != 4) {
+                                            medianTypeL = medianTypeAB = Median::TYPE_9X9;
+                                        } else {
+                                            medianTypeL = Median::TYPE_5X5_SOFT;
+                                            medianTypeAB = Median::TYPE_9X9;
+                                        }
                                     }
-                                } else if (dnparams.medmethod == "99") {
-                                    if (metchoice != 4) {
-                                        medianTypeL = medianTypeAB = Median::TYPE_9X9;
-                                    } else {
-                                        medianTypeL = Median::TYPE_5X5_SOFT;
-                                        medianTypeAB = Median::TYPE_9X9;
+
+                                    if (metchoice == 1 || metchoice == 2 || metchoice == 4) {
+                                        Median_Denoise(labdn->L, labdn->L, wid, hei, medianTypeL, dnparams.passes, denoiseNestedLevels, tmL);
                                     }
-                                }
 
-                                if (metchoice == 1 || metchoice == 2 || metchoice == 4) {
-                                    Median_Denoise(labdn->L, labdn->L, wid, hei, medianTypeL, dnparams.passes, denoiseNestedLevels, tmL);
-                                }
+                                    if (metchoice == 2 || metchoice == 3 || metchoice == 4) {
+                                        Median_Denoise(labdn->a, labdn->a, wid, hei, medianTypeAB, dnparams.passes, denoiseNestedLevels, tmL);
+                                        Median_Denoise(labdn->b, labdn->b, wid, hei, medianTypeAB, dnparams.passes, denoiseNestedLevels, tmL);
+                                    }
 
-                                if (metchoice == 2 || metchoice == 3 || metchoice == 4) {
-                                    Median_Denoise(labdn->a, labdn->a, wid, hei, medianTypeAB, dnparams.passes, denoiseNestedLevels, tmL);
-                                    Median_Denoise(labdn->b, labdn->b, wid, hei, medianTypeAB, dnparams.passes, denoiseNestedLevels, tmL);
-                                }
+                                    for (int i = 0; i < hei; ++i) {
+                                        delete[] tmL[i];
+                                    }
 
-                                for (int i = 0; i < hei; ++i) {
-                                    delete[] tmL[i];
+                                    delete[] tmL;
                                 }
 
-                                delete[] tmL;
-                            }
-
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-                            // transform denoised "Lab" to output RGB
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                                // transform denoised "Lab" to output RGB
 
-                            //calculate mask for feathering output tile overlaps
-                            float Vmask[height + 1] ALIGNED16;
-                            float Hmask[width + 1] ALIGNED16;
-                            float newGain;
+                                //calculate mask for feathering output tile overlaps
+                                float Vmask[height + 1] ALIGNED16;
+                                float Hmask[width + 1] ALIGNED16;
+                                float newGain;
 
-                            if (numtiles > 1) {
-                                for (int i = 0; i < height; ++i) {
-                                    Vmask[i] = 1;
-                                }
+                                if (numtiles > 1) {
+                                    for (int i = 0; i < height; ++i) {
+                                        Vmask[i] = 1;
+                                    }
 
-                                newGain = 1.f;
+                                    newGain = 1.f;
 
-                                if (isRAW) {
-                                    newGain = gain;
-                                }
+                                    if (isRAW) {
+                                        newGain = gain;
+                                    }
 
-                                for (int j = 0; j < width; ++j) {
-                                    Hmask[j] = 1.f / newGain;
-                                }
+                                    for (int j = 0; j < width; ++j) {
+                                        Hmask[j] = 1.f / newGain;
+                                    }
 
-                                for (int i = 0; i < overlap; ++i) {
-                                    float mask = SQR(xsinf((rtengine::RT_PI * i) / (2 * overlap)));
+                                    for (int i = 0; i < overlap; ++i) {
+                                        float mask = SQR(xsinf((rtengine::RT_PI * i) / (2 * overlap)));
 
-                                    if (tiletop > 0) {
-                                        Vmask[i] = mask;
-                                    }
+                                        if (tiletop > 0) {
+                                            Vmask[i] = mask;
+                                        }
 
-                                    if (tilebottom < imheight) {
-                                        Vmask[height - i] = mask;
-                                    }
+                                        if (tilebottom < imheight) {
+                                            Vmask[height - i] = mask;
+                                        }
 
-                                    if (tileleft > 0) {
-                                        Hmask[i] = mask / newGain;
-                                    }
+                                        if (tileleft > 0) {
+                                            Hmask[i] = mask / newGain;
+                                        }
 
-                                    if (tileright < imwidth) {
-                                        Hmask[width - i] = mask / newGain;
+                                        if (tileright < imwidth) {
+                                            Hmask[width - i] = mask / newGain;
+                                        }
                                     }
+                                } else {
+                                    newGain = isRAW ? 1.f / gain : 1.f;;
                                 }
-                            } else {
-                                newGain = isRAW ? 1.f / gain : 1.f;;
-                            }
 
-                            //convert back to RGB and write to destination array
-                            if (isRAW) {
-                                if (!denoiseMethodRgb) {//Lab mode
-                                    realred /= 100.f;
-                                    realblue /= 100.f;
+                                //convert back to RGB and write to destination array
+                                if (isRAW) {
+                                    if (!denoiseMethodRgb) {//Lab mode
+                                        realred /= 100.f;
+                                        realblue /= 100.f;
 
 #ifdef _OPENMP
-                                    #pragma omp parallel for schedule(dynamic,16) num_threads(denoiseNestedLevels)
+                                        #pragma omp parallel for schedule(dynamic,16) num_threads(denoiseNestedLevels)
 #endif
 
-                                    for (int i = tiletop; i < tilebottom; ++i) {
-                                        int i1 = i - tiletop;
-                                        //true conversion Lab==>xyz
-                                        Color::Lab2RGBLimit(labdn->L[i1], labdn->a[i1], labdn->b[i1], labdn->L[i1], labdn->a[i1], labdn->b[i1], wip, 9000000.f, 1.f + qhighFactor * realred, 1.f + qhighFactor * realblue, width);
-                                        for (int j = tileleft; j < tileright; ++j) {
-                                            int j1 = j - tileleft;
-                                            float r_ = std::max(0.f, labdn->L[i1][j1]);
-                                            float g_ = std::max(0.f, labdn->a[i1][j1]);
-                                            float b_ = std::max(0.f, labdn->b[i1][j1]);
-                                            //inverse gamma standard (slider)
-                                            r_ = r_ < 32768.f ? igamcurve[r_] : (Color::gammanf(r_ / 32768.f, igam) * 65535.f);
-                                            g_ = g_ < 32768.f ? igamcurve[g_] : (Color::gammanf(g_ / 32768.f, igam) * 65535.f);
-                                            b_ = b_ < 32768.f ? igamcurve[b_] : (Color::gammanf(b_ / 32768.f, igam) * 65535.f);
+                                        for (int i = tiletop; i < tilebottom; ++i) {
+                                            int i1 = i - tiletop;
+                                            //true conversion Lab==>xyz
+                                            Color::Lab2RGBLimit(labdn->L[i1], labdn->a[i1], labdn->b[i1], labdn->L[i1], labdn->a[i1], labdn->b[i1], wip, 9000000.f, 1.f + qhighFactor * realred, 1.f + qhighFactor * realblue, width);
+                                            for (int j = tileleft; j < tileright; ++j) {
+                                                int j1 = j - tileleft;
+                                                float r_ = std::max(0.f, labdn->L[i1][j1]);
+                                                float g_ = std::max(0.f, labdn->a[i1][j1]);
+                                                float b_ = std::max(0.f, labdn->b[i1][j1]);
+                                                //inverse gamma standard (slider)
+                                                r_ = r_ < 32768.f ? igamcurve[r_] : (Color::gammanf(r_ / 32768.f, igam) * 65535.f);
+                                                g_ = g_ < 32768.f ? igamcurve[g_] : (Color::gammanf(g_ / 32768.f, igam) * 65535.f);
+                                                b_ = b_ < 32768.f ? igamcurve[b_] : (Color::gammanf(b_ / 32768.f, igam) * 65535.f);
+
+                                                //readapt arbitrary gamma (inverse from beginning)
+                                                r_ = Color::denoiseGammaTab[r_];
+                                                g_ = Color::denoiseGammaTab[g_];
+                                                b_ = Color::denoiseGammaTab[b_];
+
+                                                if (numtiles == 1) {
+                                                    dsttmp->r(i - dstTop, j) = newGain * r_;
+                                                    dsttmp->g(i - dstTop, j) = newGain * g_;
+                                                    dsttmp->b(i - dstTop, j) = newGain * b_;
+                                                } else {
+                                                    float factor = Vmask[i1] * Hmask[j1];
+                                                    dsttmp->r(i - dstTop, j) += factor * r_;
+                                                    dsttmp->g(i - dstTop, j) += factor * g_;
+                                                    dsttmp->b(i - dstTop, j) += factor * b_;
+                                                }
+                                            }
+                                        }
+                                    } else {//RGB mode
+#ifdef _OPENMP
+                                        #pragma omp parallel for num_threads(denoiseNestedLevels)
+#endif
 
-                                            //readapt arbitrary gamma (inverse from beginning)
-                                            r_ = Color::denoiseGammaTab[r_];
-                                            g_ = Color::denoiseGammaTab[g_];
-                                            b_ = Color::denoiseGammaTab[b_];
+                                        for (int i = tiletop; i < tilebottom; ++i) {
+                                            int i1 = i - tiletop;
 
-                                            if (numtiles == 1) {
-                                                dsttmp->r(i, j) = newGain * r_;
-                                                dsttmp->g(i, j) = newGain * g_;
-                                                dsttmp->b(i, j) = newGain * b_;
-                                            } else {
-                                                float factor = Vmask[i1] * Hmask[j1];
-                                                dsttmp->r(i, j) += factor * r_;
-                                                dsttmp->g(i, j) += factor * g_;
-                                                dsttmp->b(i, j) += factor * b_;
+                                            for (int j = tileleft; j < tileright; ++j) {
+                                                int j1 = j - tileleft;
+                                                float c_h = sqrt(SQR(labdn->a[i1][j1]) + SQR(labdn->b[i1][j1]));
+
+                                                if (c_h > 3000.f) {
+                                                    labdn->a[i1][j1] *= 1.f + qhighFactor * realred / 100.f;
+                                                    labdn->b[i1][j1] *= 1.f + qhighFactor * realblue / 100.f;
+                                                }
+
+                                                float Y = labdn->L[i1][j1];
+                                                float X = (labdn->a[i1][j1]) + Y;
+                                                float Z = Y - (labdn->b[i1][j1]);
+
+
+                                                X = X < 32768.f ? igamcurve[X] : (Color::gammaf(X / 32768.f, igam, igamthresh, igamslope) * 65535.f);
+                                                Y = Y < 32768.f ? igamcurve[Y] : (Color::gammaf(Y / 32768.f, igam, igamthresh, igamslope) * 65535.f);
+                                                Z = Z < 32768.f ? igamcurve[Z] : (Color::gammaf(Z / 32768.f, igam, igamthresh, igamslope) * 65535.f);
+
+                                                if (numtiles == 1) {
+                                                    dsttmp->r(i - dstTop, j) = newGain * X;
+                                                    dsttmp->g(i - dstTop, j) = newGain * Y;
+                                                    dsttmp->b(i - dstTop, j) = newGain * Z;
+                                                } else {
+                                                    float factor = Vmask[i1] * Hmask[j1];
+                                                    dsttmp->r(i - dstTop, j) += factor * X;
+                                                    dsttmp->g(i - dstTop, j) += factor * Y;
+                                                    dsttmp->b(i - dstTop, j) += factor * Z;
+                                                }
                                             }
                                         }
+
                                     }
-                                } else {//RGB mode
+                                } else {
 #ifdef _OPENMP
                                     #pragma omp parallel for num_threads(denoiseNestedLevels)
 #endif
@@ -1642,89 +1730,93 @@ BENCHFUN
 
                                         for (int j = tileleft; j < tileright; ++j) {
                                             int j1 = j - tileleft;
-                                            float c_h = sqrt(SQR(labdn->a[i1][j1]) + SQR(labdn->b[i1][j1]));
+                                            //modification Jacques feb 2013
+                                            float L = labdn->L[i1][j1];
+                                            float a = labdn->a[i1][j1];
+                                            float b = labdn->b[i1][j1];
+                                            float c_h = sqrt(SQR(a) + SQR(b));
 
                                             if (c_h > 3000.f) {
-                                                labdn->a[i1][j1] *= 1.f + qhighFactor * realred / 100.f;
-                                                labdn->b[i1][j1] *= 1.f + qhighFactor * realblue / 100.f;
+                                                a *= 1.f + qhighFactor * realred / 100.f;
+                                                b *= 1.f + qhighFactor * realblue / 100.f;
                                             }
 
-                                            float Y = labdn->L[i1][j1];
-                                            float X = (labdn->a[i1][j1]) + Y;
-                                            float Z = Y - (labdn->b[i1][j1]);
-
+                                            float X, Y, Z;
+                                            Color::Lab2XYZ(L, a, b, X, Y, Z);
 
-                                            X = X < 32768.f ? igamcurve[X] : (Color::gammaf(X / 32768.f, igam, igamthresh, igamslope) * 65535.f);
-                                            Y = Y < 32768.f ? igamcurve[Y] : (Color::gammaf(Y / 32768.f, igam, igamthresh, igamslope) * 65535.f);
-                                            Z = Z < 32768.f ? igamcurve[Z] : (Color::gammaf(Z / 32768.f, igam, igamthresh, igamslope) * 65535.f);
+                                            float r_, g_, b_;
+                                            Color::xyz2rgb(X, Y, Z, r_, g_, b_, wip);
+                                            //gamma slider is different from Raw
+                                            r_ = r_ < 32768.f ? igamcurve[r_] : (Color::gammanf(r_ / 32768.f, igam) * 65535.f);
+                                            g_ = g_ < 32768.f ? igamcurve[g_] : (Color::gammanf(g_ / 32768.f, igam) * 65535.f);
+                                            b_ = b_ < 32768.f ? igamcurve[b_] : (Color::gammanf(b_ / 32768.f, igam) * 65535.f);
 
                                             if (numtiles == 1) {
-                                                dsttmp->r(i, j) = newGain * X;
-                                                dsttmp->g(i, j) = newGain * Y;
-                                                dsttmp->b(i, j) = newGain * Z;
+                                                dsttmp->r(i - dstTop, j) = newGain * r_;
+                                                dsttmp->g(i - dstTop, j) = newGain * g_;
+                                                dsttmp->b(i - dstTop, j) = newGain * b_;
                                             } else {
                                                 float factor = Vmask[i1] * Hmask[j1];
-                                                dsttmp->r(i, j) += factor * X;
-                                                dsttmp->g(i, j) += factor * Y;
-                                                dsttmp->b(i, j) += factor * Z;
+                                                dsttmp->r(i - dstTop, j) += factor * r_;
+                                                dsttmp->g(i - dstTop, j) += factor * g_;
+                                                dsttmp->b(i - dstTop, j) += factor * b_;
                                             }
                                         }
                                     }
-
                                 }
-                            } else {
+
+                                //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                            }
+
+                        }//end of tile row
+                    }//end of tile loop
+
+                    if (streamInPlace) {
+                        if (memoryAllocationFailed) {
+                            // the next try redoes this row of tiles
+                            break;
+                        }
+
+                        // the rows above the next row of tiles are complete and no later tile reads them from src
 #ifdef _OPENMP
-                                #pragma omp parallel for num_threads(denoiseNestedLevels)
+                        #pragma omp for
 #endif
 
-                                for (int i = tiletop; i < tilebottom; ++i) {
-                                    int i1 = i - tiletop;
-
-                                    for (int j = tileleft; j < tileright; ++j) {
-                                        int j1 = j - tileleft;
-                                        //modification Jacques feb 2013
-                                        float L = labdn->L[i1][j1];
-                                        float a = labdn->a[i1][j1];
-                                        float b = labdn->b[i1][j1];
-                                        float c_h = sqrt(SQR(a) + SQR(b));
-
-                                        if (c_h > 3000.f) {
-                                            a *= 1.f + qhighFactor * realred / 100.f;
-                                            b *= 1.f + qhighFactor * realblue / 100.f;
-                                        }
+                        for (int i = passTop; i < passBottom; ++i) {
+                            for (int j = 0; j < imwidth; ++j) {
+                                dst->r(i, j) = dsttmp->r(i - passTop, j);
+                                dst->g(i, j) = dsttmp->g(i - passTop, j);
+                                dst->b(i, j) = dsttmp->b(i - passTop, j);
+                            }
+                        }
 
-                                        float X, Y, Z;
-                                        Color::Lab2XYZ(L, a, b, X, Y, Z);
-
-                                        float r_, g_, b_;
-                                        Color::xyz2rgb(X, Y, Z, r_, g_, b_, wip);
-                                        //gamma slider is different from Raw
-                                        r_ = r_ < 32768.f ? igamcurve[r_] : (Color::gammanf(r_ / 32768.f, igam) * 65535.f);
-                                        g_ = g_ < 32768.f ? igamcurve[g_] : (Color::gammanf(g_ / 32768.f, igam) * 65535.f);
-                                        b_ = b_ < 32768.f ? igamcurve[b_] : (Color::gammanf(b_ / 32768.f, igam) * 65535.f);
-
-                                        if (numtiles == 1) {
-                                            dsttmp->r(i, j) = newGain * r_;
-                                            dsttmp->g(i, j) = newGain * g_;
-                                            dsttmp->b(i, j) = newGain * b_;
-                                        } else {
-                                            float factor = Vmask[i1] * Hmask[j1];
-                                            dsttmp->r(i, j) += factor * r_;
-                                            dsttmp->g(i, j) += factor * g_;
-                                            dsttmp->b(i, j) += factor * b_;
-                                        }
+#ifdef _OPENMP
+                        #pragma omp single
+#endif
+                        {
+                            // move the overlap with the next row of tiles to the top of dsttmp and keep a copy of it in carry
+                            const int bandHeight = dsttmp->getHeight();
+                            const int carryRows = carry.size() / (3 * imwidth);
+
+                            for (int i = 0; i < bandHeight; ++i) {
+                                for (int j = 0; j < imwidth; ++j) {
+                                    const bool moved = i + passHeight < bandHeight;
+                                    dsttmp->r(i, j) = moved ? dsttmp->r(i + passHeight, j) : 0.f;
+                                    dsttmp->g(i, j) = moved ? dsttmp->g(i + passHeight, j) : 0.f;
+                                    dsttmp->b(i, j) = moved ? dsttmp->b(i + passHeight, j) : 0.f;
+
+                                    if (i < carryRows) {
+                                        carry[i * imwidth + j] = dsttmp->r(i, j);
+                                        carry[(carryRows + i) * imwidth + j] = dsttmp->g(i, j);
+                                        carry[(2 * carryRows + i) * imwidth + j] = dsttmp->b(i, j);
                                     }
                                 }
                             }
 
-                            //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+                            flushedRows = passBottom;
                         }
-
-                        delete labdn;
-                        delete Lin;
-
-                    }//end of tile row
-                }//end of tile loop
+                    }
+                }
 
                 if (numtiles > 1 || !isRAW || (!useNoiseCCurve && !useNoiseLCurve)) {
                     delete[] noisevarlum;
@@ -1748,40 +1840,40 @@ BENCHFUN
 
             //copy denoised image to output
             if (numtiles > 1) {
-                if (!memoryAllocationFailed) {
-                    dsttmp->copyData(dst);
-                } else if (dst != src) {
+                if (dsttmp != dst) {
+                    if (!memoryAllocationFailed && !streamInPlace) {
+                        dsttmp->copyData(dst);
+                    }
+
+                    delete dsttmp;
+                } else if (memoryAllocationFailed) {
                     src->copyData(dst);
                 }
-
-                delete dsttmp;
             }
+        } while (memoryAllocationFailed && numTries < 2 && (options.rgbDenoiseThreadLimit == 0 || options.rgbDenoiseStreamTiles) && !ponder);
 
-            if (!isRAW && !memoryAllocationFailed) {//restore original image gamma
+        if (!isRAW && (!memoryAllocationFailed || streamedInPlace)) {//restore original image gamma
+            // after a failure while streaming in place, only the rows already written back are denoised
+            const int restoredRows = memoryAllocationFailed ? flushedRows : dst->getHeight();
 #ifdef _OPENMP
-                #pragma omp parallel for
+            #pragma omp parallel for
 #endif
 
-                for (int i = 0; i < dst->getHeight(); ++i) {
-                    for (int j = 0; j < dst->getWidth(); ++j) {
-                        dst->r(i, j) = Color::gammatab_srgb[ dst->r(i, j) ];
-                        dst->g(i, j) = Color::gammatab_srgb[ dst->g(i, j) ];
-                        dst->b(i, j) = Color::gammatab_srgb[ dst->b(i, j) ];
-                    }
+            for (int i = 0; i < restoredRows; ++i) {
+                for (int j = 0; j < dst->getWidth(); ++j) {
+                    dst->r(i, j) = Color::gammatab_srgb[ dst->r(i, j) ];
+                    dst->g(i, j) = Color::gammatab_srgb[ dst->g(i, j) ];
+                    dst->b(i, j) = Color::gammatab_srgb[ dst->b(i, j) ];
                 }
             }
-
-            if (denoiseLuminance) {
-                // destroy the plans
-                fftwf_destroy_plan(plan_forward_blox[0]);
-                fftwf_destroy_plan(plan_backward_blox[0]);
-                fftwf_destroy_plan(plan_forward_blox[1]);
-                fftwf_destroy_plan(plan_backward_blox[1]);
-            }
-        } while (memoryAllocationFailed && numTries < 2 && (options.rgbDenoiseThreadLimit == 0) && !ponder);
+        }
 
         if (memoryAllocationFailed) {
-            printf("tiled denoise failed due to isufficient memory. Output is not denoised!\n");
+            if (streamedInPlace && flushedRows > 0) {
+                printf("tiled denoise failed due to insufficient memory. Only the top %d rows of the output are denoised!\n", flushedRows);
+            } else {
+                printf("tiled denoise failed due to isufficient memory. Output is not denoised!\n");
+            }
         }
 
     }
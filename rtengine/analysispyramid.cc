@@ -0,0 +1,128 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cassert>
+
+#include "analysispyramid.h"
+#include "imagefloat.h"
+
+namespace
+{
+
+constexpr int maxSize = 1024;
+constexpr int minSize = 64;
+
+// Averages blocks of factor x factor pixels, partial blocks at the right and bottom border included
+template<typename Source>
+void boxDownscale(const Source& src, int srcWidth, int srcHeight, int factor, array2D<float>& dst, bool multithread)
+{
+    const int dstWidth = dst.width();
+    const int dstHeight = dst.height();
+
+#ifdef _OPENMP
+    #pragma omp parallel for if (multithread)
+#endif
+    for (int y = 0; y < dstHeight; ++y) {
+        const int sy0 = y * factor;
+        const int sy1 = std::min(sy0 + factor, srcHeight);
+
+        for (int x = 0; x < dstWidth; ++x) {
+            const int sx0 = x * factor;
+            const int sx1 = std::min(sx0 + factor, srcWidth);
+            float sum = 0.f;
+
+            for (int sy = sy0; sy < sy1; ++sy) {
+                for (int sx = sx0; sx < sx1; ++sx) {
+                    sum += src[sy][sx];
+                }
+            }
+
+            dst[y][x] = sum / ((sy1 - sy0) * (sx1 - sx0));
+        }
+    }
+}
+
+}
+
+rtengine::AnalysisPyramid::AnalysisPyramid() = default;
+
+rtengine::AnalysisPyramid::~AnalysisPyramid() = default;
+
+void rtengine::AnalysisPyramid::update(const Imagefloat* img, bool multithread)
+{
+    clear();
+
+    const int width = img->getWidth();
+    const int height = img->getHeight();
+
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    const int factor = (std::max(width, height) + maxSize - 1) / maxSize;
+    int levelWidth = (width + factor - 1) / factor;
+    int levelHeight = (height + factor - 1) / factor;
+
+    Level* level = new Level;
+    levels.emplace_back(level);
+    level->r(levelWidth, levelHeight);
+    level->g(levelWidth, levelHeight);
+    level->b(levelWidth, levelHeight);
+    boxDownscale(img->r.ptrs, width, height, factor, level->r, multithread);
+    boxDownscale(img->g.ptrs, width, height, factor, level->g, multithread);
+    boxDownscale(img->b.ptrs, width, height, factor, level->b, multithread);
+
+    while (std::max((levelWidth + 1) / 2, (levelHeight + 1) / 2) >= minSize) {
+        const Level& previous = *level;
+        const int previousWidth = levelWidth;
+        const int previousHeight = levelHeight;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+
+        level = new Level;
+        levels.emplace_back(level);
+        level->r(levelWidth, levelHeight);
+        level->g(levelWidth, levelHeight);
+        level->b(levelWidth, levelHeight);
+        boxDownscale(previous.r, previousWidth, previousHeight, 2, level->r, multithread);
+        boxDownscale(previous.g, previousWidth, previousHeight, 2, level->g, multithread);
+        boxDownscale(previous.b, previousWidth, previousHeight, 2, level->b, multithread);
+    }
+}
+
+void rtengine::AnalysisPyramid::clear()
+{
+    levels.clear();
+}
+
+bool rtengine::AnalysisPyramid::empty() const
+{
+    return levels.empty();
+}
+
+const rtengine::AnalysisPyramid::Level& rtengine::AnalysisPyramid::getLevel(int size) const
+{
+    assert(!levels.empty());
+
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+        if (std::max((*level)->r.width(), (*level)->r.height()) >= size) {
+            return **level;
+        }
+    }
+
+    return *levels.front();
+}
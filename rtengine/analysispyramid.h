@@ -0,0 +1,67 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "array2D.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+class Imagefloat;
+
+/**
+ * @brief Downscaled copies of an image for global statistics
+ *
+ * Tools estimating a global property of the image (like the ambient light of dehaze) don't need the full
+ * resolution, and their estimate should not depend on whether they see the preview, the full image of a
+ * detail window or the full size image of an export. The first level averages blocks of the image down to
+ * at most 1024 pixels on the long side, each further level halves the previous one down to 64 pixels.
+ * As every level is an area average, it's nearly the same for any scale the picture was rendered at.
+ *
+ * ImProcCoordinator keeps the pyramid of its preview image after the conversion to the working space, and
+ * shares it with the detail windows.
+ */
+class AnalysisPyramid final :
+    public NonCopyable
+{
+public:
+    struct Level {
+        array2D<float> r;
+        array2D<float> g;
+        array2D<float> b;
+    };
+
+    AnalysisPyramid();
+    ~AnalysisPyramid();
+
+    /** Rebuilds all levels from @p img */
+    void update(const Imagefloat* img, bool multithread);
+    void clear();
+    bool empty() const;
+
+    /** Returns the smallest level with at least @p size pixels on its long side, or the largest level if there is none. */
+    const Level& getLevel(int size) const;
+
+private:
+    std::vector<std::unique_ptr<Level>> levels; // largest first
+};
+
+}
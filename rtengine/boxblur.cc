@@ -18,6 +18,7 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <memory>
 #include <cmath>
 
@@ -26,6 +27,104 @@
 #include "rt_math.h"
 #include "opthelper.h"
 
+namespace
+{
+
+// Moves the window of boxblurLine from radius + 1 to length - radius, returns the position in ring afterwards
+template<int lanes>
+inline int boxblurSlide(float* RESTRICT data, float* RESTRICT ring, float* RESTRICT temp, int length, int radius, float rlen)
+{
+    int pos = 0;
+
+    for (int i = radius + 1; i < length - radius; ++i) {
+        for (int k = 0; k < lanes; ++k) {
+            const float oldVal = ring[pos * lanes + k];
+            ring[pos * lanes + k] = data[i * lanes + k];
+            temp[k] += (data[(i + radius) * lanes + k] - oldVal) * rlen;
+            data[i * lanes + k] = temp[k];
+        }
+
+        pos = pos < radius ? pos + 1 : 0;
+    }
+
+    return pos;
+}
+
+#ifdef __SSE2__
+template<>
+inline int boxblurSlide<8>(float* RESTRICT data, float* RESTRICT ring, float* RESTRICT temp, int length, int radius, float rlen)
+{
+    const vfloat rlenv = F2V(rlen);
+    vfloat temp0v = LVFU(temp[0]);
+    vfloat temp1v = LVFU(temp[4]);
+    int pos = 0;
+
+    for (int i = radius + 1; i < length - radius; ++i) {
+        const vfloat oldVal0 = LVFU(ring[pos * 8]);
+        const vfloat oldVal1 = LVFU(ring[pos * 8 + 4]);
+        STVFU(ring[pos * 8], LVFU(data[i * 8]));
+        STVFU(ring[pos * 8 + 4], LVFU(data[i * 8 + 4]));
+        temp0v += (LVFU(data[(i + radius) * 8]) - oldVal0) * rlenv;
+        temp1v += (LVFU(data[(i + radius) * 8 + 4]) - oldVal1) * rlenv;
+        STVFU(data[i * 8], temp0v);
+        STVFU(data[i * 8 + 4], temp1v);
+        pos = pos < radius ? pos + 1 : 0;
+    }
+
+    STVFU(temp[0], temp0v);
+    STVFU(temp[4], temp1v);
+    return pos;
+}
+#endif
+
+// In place box blur of lanes interleaved lines of length values, using the arithmetic of boxblur().
+// ring needs room for (radius + 1) * lanes values, radius must not exceed (length - 1) / 2.
+template<int lanes>
+void boxblurLine(float* RESTRICT data, float* RESTRICT ring, int length, int radius)
+{
+    float temp[lanes];
+    float len = radius + 1;
+
+    for (int k = 0; k < lanes; ++k) {
+        ring[k] = temp[k] = data[k];
+    }
+
+    for (int i = 1; i <= radius; ++i) {
+        for (int k = 0; k < lanes; ++k) {
+            temp[k] += data[i * lanes + k];
+        }
+    }
+
+    for (int k = 0; k < lanes; ++k) {
+        temp[k] /= len;
+        data[k] = temp[k];
+    }
+
+    for (int i = 1; i <= radius; ++i) {
+        for (int k = 0; k < lanes; ++k) {
+            ring[i * lanes + k] = data[i * lanes + k];
+            temp[k] = (temp[k] * len + data[(i + radius) * lanes + k]) / (len + 1);
+            data[i * lanes + k] = temp[k];
+        }
+
+        ++len;
+    }
+
+    int pos = boxblurSlide<lanes>(data, ring, temp, length, radius, 1.f / len);
+
+    for (int i = length - radius; i < length; ++i) {
+        for (int k = 0; k < lanes; ++k) {
+            temp[k] = (temp[k] * len - ring[pos * lanes + k]) / (len - 1);
+            data[i * lanes + k] = temp[k];
+        }
+
+        --len;
+        pos = pos < radius ? pos + 1 : 0;
+    }
+}
+
+}
+
 namespace rtengine
 {
 
@@ -396,6 +495,121 @@ void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiTh
     }
 }
 
+void boxblurIterated(float** src, float** dst, const int* radii, int iterations, int W, int H, bool multiThread)
+{
+    // The horizontal and the vertical passes commute, so all horizontal passes can be done first. Each row is blurred
+    // in a row buffer and each strip of numCols columns in a strip buffer, which reads and writes the image only twice
+    // instead of twice per iteration.
+    constexpr int numCols = 8;
+    int maxRadius = 0;
+
+    for (int i = 0; i < iterations; ++i) {
+        maxRadius = rtengine::max(maxRadius, radii[i]);
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    {
+        std::unique_ptr<float[]> ring(new float[numCols * (maxRadius + 1)]);
+
+        {
+            // numCols rows are interleaved, so that their running sums are independent and can be vectorized
+            std::unique_ptr<float[]> rowBuffer(new float[numCols * W]);
+#ifdef _OPENMP
+            #pragma omp for
+#endif
+
+            for (int row = 0; row < H - numCols + 1; row += numCols) {
+                for (int col = 0; col < W; ++col) {
+                    for (int k = 0; k < numCols; ++k) {
+                        rowBuffer[col * numCols + k] = src[row + k][col];
+                    }
+                }
+
+                for (int i = 0; i < iterations; ++i) {
+                    const int radius = rtengine::min(radii[i], (W - 1) / 2);
+
+                    if (radius > 0) {
+                        boxblurLine<numCols>(rowBuffer.get(), ring.get(), W, radius);
+                    }
+                }
+
+                for (int col = 0; col < W; ++col) {
+                    for (int k = 0; k < numCols; ++k) {
+                        dst[row + k][col] = rowBuffer[col * numCols + k];
+                    }
+                }
+            }
+
+            // remaining rows
+#ifdef _OPENMP
+            #pragma omp for
+#endif
+
+            for (int row = H - H % numCols; row < H; ++row) {
+                std::copy(src[row], src[row] + W, rowBuffer.get());
+
+                for (int i = 0; i < iterations; ++i) {
+                    const int radius = rtengine::min(radii[i], (W - 1) / 2);
+
+                    if (radius > 0) {
+                        boxblurLine<1>(rowBuffer.get(), ring.get(), W, radius);
+                    }
+                }
+
+                std::copy(rowBuffer.get(), rowBuffer.get() + W, dst[row]);
+            }
+        }
+
+        std::unique_ptr<float[]> stripBuffer(new float[numCols * H]);
+#ifdef _OPENMP
+        #pragma omp for nowait
+#endif
+
+        for (int col = 0; col < W - numCols + 1; col += numCols) {
+            for (int row = 0; row < H; ++row) {
+                std::copy(dst[row] + col, dst[row] + col + numCols, stripBuffer.get() + row * numCols);
+            }
+
+            for (int i = 0; i < iterations; ++i) {
+                const int radius = rtengine::min(radii[i], (H - 1) / 2);
+
+                if (radius > 0) {
+                    boxblurLine<numCols>(stripBuffer.get(), ring.get(), H, radius);
+                }
+            }
+
+            for (int row = 0; row < H; ++row) {
+                std::copy(stripBuffer.get() + row * numCols, stripBuffer.get() + (row + 1) * numCols, dst[row] + col);
+            }
+        }
+
+        // remaining columns
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for (int col = W - W % numCols; col < W; ++col) {
+            for (int row = 0; row < H; ++row) {
+                stripBuffer[row] = dst[row][col];
+            }
+
+            for (int i = 0; i < iterations; ++i) {
+                const int radius = rtengine::min(radii[i], (H - 1) / 2);
+
+                if (radius > 0) {
+                    boxblurLine<1>(stripBuffer.get(), ring.get(), H, radius);
+                }
+            }
+
+            for (int row = 0; row < H; ++row) {
+                dst[row][col] = stripBuffer[row];
+            }
+        }
+    }
+}
+
 void boxblur(float* src, float* dst, int radius, int W, int H, bool multiThread)
 {
     float* srcp[H];
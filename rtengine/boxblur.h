@@ -23,6 +23,11 @@ namespace rtengine
 
 void boxblur(float** src, float** dst, int radius, int W, int H, bool multiThread);
 void boxblur(float* src, float* dst, int radius, int W, int H, bool multiThread);
+// Applies boxblur with radii[0], ..., radii[iterations - 1] in turn, but does all horizontal passes of a row and all
+// vertical passes of a strip of columns while they are in cache. Same result as calling boxblur repeatedly as long as
+// no radius exceeds (W - 1) / 2 and (H - 1) / 2. Larger radii are clamped to these per direction, while boxblur only
+// clamps to min(W - 1, H - 1) and then reads beyond the image edges.
+void boxblurIterated(float** src, float** dst, const int* radii, int iterations, int W, int H, bool multiThread);
 void boxabsblur(float** src, float** dst, int radius, int W, int H, bool multiThread);
 void boxabsblur(float* src, float* dst, int radius, int W, int H, bool multiThread);
 
@@ -0,0 +1,281 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <giomm/file.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+
+#include "calibrationindex.h"
+#include "imagedata.h"
+#include "rawimage.h"
+#include "settings.h"
+#include "utils.h"
+
+#include "../rtgui/options.h"
+
+namespace
+{
+
+// One line per file: "<filename>\t<mtime>\t<size>[\t<field>]...\n"
+constexpr char separator = '\t';
+
+std::vector<std::string> split(const std::string& line)
+{
+    std::vector<std::string> result;
+    std::string::size_type start = 0;
+
+    while (true) {
+        const std::string::size_type end = line.find(separator, start);
+        result.emplace_back(line, start, end == std::string::npos ? std::string::npos : end - start);
+
+        if (end == std::string::npos) {
+            return result;
+        }
+
+        start = end + 1;
+    }
+}
+
+bool isStorable(const std::string& text)
+{
+    return text.find_first_of("\t\n") == std::string::npos;
+}
+
+}
+
+rtengine::CalibrationIndex::CalibrationIndex(const Glib::ustring& fname) :
+    fname(fname),
+    changed(false)
+{
+    if (fname.empty() || !Glib::file_test(fname, Glib::FILE_TEST_EXISTS)) {
+        return;
+    }
+
+    std::string contents;
+
+    try {
+        contents = Glib::file_get_contents(fname);
+    } catch (Glib::FileError&) {
+        return;
+    }
+
+    std::string::size_type start = 0;
+
+    while (start < contents.size()) {
+        std::string::size_type end = contents.find('\n', start);
+
+        if (end == std::string::npos) {
+            // truncated last line
+            break;
+        }
+
+        std::vector<std::string> columns = split(contents.substr(start, end - start));
+        start = end + 1;
+
+        if (columns.size() < 3) {
+            continue;
+        }
+
+        Entry& entry = entries[columns[0]];
+        entry.mtime = std::strtoll(columns[1].c_str(), nullptr, 10);
+        entry.size = std::strtoll(columns[2].c_str(), nullptr, 10);
+        entry.fields.assign(columns.begin() + 3, columns.end());
+        entry.used = false;
+    }
+}
+
+bool rtengine::CalibrationIndex::lookup(const Glib::ustring& filename, std::int64_t mtime, std::int64_t size, Fields& fields)
+{
+    const auto iterator = entries.find(filename);
+
+    if (iterator == entries.end() || iterator->second.mtime != mtime || iterator->second.size != size) {
+        return false;
+    }
+
+    iterator->second.used = true;
+    fields = iterator->second.fields;
+    return true;
+}
+
+void rtengine::CalibrationIndex::store(const Glib::ustring& filename, std::int64_t mtime, std::int64_t size, const Fields& fields)
+{
+    Entry& entry = entries[filename];
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.fields = fields;
+    entry.used = true;
+    changed = true;
+}
+
+void rtengine::CalibrationIndex::save()
+{
+    std::string contents;
+
+    for (auto iterator = entries.begin(); iterator != entries.end();) {
+        if (!iterator->second.used) {
+            // file removed from the directory, or another directory is in use now
+            iterator = entries.erase(iterator);
+            changed = true;
+            continue;
+        }
+
+        bool storable = isStorable(iterator->first);
+
+        for (const auto& field : iterator->second.fields) {
+            storable = storable && isStorable(field);
+        }
+
+        if (storable) {
+            contents += iterator->first + separator + std::to_string(iterator->second.mtime) + separator + std::to_string(iterator->second.size);
+
+            for (const auto& field : iterator->second.fields) {
+                contents += separator + field;
+            }
+
+            contents += '\n';
+        }
+
+        ++iterator;
+    }
+
+    if (!changed || fname.empty()) {
+        return;
+    }
+
+    try {
+        Glib::file_set_contents(fname, contents);
+        changed = false;
+    } catch (Glib::FileError& e) {
+        if (settings->verbose) {
+            std::cerr << "Could not save calibration frame index " << fname << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+std::vector<rtengine::CalibrationIndex::Frame> rtengine::CalibrationIndex::scan(const Glib::ustring& dirname, const std::string& indexName, const Handler& handle, const Reader& read, const char* kind)
+{
+    struct CalibrationFile {
+        Glib::ustring name;
+        std::int64_t mtime;
+        std::int64_t size;
+        bool hidden;
+        bool indexed;
+        bool read;
+        Fields fields;
+    };
+
+    std::vector<CalibrationFile> files;
+
+    auto dir = Gio::File::create_for_path (dirname);
+
+    if (!dir || !dir->query_exists()) {
+        return {};
+    }
+
+    try {
+
+        auto enumerator = dir->enumerate_children ("standard::name,standard::type,standard::is-hidden,standard::size,time::modified");
+
+        while (auto file = enumerator->next_file ()) {
+            if (file->get_file_type() != Gio::FILE_TYPE_DIRECTORY) {
+                files.push_back ({Glib::build_filename (dirname, file->get_name ()), file->modification_time().tv_sec, file->get_size(), file->is_hidden(), false, false, {}});
+            }
+        }
+
+    } catch (Glib::Exception&) {}
+
+    // frames which are unchanged since the last scan are taken from the index, the others are opened in parallel
+    CalibrationIndex index(options.cacheBaseDir.empty() ? Glib::ustring() : Glib::build_filename(options.cacheBaseDir, indexName));
+    std::vector<CalibrationFile*> toRead;
+
+    for (auto& file : files) {
+        const auto ext = getFileExtension(file.name);
+
+        if ((handle && handle(file.name)) || ext.empty() || !options.is_extention_enabled(ext) || (!options.fbShowHidden && file.hidden)) {
+            file.name.clear();
+        } else {
+            file.indexed = index.lookup(file.name, file.mtime, file.size, file.fields);
+
+            if (!file.indexed) {
+                toRead.push_back(&file);
+            }
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < static_cast<int>(toRead.size()); ++i) {
+        CalibrationFile& file = *toRead[i];
+
+        try {
+            // files which can't be opened as raw files, possibly temporarily, are tried again on the next scan
+            file.read = readFrame(file.name, read, file.fields);
+        } catch (std::exception&) {
+            // possibly a temporary failure, try again on the next scan
+            file.fields.clear();
+        }
+    }
+
+    std::vector<Frame> frames;
+
+    for (auto& file : files) {
+        if (file.name.empty()) {
+            continue;
+        }
+
+        if (file.read) {
+            index.store(file.name, file.mtime, file.size, file.fields);
+        }
+
+        if (!file.fields.empty()) {
+            frames.push_back({std::move(file.name), std::move(file.fields)});
+        }
+    }
+
+    index.save();
+
+    if (settings->verbose) {
+        printf("%s: %d of %d files read, the others taken from the index\n", kind, static_cast<int>(toRead.size()), static_cast<int>(files.size()));
+    }
+
+    return frames;
+}
+
+bool rtengine::CalibrationIndex::readFrame(const Glib::ustring& filename, const Reader& read, Fields& fields)
+{
+    RawImage ri(filename);
+
+    if (ri.loadRaw(false) != 0) { // Read information about shot
+        fields.clear();
+        return false;
+    }
+
+    const FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
+
+    fields = read(ri, idata);
+    return true;
+}
+
+std::string rtengine::CalibrationIndex::toString(double value)
+{
+    char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+    return g_ascii_dtostr(buffer, G_ASCII_DTOSTR_BUF_SIZE, value);
+}
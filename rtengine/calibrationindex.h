@@ -0,0 +1,96 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+class FramesData;
+class RawImage;
+
+/**
+ * @brief Persistent index of the shot information of calibration frames
+ *
+ * DFManager and FFManager have to open every raw file of their directory to learn make, model
+ * and exposure or lens settings. The index keeps these fields per file, together with the
+ * modification time and size of the file, so that unchanged files don't need to be opened again
+ * on the next start. Files which could not be opened as raw files are not recorded, so they are
+ * tried again on the next start.
+ */
+class CalibrationIndex final :
+    public NonCopyable
+{
+public:
+    using Fields = std::vector<std::string>;
+
+    struct Frame {
+        Glib::ustring filename;
+        Fields fields;
+    };
+
+    /** Extracts the fields of a frame from its raw file and metadata. Called from several threads at once. */
+    using Reader = std::function<Fields (const RawImage& ri, const FramesData& idata)>;
+    /** Handles files which are no frames, e.g. bad pixel lists. Returns true if @p filename was handled. */
+    using Handler = std::function<bool (const Glib::ustring& filename)>;
+
+    /**
+     * Returns the frames of directory @p dirname in directory order. Unchanged files are taken from
+     * the index @p indexName in the cache directory, the others are opened in parallel and their fields
+     * built by @p read. Files with disabled extensions, hidden files and files taken by @p handle are skipped.
+     */
+    static std::vector<Frame> scan(const Glib::ustring& dirname, const std::string& indexName, const Handler& handle, const Reader& read, const char* kind);
+
+    /** Opens the raw file @p filename and sets @p fields to the fields built by @p read. Returns false if it can't be opened as raw file. */
+    static bool readFrame(const Glib::ustring& filename, const Reader& read, Fields& fields);
+
+    /** Locale independent conversion of a number into a field. */
+    static std::string toString(double value);
+
+    /** Loads the index stored in @p fname. An empty filename disables persistence. */
+    explicit CalibrationIndex(const Glib::ustring& fname);
+
+    /** Returns true and sets @p fields if @p filename is indexed with the same modification time and size. */
+    bool lookup(const Glib::ustring& filename, std::int64_t mtime, std::int64_t size, Fields& fields);
+    void store(const Glib::ustring& filename, std::int64_t mtime, std::int64_t size, const Fields& fields);
+
+    /** Writes the index, keeping only the files looked up or stored since loading. */
+    void save();
+
+private:
+    struct Entry {
+        std::int64_t mtime;
+        std::int64_t size;
+        Fields fields;
+        bool used;
+    };
+
+    std::map<std::string, Entry> entries;
+    Glib::ustring fname;
+    bool changed;
+};
+
+}
@@ -1029,18 +1029,48 @@ BENCHFUN
     const array2D<float>& greenVals = greenCache ? *greenCache : green;
     const array2D<float>& blueVals = blueCache ? *blueCache : blue;
 
-    array2D<float> clipMask(W, H);
+    // The blend mask only depends on the raw data, the demosaiced image and the contrast threshold. While the demosaiced
+    // image is cached, the mask is kept as well, so that changing the other settings doesn't have to rebuild it.
+    const bool cacheBlend = redCache != nullptr;
+    const bool blendCached = cacheBlend && captureSharpeningBlendCacheValid
+                             && captureSharpeningBlendAutoContrast == sharpeningParams.autoContrast
+                             && (sharpeningParams.autoContrast || captureSharpeningBlendContrast == contrast);
+
+    if (!blendCached) {
+        captureSharpeningBlendCacheValid = false;
+    }
+
+    if (cacheBlend && !captureSharpeningBlendCache) {
+        captureSharpeningBlendCache.reset(new array2D<float>(W, H));
+    }
+
+    array2D<float> clipMaskBuffer;
+
+    if (!cacheBlend) {
+        clipMaskBuffer(W, H);
+    }
+
+    array2D<float>& clipMask = cacheBlend ? *captureSharpeningBlendCache : clipMaskBuffer;
     constexpr float clipLimit = 0.95f;
     constexpr float maxSigma = 2.f;
 
+    // the auto radius only depends on the raw data
+    const bool calcRadius = sharpeningParams.autoRadius && !captureSharpeningRadiusCacheValid;
+
+    if (sharpeningParams.autoRadius && captureSharpeningRadiusCacheValid) {
+        radius = captureSharpeningRadiusCache;
+    }
+
     if (getSensorType() == ST_BAYER) {
         const float whites[2][2] = {
                                     {(ri->get_white(FC(0,0)) - c_black[FC(0,0)]) * scale_mul[FC(0,0)] * clipLimit, (ri->get_white(FC(0,1)) - c_black[FC(0,1)]) * scale_mul[FC(0,1)] * clipLimit},
                                     {(ri->get_white(FC(1,0)) - c_black[FC(1,0)]) * scale_mul[FC(1,0)] * clipLimit, (ri->get_white(FC(1,1)) - c_black[FC(1,1)]) * scale_mul[FC(1,1)] * clipLimit}
                                    };
-        buildClipMaskBayer(rawData, W, H, clipMask, whites);
+        if (!blendCached) {
+            buildClipMaskBayer(rawData, W, H, clipMask, whites);
+        }
         const unsigned int fc[2] = {FC(0,0), FC(1,0)};
-        if (sharpeningParams.autoRadius) {
+        if (calcRadius) {
             radius = std::min(calcRadiusBayer(rawData, W, H, 1000.f, clipVal, fc), maxSigma);
         }
     } else if (getSensorType() == ST_FUJI_XTRANS) {
@@ -1051,7 +1081,9 @@ BENCHFUN
                 whites[i][j] = (ri->get_white(color) - c_black[color]) * scale_mul[color] * clipLimit;
             }
         }
-        buildClipMaskXtrans(rawData, W, H, clipMask, whites);
+        if (!blendCached) {
+            buildClipMaskXtrans(rawData, W, H, clipMask, whites);
+        }
         bool found = false;
         int i, j;
         for (i = 6; i < 12 && !found; ++i) {
@@ -1068,36 +1100,60 @@ BENCHFUN
                 }
             }
         }
-        if (sharpeningParams.autoRadius) {
+        if (calcRadius) {
             radius = std::min(calcRadiusXtrans(rawData, W, H, 1000.f, clipVal, i, j), maxSigma);
         }
 
     } else if (ri->get_colors() == 1) {
-        buildClipMaskMono(rawData, W, H, clipMask, (ri->get_white(0) - c_black[0]) * scale_mul[0] * clipLimit);
-        if (sharpeningParams.autoRadius) {
+        if (!blendCached) {
+            buildClipMaskMono(rawData, W, H, clipMask, (ri->get_white(0) - c_black[0]) * scale_mul[0] * clipLimit);
+        }
+        if (calcRadius) {
             const unsigned int fc[2] = {0, 0};
             radius = std::min(calcRadiusBayer(rawData, W, H, 1000.f, clipVal, fc), maxSigma);
         }
     }
 
+    if (calcRadius) {
+        captureSharpeningRadiusCache = radius;
+        captureSharpeningRadiusCacheValid = true;
+    }
+
     if (std::isnan(radius)) {
         return;
     }
 
+    const auto buildBlend =
+        [&](array2D<float>& L)
+        {
+            if (blendCached) {
+                contrast = captureSharpeningBlendContrast;
+            } else {
+                buildBlendMask(L, clipMask, W, H, contrast, sharpeningParams.autoContrast, clipMask);
+                if (cacheBlend) {
+                    captureSharpeningBlendAutoContrast = sharpeningParams.autoContrast;
+                    captureSharpeningBlendContrast = contrast;
+                    captureSharpeningBlendCacheValid = true;
+                }
+            }
+        };
+
     if (showMask) {
         array2D<float>& L = blue; // blue will be overridden anyway => we can use its buffer to store L
+        if (!blendCached) {
 #ifdef _OPENMP
-        #pragma omp parallel for
+            #pragma omp parallel for
 #endif
 
-        for (int i = 0; i < H; ++i) {
-            Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
+            for (int i = 0; i < H; ++i) {
+                Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
+            }
         }
         if (plistener) {
             plistener->setProgress(0.1);
         }
 
-        buildBlendMask(L, clipMask, W, H, contrast, sharpeningParams.autoContrast, clipMask);
+        buildBlend(L);
         if (plistener) {
             plistener->setProgress(0.2);
         }
@@ -1138,7 +1194,9 @@ BENCHFUN
     #pragma omp parallel for schedule(dynamic, 16)
 #endif
     for (int i = 0; i < H; ++i) {
-        Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
+        if (!blendCached) {
+            Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
+        }
         Color::RGB2Y(redVals[i], greenVals[i], blueVals[i], YOld[i], YNew[i], W);
     }
     if (plistener) {
@@ -1146,7 +1204,7 @@ BENCHFUN
     }
 
     // calculate contrast based blend factors to reduce sharpening in regions with low contrast
-    buildBlendMask(L, clipMask, W, H, contrast, sharpeningParams.autoContrast, clipMask);
+    buildBlend(L);
     if (plistener) {
         plistener->setProgress(0.2);
     }
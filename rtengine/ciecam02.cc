@@ -18,6 +18,7 @@
  */
 #include "ciecam02.h"
 #include "rt_math.h"
+#include "color.h"
 #include "curves.h"
 #include <math.h>
 #include "sleef.h"
@@ -515,63 +516,6 @@ void Ciecam02::xyz2jchqms_ciecam02float ( float &J, float &C, float &h, float &Q
     s = 100.0f * sqrtf ( M / Q );
     h = (myh * 180.f) / (float)rtengine::RT_PI;
 }
-#ifdef __SSE2__
-void Ciecam02::xyz2jchqms_ciecam02float ( vfloat &J, vfloat &C, vfloat &h, vfloat &Q, vfloat &M, vfloat &s, vfloat aw, vfloat fl, vfloat wh,
-        vfloat x, vfloat y, vfloat z, vfloat xw, vfloat yw, vfloat zw,
-        vfloat c, vfloat nc, vfloat pow1, vfloat nbb, vfloat ncb, vfloat pfl, vfloat cz, vfloat d)
-
-{
-    vfloat r, g, b;
-    vfloat rw, gw, bw;
-    vfloat rc, gc, bc;
-    vfloat rp, gp, bp;
-    vfloat rpa, gpa, bpa;
-    vfloat a, ca, cb;
-    vfloat e, t;
-
-    xyz_to_cat02float ( r, g, b, x, y, z);
-    xyz_to_cat02float ( rw, gw, bw, xw, yw, zw);
-    vfloat onev = F2V (1.f);
-    rc = r * (((yw * d) / rw) + (onev - d));
-    gc = g * (((yw * d) / gw) + (onev - d));
-    bc = b * (((yw * d) / bw) + (onev - d));
-
-    cat02_to_hpefloat ( rp, gp, bp, rc, gc, bc);
-    //gamut correction M.H.Brill S.Susstrunk
-    rp = vmaxf (rp, ZEROV);
-    gp = vmaxf (gp, ZEROV);
-    bp = vmaxf (bp, ZEROV);
-    rpa = nonlinear_adaptationfloat ( rp, fl );
-    gpa = nonlinear_adaptationfloat ( gp, fl );
-    bpa = nonlinear_adaptationfloat ( bp, fl );
-
-    ca = rpa - ((F2V (12.0f) * gpa) - bpa) / F2V (11.0f);
-    cb = F2V (0.11111111f) * (rpa + gpa - (bpa + bpa));
-
-    vfloat myh = xatan2f ( cb, ca );
-    vfloat temp = F2V (rtengine::RT_PI);
-    temp += temp;
-    temp += myh;
-    myh = vself (vmaskf_lt (myh, ZEROV), temp, myh);
-
-    a = ((rpa + rpa) + gpa + (F2V (0.05f) * bpa) - F2V (0.305f)) * nbb;
-    a = vmaxf (a, ZEROV);  //gamut correction M.H.Brill S.Susstrunk
-
-    J = pow_F ( a / aw, c * cz * F2V (0.5f));
-
-    e = ((F2V (961.53846f)) * nc * ncb) * (xcosf ( myh + F2V (2.0f) ) + F2V (3.8f));
-    t = (e * vsqrtf ( (ca * ca) + (cb * cb) )) / (rpa + gpa + (F2V (1.05f) * bpa));
-
-    C = pow_F ( t, F2V (0.9f) ) * J * pow1;
-
-    Q = wh * J;
-    J *= J * F2V (100.0f);
-    M = C * pfl;
-    Q = vmaxf (Q, F2V (0.0001f)); // avoid division by zero
-    s = F2V (100.0f) * vsqrtf ( M / Q );
-    h = (myh * F2V (180.f)) / F2V (rtengine::RT_PI);
-}
-#endif
 
 void Ciecam02::xyz2jch_ciecam02float ( float &J, float &C, float &h, float aw, float fl,
                                        float x, float y, float z, float xw, float yw, float zw,
@@ -691,40 +635,232 @@ void Ciecam02::jch2xyz_ciecam02float ( float &x, float &y, float &z, float J, fl
     cat02_to_xyzfloat(x, y, z, r, g, b);
 }
 
-#ifdef __SSE2__
-void Ciecam02::jch2xyz_ciecam02float ( vfloat &x, vfloat &y, vfloat &z, vfloat J, vfloat C, vfloat h,
-                                       vfloat xw, vfloat yw, vfloat zw,
-                                       vfloat nc, vfloat pow1, vfloat nbb, vfloat ncb, vfloat fl, vfloat d, vfloat aw, vfloat reccmcz)
+Ciecam02::ViewingConditions::ViewingConditions (float xw, float yw, float zw, float c, float nc, float n, float nbb, float ncb, float fl, float cz, float d, float aw) :
+    xw (xw),
+    yw (yw),
+    zw (zw),
+    c (c),
+    nc (nc),
+    nbb (nbb),
+    ncb (ncb),
+    fl (fl),
+    cz (cz),
+    d (d),
+    aw (aw),
+    wh ((4.0f / c) * (aw + 4.0f) * pow_F (fl, 0.25f)),
+    pfl (pow_F (fl, 0.25f)),
+    pow1 (pow_F (1.64f - pow_F (0.29f, n), 0.73f)),
+    jExponent (c * cz * 0.5f),
+    jInvExponent (1.f / (c * cz)),
+    eFactor (961.53846f * nc * ncb)
 {
-    vfloat r, g, b;
-    vfloat rc, gc, bc;
-    vfloat rp, gp, bp;
-    vfloat rpa, gpa, bpa;
-    vfloat rw, gw, bw;
-    vfloat a, ca, cb;
-    vfloat e, t;
-    xyz_to_cat02float ( rw, gw, bw, xw, yw, zw);
-    e = ((F2V (961.53846f)) * nc * ncb) * (xcosf ( ((h * F2V (rtengine::RT_PI)) / F2V (180.0f)) + F2V (2.0f) ) + F2V (3.8f));
-    a = pow_F ( J / F2V (100.0f), reccmcz ) * aw;
-    t = pow_F ( F2V (10.f) * C / (vsqrtf ( J ) * pow1), F2V (1.1111111f) );
+    float rw, gw, bw;
+    xyz_to_cat02float (rw, gw, bw, xw, yw, zw);
+    gainR = ((yw * d) / rw) + (1.f - d);
+    gainG = ((yw * d) / gw) + (1.f - d);
+    gainB = ((yw * d) / bw) + (1.f - d);
+}
 
-    calculate_abfloat ( ca, cb, h, e, t, nbb, a );
-    Aab_to_rgbfloat ( rpa, gpa, bpa, a, ca, cb, nbb );
+void Ciecam02::lab2jchqms_ciecam02float ( const ViewingConditions &vc, int width,
+        const float *L, const float *a, const float *b,
+        float *J, float *C, float *h, float *Q, float *M, float *s )
+{
+    int k = 0;
+#ifdef __SSE2__
+    const vfloat c655d35 = F2V (655.35f);
+    const vfloat gainRv = F2V (vc.gainR);
+    const vfloat gainGv = F2V (vc.gainG);
+    const vfloat gainBv = F2V (vc.gainB);
+    const vfloat flv = F2V (vc.fl);
+    const vfloat nbbv = F2V (vc.nbb);
+    const vfloat rawv = F2V (1.f / vc.aw);
+    const vfloat jExponentv = F2V (vc.jExponent);
+    const vfloat eFactorv = F2V (vc.eFactor);
+    const vfloat pow1v = F2V (vc.pow1);
+    const vfloat whv = F2V (vc.wh);
+    const vfloat pflv = F2V (vc.pfl);
+    const vfloat twoPiv = F2V (2.f * rtengine::RT_PI_F);
+
+    const auto convert =
+        [&] (vfloat Lv, vfloat av, vfloat bv, vfloat & Jv, vfloat & Cv, vfloat & hv, vfloat & Qv, vfloat & Mv, vfloat & sv) -> void
+        {
+            vfloat x, y, z;
+            Color::Lab2XYZ (Lv, av, bv, x, y, z);
+            x /= c655d35;
+            y /= c655d35;
+            z /= c655d35;
+
+            vfloat r, g, bl;
+            xyz_to_cat02float (r, g, bl, x, y, z);
+
+            vfloat rp, gp, bp;
+            cat02_to_hpefloat (rp, gp, bp, r * gainRv, g * gainGv, bl * gainBv);
+            //gamut correction M.H.Brill S.Susstrunk
+            const vfloat rpa = nonlinear_adaptationfloat (vmaxf (rp, ZEROV), flv);
+            const vfloat gpa = nonlinear_adaptationfloat (vmaxf (gp, ZEROV), flv);
+            const vfloat bpa = nonlinear_adaptationfloat (vmaxf (bp, ZEROV), flv);
+
+            const vfloat ca = rpa - ((F2V (12.0f) * gpa) - bpa) / F2V (11.0f);
+            const vfloat cb = F2V (0.11111111f) * (rpa + gpa - (bpa + bpa));
+
+            vfloat myh = xatan2f (cb, ca);
+            myh = vself (vmaskf_lt (myh, ZEROV), myh + twoPiv, myh);
+
+            const vfloat A = vmaxf (((rpa + rpa) + gpa + (F2V (0.05f) * bpa) - F2V (0.305f)) * nbbv, ZEROV); //gamut correction M.H.Brill S.Susstrunk
+
+            Jv = pow_F (A * rawv, jExponentv);
+
+            const vfloat e = eFactorv * (xcosf (myh + F2V (2.0f)) + F2V (3.8f));
+            const vfloat t = (e * vsqrtf ((ca * ca) + (cb * cb))) / (rpa + gpa + (F2V (1.05f) * bpa));
+
+            Cv = pow_F (t, F2V (0.9f)) * Jv * pow1v;
+            Qv = vmaxf (whv * Jv, F2V (0.0001f)); // avoid division by zero
+            Jv *= Jv * F2V (100.0f);
+            Mv = Cv * pflv;
+            sv = F2V (100.0f) * vsqrtf (Mv / Qv);
+            hv = (myh * F2V (180.f)) / F2V (rtengine::RT_PI);
+        };
+
+    for (; k < width - 3; k += 4) {
+        vfloat Jv, Cv, hv, Qv, Mv, sv;
+        convert (LVFU (L[k]), LVFU (a[k]), LVFU (b[k]), Jv, Cv, hv, Qv, Mv, sv);
+        STVFU (J[k], Jv);
+        STVFU (C[k], Cv);
+        STVFU (h[k], hv);
+        STVFU (Q[k], Qv);
+        STVFU (M[k], Mv);
+        STVFU (s[k], sv);
+    }
 
-    rp = inverse_nonlinear_adaptationfloat ( rpa, fl );
-    gp = inverse_nonlinear_adaptationfloat ( gpa, fl );
-    bp = inverse_nonlinear_adaptationfloat ( bpa, fl );
+    if (k < width) {
+        // pad the last pixels to a full vector
+        float in[3][4] ALIGNED16 = {};
+        float out[6][4] ALIGNED16;
+
+        for (int l = k; l < width; ++l) {
+            in[0][l - k] = L[l];
+            in[1][l - k] = a[l];
+            in[2][l - k] = b[l];
+        }
+
+        vfloat Jv, Cv, hv, Qv, Mv, sv;
+        convert (LVF (in[0][0]), LVF (in[1][0]), LVF (in[2][0]), Jv, Cv, hv, Qv, Mv, sv);
+        STVF (out[0][0], Jv);
+        STVF (out[1][0], Cv);
+        STVF (out[2][0], hv);
+        STVF (out[3][0], Qv);
+        STVF (out[4][0], Mv);
+        STVF (out[5][0], sv);
+
+        for (int l = k; l < width; ++l) {
+            J[l] = out[0][l - k];
+            C[l] = out[1][l - k];
+            h[l] = out[2][l - k];
+            Q[l] = out[3][l - k];
+            M[l] = out[4][l - k];
+            s[l] = out[5][l - k];
+        }
+    }
 
-    hpe_to_xyzfloat ( x, y, z, rp, gp, bp );
-    xyz_to_cat02float ( rc, gc, bc, x, y, z );
+#else
 
-    r = rc / (((yw * d) / rw) + (F2V (1.0f) - d));
-    g = gc / (((yw * d) / gw) + (F2V (1.0f) - d));
-    b = bc / (((yw * d) / bw) + (F2V (1.0f) - d));
+    for (; k < width; ++k) {
+        float x, y, z;
+        Color::Lab2XYZ (L[k], a[k], b[k], x, y, z);
+        xyz2jchqms_ciecam02float (J[k], C[k], h[k], Q[k], M[k], s[k], vc.aw, vc.fl, vc.wh,
+                                  x / 655.35f, y / 655.35f, z / 655.35f,
+                                  vc.xw, vc.yw, vc.zw,
+                                  vc.c, vc.nc, vc.pow1, vc.nbb, vc.ncb, vc.pfl, vc.cz, vc.d);
+    }
 
-    cat02_to_xyzfloat ( x, y, z, r, g, b );
+#endif
 }
+
+void Ciecam02::jch2xyz_ciecam02float ( const ViewingConditions &vc, int width,
+                                       const float *J, const float *C, const float *h,
+                                       float *x, float *y, float *z )
+{
+    int k = 0;
+#ifdef __SSE2__
+    const vfloat c655d35 = F2V (655.35f);
+    const vfloat rgainRv = F2V (1.f / vc.gainR);
+    const vfloat rgainGv = F2V (1.f / vc.gainG);
+    const vfloat rgainBv = F2V (1.f / vc.gainB);
+    const vfloat flv = F2V (vc.fl);
+    const vfloat nbbv = F2V (vc.nbb);
+    const vfloat awv = F2V (vc.aw);
+    const vfloat jInvExponentv = F2V (vc.jInvExponent);
+    const vfloat eFactorv = F2V (vc.eFactor);
+    const vfloat pow1v = F2V (vc.pow1);
+
+    const auto convert =
+        [&] (vfloat Jv, vfloat Cv, vfloat hv, vfloat & xv, vfloat & yv, vfloat & zv) -> void
+        {
+            const vfloat e = eFactorv * (xcosf (((hv * F2V (rtengine::RT_PI)) / F2V (180.0f)) + F2V (2.0f)) + F2V (3.8f));
+            const vfloat A = pow_F (Jv / F2V (100.0f), jInvExponentv) * awv;
+            const vfloat t = pow_F (F2V (10.f) * Cv / (vsqrtf (Jv) * pow1v), F2V (1.1111111f));
+
+            vfloat ca, cb;
+            calculate_abfloat (ca, cb, hv, e, t, nbbv, A);
+            vfloat rpa, gpa, bpa;
+            Aab_to_rgbfloat (rpa, gpa, bpa, A, ca, cb, nbbv);
+
+            hpe_to_xyzfloat (xv, yv, zv, inverse_nonlinear_adaptationfloat (rpa, flv), inverse_nonlinear_adaptationfloat (gpa, flv), inverse_nonlinear_adaptationfloat (bpa, flv));
+            vfloat rc, gc, bc;
+            xyz_to_cat02float (rc, gc, bc, xv, yv, zv);
+            cat02_to_xyzfloat (xv, yv, zv, rc * rgainRv, gc * rgainGv, bc * rgainBv);
+
+            xv *= c655d35;
+            yv *= c655d35;
+            zv *= c655d35;
+        };
+
+    for (; k < width - 3; k += 4) {
+        vfloat xv, yv, zv;
+        convert (LVFU (J[k]), LVFU (C[k]), LVFU (h[k]), xv, yv, zv);
+        STVFU (x[k], xv);
+        STVFU (y[k], yv);
+        STVFU (z[k], zv);
+    }
+
+    if (k < width) {
+        // pad the last pixels to a full vector
+        float in[3][4] ALIGNED16 = {};
+        float out[3][4] ALIGNED16;
+
+        for (int l = k; l < width; ++l) {
+            in[0][l - k] = J[l];
+            in[1][l - k] = C[l];
+            in[2][l - k] = h[l];
+        }
+
+        vfloat xv, yv, zv;
+        convert (LVF (in[0][0]), LVF (in[1][0]), LVF (in[2][0]), xv, yv, zv);
+        STVF (out[0][0], xv);
+        STVF (out[1][0], yv);
+        STVF (out[2][0], zv);
+
+        for (int l = k; l < width; ++l) {
+            x[l] = out[0][l - k];
+            y[l] = out[1][l - k];
+            z[l] = out[2][l - k];
+        }
+    }
+
+#else
+
+    for (; k < width; ++k) {
+        float xx, yy, zz;
+        jch2xyz_ciecam02float (xx, yy, zz, J[k], C[k], h[k],
+                               vc.xw, vc.yw, vc.zw,
+                               vc.c, vc.nc, vc.pow1, vc.nbb, vc.ncb, vc.fl, vc.cz, vc.d, vc.aw);
+        x[k] = xx * 655.35f;
+        y[k] = yy * 655.35f;
+        z[k] = zz * 655.35f;
+    }
+
 #endif
+}
 
 float Ciecam02::nonlinear_adaptationfloat ( float c, float fl )
 {
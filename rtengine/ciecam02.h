@@ -74,12 +74,6 @@ public:
                                         float J, float C, float h,
                                         float xw, float yw, float zw,
                                         float c, float nc, float n, float nbb, float ncb, float fl, float cz, float d, float aw );
-#ifdef __SSE2__
-    static void jch2xyz_ciecam02float ( vfloat &x, vfloat &y, vfloat &z,
-                                        vfloat J, vfloat C, vfloat h,
-                                        vfloat xw, vfloat yw, vfloat zw,
-                                        vfloat nc, vfloat n, vfloat nbb, vfloat ncb, vfloat fl, vfloat d, vfloat aw, vfloat reccmcz );
-#endif
     /**
      * Forward transform from XYZ to CIECAM02 JCh.
      */
@@ -101,15 +95,37 @@ public:
                                            float xw, float yw, float zw,
                                            float c, float nc, float n, float nbb, float ncb, float pfl, float cz, float d  );
 
-#ifdef __SSE2__
-    static void xyz2jchqms_ciecam02float ( vfloat &J, vfloat &C, vfloat &h,
-                                           vfloat &Q, vfloat &M, vfloat &s, vfloat aw, vfloat fl, vfloat wh,
-                                           vfloat x, vfloat y, vfloat z,
-                                           vfloat xw, vfloat yw, vfloat zw,
-                                           vfloat c, vfloat nc, vfloat n, vfloat nbb, vfloat ncb, vfloat pfl, vfloat cz, vfloat d  );
+    /**
+     * Constants of one set of viewing conditions, derived once per image from the results of
+     * initcam1float() or initcam2float(). The row transforms below use them instead of adapting
+     * the white point and deriving the exponents for every pixel.
+     */
+    struct ViewingConditions {
+        ViewingConditions (float xw, float yw, float zw, float c, float nc, float n, float nbb, float ncb, float fl, float cz, float d, float aw);
+
+        float xw, yw, zw;
+        float c, nc, nbb, ncb, fl, cz, d, aw;
+        float wh, pfl, pow1;
+        float gainR, gainG, gainB; // von Kries gains of the CAT02 channels
+        float jExponent;           // A / aw to the power of jExponent gives sqrt (J / 100)
+        float jInvExponent;        // J / 100 to the power of jInvExponent gives A / aw
+        float eFactor;             // eccentricity factor without the hue term
+    };
 
+    /**
+     * Forward transform of a row of Lab values (L in [0, 32768]) to CIECAM02 JChQMs.
+     */
+    static void lab2jchqms_ciecam02float ( const ViewingConditions &vc, int width,
+                                           const float *L, const float *a, const float *b,
+                                           float *J, float *C, float *h, float *Q, float *M, float *s );
 
-#endif
+    /**
+     * Inverse transform of a row of CIECAM02 JCh values to XYZ in [0, 65535].
+     * The output may use the same buffers as the input.
+     */
+    static void jch2xyz_ciecam02float ( const ViewingConditions &vc, int width,
+                                        const float *J, const float *C, const float *h,
+                                        float *x, float *y, float *z );
 
 };
 }
@@ -5,6 +5,7 @@
 
 #include "clutstore.h"
 
+#include "color.h"
 #include "colortemp.h"
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -18,108 +19,73 @@
 namespace
 {
 
-bool loadFile(
-    const Glib::ustring& filename,
-    const Glib::ustring& working_color_space,
-    AlignedBuffer<std::uint16_t>& clut_image,
-    unsigned int& clut_level
-)
+// Loads the CLUT image with its sRGB gamma encoded values as they are
+std::unique_ptr<rtengine::ColorLUT3D> loadFile(const Glib::ustring& filename)
 {
     rtengine::StdImageSource img_src;
 
     if (!Glib::file_test(filename, Glib::FILE_TEST_EXISTS) || img_src.load(filename)) {
-        return false;
+        return nullptr;
     }
 
     int fw, fh;
     img_src.getFullSize(fw, fh, TR_NONE);
 
-    bool res = false;
+    if (fw != fh) {
+        return nullptr;
+    }
 
-    if (fw == fh) {
-        int level = 1;
+    int level = 1;
 
-        while (level * level * level < fw) {
-            ++level;
-        }
+    while (level * level * level < fw) {
+        ++level;
+    }
 
-        if (level * level * level == fw && level > 1) {
-            clut_level = level;
-            res = true;
-        }
+    if (level * level * level != fw || level < 2) {
+        return nullptr;
     }
 
-    if (res) {
-        rtengine::ColorTemp curr_wb = img_src.getWB();
-        std::unique_ptr<rtengine::Imagefloat> img_float = std::unique_ptr<rtengine::Imagefloat>(new rtengine::Imagefloat(fw, fh));
-        const PreviewProps pp(0, 0, fw, fh, 1);
+    rtengine::ColorTemp curr_wb = img_src.getWB();
+    std::unique_ptr<rtengine::Imagefloat> img_float = std::unique_ptr<rtengine::Imagefloat>(new rtengine::Imagefloat(fw, fh));
+    const PreviewProps pp(0, 0, fw, fh, 1);
 
-        rtengine::procparams::ColorManagementParams icm;
-        icm.workingProfile = working_color_space;
+    img_src.getImage(curr_wb, TR_NONE, img_float.get(), pp, rtengine::procparams::ToneCurveParams(), rtengine::procparams::RAWParams());
 
-        img_src.getImage(curr_wb, TR_NONE, img_float.get(), pp, rtengine::procparams::ToneCurveParams(), rtengine::procparams::RAWParams());
+    // The pixels of a Hald CLUT are the nodes in order, red changing fastest
+    const int size = level * level;
+    std::unique_ptr<rtengine::ColorLUT3D> clut(new rtengine::ColorLUT3D(size));
 
-        if (!working_color_space.empty()) {
-            img_src.convertColorSpace(img_float.get(), icm, curr_wb);
+    for (int y = 0; y < fh; ++y) {
+        for (int x = 0; x < fw; ++x) {
+            const int color = y * fw + x;
+            float* const node = clut->getNode(color % size, color / size % size, color / (size * size));
+            node[0] = img_float->r(y, x);
+            node[1] = img_float->g(y, x);
+            node[2] = img_float->b(y, x);
         }
-
-        AlignedBuffer<std::uint16_t> image(fw * fh * 4 + 4); // getClutValues() loads one pixel in advance
-
-        std::size_t index = 0;
-
-        for (int y = 0; y < fh; ++y) {
-            for (int x = 0; x < fw; ++x) {
-                image.data[index] = img_float->r(y, x);
-                ++index;
-                image.data[index] = img_float->g(y, x);
-                ++index;
-                image.data[index] = img_float->b(y, x);
-                index += 2;
-            }
-        }
-
-        clut_image.swap(image);
     }
 
-    return res;
+    return clut;
 }
 
-#ifdef __SSE2__
-vfloat2 getClutValues(const AlignedBuffer<std::uint16_t>& clut_image, size_t index)
+void toFloatMatrix(rtengine::TMatrix source, float (&destination)[3][3])
 {
-    const vint v_values = _mm_loadu_si128(reinterpret_cast<const vint*>(clut_image.data + index));
-#ifdef __SSE4_1__
-    return {
-        _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v_values)),
-        _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v_values, 8)))
-    };
-#else
-    const vint v_mask = _mm_set1_epi32(0x0000FFFF);
-
-    vint v_low = _mm_shuffle_epi32(v_values, _MM_SHUFFLE(1, 0, 1, 0));
-    vint v_high = _mm_shuffle_epi32(v_values, _MM_SHUFFLE(3, 2, 3, 2));
-    v_low = _mm_shufflelo_epi16(v_low, _MM_SHUFFLE(1, 1, 0, 0));
-    v_high = _mm_shufflelo_epi16(v_high, _MM_SHUFFLE(1, 1, 0, 0));
-    v_low = _mm_shufflehi_epi16(v_low, _MM_SHUFFLE(3, 3, 2, 2));
-    v_high = _mm_shufflehi_epi16(v_high, _MM_SHUFFLE(3, 3, 2, 2));
-    v_low = vandm(v_low, v_mask);
-    v_high = vandm(v_high, v_mask);
-
-    return {
-        _mm_cvtepi32_ps(v_low),
-        _mm_cvtepi32_ps(v_high)
-    };
-#endif
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            destination[i][j] = source[i][j];
+        }
+    }
 }
-#endif
 
 }
 
 rtengine::HaldCLUT::HaldCLUT() :
-    clut_level(0),
-    flevel_minus_one(0.0f),
-    flevel_minus_two(0.0f),
-    clut_profile("sRGB")
+    clut_profile("sRGB"),
+    convert(false),
+    work2xyz{},
+    xyz2clut{},
+    clut2xyz{},
+    xyz2work{}
 {
 }
 
@@ -127,16 +93,26 @@ rtengine::HaldCLUT::~HaldCLUT()
 {
 }
 
-bool rtengine::HaldCLUT::load(const Glib::ustring& filename)
+bool rtengine::HaldCLUT::load(const Glib::ustring& filename, const Glib::ustring& working_profile)
 {
-    if (loadFile(filename, "", clut_image, clut_level)) {
+    std::unique_ptr<ColorLUT3D> source = loadFile(filename);
+
+    if (source) {
         Glib::ustring name, ext;
         splitClutFilename(filename, name, ext, clut_profile);
 
+        clut = std::move(source);
         clut_filename = filename;
-        clut_level *= clut_level;
-        flevel_minus_one = static_cast<float>(clut_level - 1) / 65535.0f;
-        flevel_minus_two = static_cast<float>(clut_level - 2);
+
+        convert = clut_profile != working_profile;
+
+        if (convert) {
+            toFloatMatrix(ICCStore::getInstance()->workingSpaceMatrix(working_profile), work2xyz);
+            toFloatMatrix(ICCStore::getInstance()->workingSpaceInverseMatrix(clut_profile), xyz2clut);
+            toFloatMatrix(ICCStore::getInstance()->workingSpaceMatrix(clut_profile), clut2xyz);
+            toFloatMatrix(ICCStore::getInstance()->workingSpaceInverseMatrix(working_profile), xyz2work);
+        }
+
         return true;
     }
 
@@ -145,7 +121,7 @@ bool rtengine::HaldCLUT::load(const Glib::ustring& filename)
 
 rtengine::HaldCLUT::operator bool() const
 {
-    return !clut_image.isEmpty();
+    return static_cast<bool>(clut);
 }
 
 Glib::ustring rtengine::HaldCLUT::getFilename() const
@@ -158,115 +134,122 @@ Glib::ustring rtengine::HaldCLUT::getProfile() const
     return clut_profile;
 }
 
+std::size_t rtengine::HaldCLUT::getBytes() const
+{
+    return clut ? clut->getBytes() : 0;
+}
+
 void rtengine::HaldCLUT::getRGB(
     float strength,
     std::size_t line_size,
     const float* r,
     const float* g,
     const float* b,
-    float* out_rgbx
+    float* out_r,
+    float* out_g,
+    float* out_b
 ) const
 {
-    const unsigned int level = clut_level; // This is important
-
-    const unsigned int level_square = level * level;
+    const float scale = (clut->getSize() - 1) / 65535.f;
+    std::size_t column = 0;
 
+    // The CLUT maps sRGB gamma encoded values of its profile, the strength blends those as well
 #ifdef __SSE2__
+    const vfloat v_scale = F2V(scale);
     const vfloat v_strength = F2V(strength);
-#endif
-
-    for (std::size_t column = 0; column < line_size; ++column, ++r, ++g, ++b, out_rgbx += 4) {
-        const unsigned int red = std::min(flevel_minus_two, *r * flevel_minus_one);
-        const unsigned int green = std::min(flevel_minus_two, *g * flevel_minus_one);
-        const unsigned int blue = std::min(flevel_minus_two, *b * flevel_minus_one);
-
-        const unsigned int color = red + green * level + blue * level_square;
-
-#ifndef __SSE2__
-        const float re = *r * flevel_minus_one - red;
-        const float gr = *g * flevel_minus_one - green;
-        const float bl = *b * flevel_minus_one - blue;
-
-        size_t index = color * 4;
-
-        float tmp1[4] ALIGNED16;
-        tmp1[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        index = (color + level) * 4;
-
-        float tmp2[4] ALIGNED16;
-        tmp2[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        out_rgbx[0] = intp<float>(gr, tmp2[0], tmp1[0]);
-        out_rgbx[1] = intp<float>(gr, tmp2[1], tmp1[1]);
-        out_rgbx[2] = intp<float>(gr, tmp2[2], tmp1[2]);
-
-        index = (color + level_square) * 4;
-
-        tmp1[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        index = (color + level + level_square) * 4;
-
-        tmp2[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        tmp1[0] = intp<float>(gr, tmp2[0], tmp1[0]);
-        tmp1[1] = intp<float>(gr, tmp2[1], tmp1[1]);
-        tmp1[2] = intp<float>(gr, tmp2[2], tmp1[2]);
-
-        out_rgbx[0] = intp<float>(bl, tmp1[0], out_rgbx[0]);
-        out_rgbx[1] = intp<float>(bl, tmp1[1], out_rgbx[1]);
-        out_rgbx[2] = intp<float>(bl, tmp1[2], out_rgbx[2]);
-
-        out_rgbx[0] = intp<float>(strength, out_rgbx[0], *r);
-        out_rgbx[1] = intp<float>(strength, out_rgbx[1], *g);
-        out_rgbx[2] = intp<float>(strength, out_rgbx[2], *b);
-#else
-        const vfloat v_in = _mm_set_ps(0.0f, *b, *g, *r);
-        const vfloat v_tmp = v_in * F2V(flevel_minus_one);
-        const vfloat v_rgb = v_tmp - _mm_cvtepi32_ps(_mm_cvttps_epi32(vminf(v_tmp, F2V(flevel_minus_two))));
-
-        size_t index = color * 4;
+    vfloat v_work2xyz[3][3] ALIGNED16;
+    vfloat v_xyz2clut[3][3] ALIGNED16;
+    vfloat v_clut2xyz[3][3] ALIGNED16;
+    vfloat v_xyz2work[3][3] ALIGNED16;
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            v_work2xyz[i][j] = F2V(work2xyz[i][j]);
+            v_xyz2clut[i][j] = F2V(xyz2clut[i][j]);
+            v_clut2xyz[i][j] = F2V(clut2xyz[i][j]);
+            v_xyz2work[i][j] = F2V(xyz2work[i][j]);
+        }
+    }
 
-        const vfloat v_r = PERMUTEPS(v_rgb, _MM_SHUFFLE(0, 0, 0, 0));
+    float coords[3][4] ALIGNED16;
+    float out[4][4] ALIGNED16;
 
-        vfloat2 v_clut_values = getClutValues(clut_image, index);
-        vfloat v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
+    for (; column + 3 < line_size; column += 4) {
+        vfloat v_r = LVFU(r[column]);
+        vfloat v_g = LVFU(g[column]);
+        vfloat v_b = LVFU(b[column]);
 
-        index = (color + level) * 4;
+        if (convert) {
+            vfloat x, y, z;
+            Color::rgbxyz(v_r, v_g, v_b, x, y, z, v_work2xyz);
+            Color::xyz2rgb(x, y, z, v_r, v_g, v_b, v_xyz2clut);
+        }
 
-        v_clut_values = getClutValues(clut_image, index);
-        vfloat v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
+        v_r = Color::gamma2curve[v_r];
+        v_g = Color::gamma2curve[v_g];
+        v_b = Color::gamma2curve[v_b];
+        STVF(coords[0][0], v_r * v_scale);
+        STVF(coords[1][0], v_g * v_scale);
+        STVF(coords[2][0], v_b * v_scale);
 
-        const vfloat v_g = PERMUTEPS(v_rgb, _MM_SHUFFLE(1, 1, 1, 1));
+        for (int k = 0; k < 4; ++k) {
+            STVF(out[k][0], clut->interpolate(coords[0][k], coords[1][k], coords[2][k]));
+        }
 
-        vfloat v_out = vintpf(v_g, v_tmp2, v_tmp1);
+        // transpose the rgbx pixels to planes
+        vfloat v_out0 = LVF(out[0][0]);
+        vfloat v_out1 = LVF(out[1][0]);
+        vfloat v_out2 = LVF(out[2][0]);
+        vfloat v_out3 = LVF(out[3][0]);
+        _MM_TRANSPOSE4_PS(v_out0, v_out1, v_out2, v_out3);
+
+        v_out0 = Color::igammatab_srgb[vintpf(v_strength, v_out0, v_r)];
+        v_out1 = Color::igammatab_srgb[vintpf(v_strength, v_out1, v_g)];
+        v_out2 = Color::igammatab_srgb[vintpf(v_strength, v_out2, v_b)];
+
+        if (convert) {
+            vfloat x, y, z;
+            Color::rgbxyz(v_out0, v_out1, v_out2, x, y, z, v_clut2xyz);
+            Color::xyz2rgb(x, y, z, v_out0, v_out1, v_out2, v_xyz2work);
+        }
 
-        index = (color + level_square) * 4;
+        STVFU(out_r[column], v_out0);
+        STVFU(out_g[column], v_out1);
+        STVFU(out_b[column], v_out2);
+    }
 
-        v_clut_values = getClutValues(clut_image, index);
-        v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
+#endif
 
-        index = (color + level + level_square) * 4;
+    for (; column < line_size; ++column) {
+        float sourceR = r[column];
+        float sourceG = g[column];
+        float sourceB = b[column];
 
-        v_clut_values = getClutValues(clut_image, index);
-        v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
+        if (convert) {
+            float x, y, z;
+            Color::rgbxyz(sourceR, sourceG, sourceB, x, y, z, work2xyz);
+            Color::xyz2rgb(x, y, z, sourceR, sourceG, sourceB, xyz2clut);
+        }
 
-        v_tmp1 = vintpf(v_g, v_tmp2, v_tmp1);
+        sourceR = Color::gamma_srgbclipped(sourceR);
+        sourceG = Color::gamma_srgbclipped(sourceG);
+        sourceB = Color::gamma_srgbclipped(sourceB);
 
-        const vfloat v_b = PERMUTEPS(v_rgb, _MM_SHUFFLE(2, 2, 2, 2));
+        float clutR, clutG, clutB;
+        clut->interpolate(sourceR * scale, sourceG * scale, sourceB * scale, clutR, clutG, clutB);
+        clutR = Color::igamma_srgb(intp(strength, clutR, sourceR));
+        clutG = Color::igamma_srgb(intp(strength, clutG, sourceG));
+        clutB = Color::igamma_srgb(intp(strength, clutB, sourceB));
 
-        v_out = vintpf(v_b, v_tmp1, v_out);
+        if (convert) {
+            float x, y, z;
+            Color::rgbxyz(clutR, clutG, clutB, x, y, z, clut2xyz);
+            Color::xyz2rgb(x, y, z, clutR, clutG, clutB, xyz2work);
+        }
 
-        STVF(*out_rgbx, vintpf(v_strength, v_out, v_in));
-#endif
+        out_r[column] = clutR;
+        out_g[column] = clutG;
+        out_b[column] = clutB;
     }
 }
 
@@ -313,33 +296,65 @@ rtengine::CLUTStore& rtengine::CLUTStore::getInstance()
     return instance;
 }
 
-std::shared_ptr<rtengine::HaldCLUT> rtengine::CLUTStore::getClut(const Glib::ustring& filename) const
+std::shared_ptr<rtengine::HaldCLUT> rtengine::CLUTStore::getClut(const Glib::ustring& filename, const Glib::ustring& working_profile) const
 {
-    std::shared_ptr<rtengine::HaldCLUT> result;
-
     const Glib::ustring full_filename =
         !Glib::path_is_absolute(filename)
             ? Glib::ustring(Glib::build_filename(options.clutsDir, filename))
             : filename;
+    const Key key(full_filename, working_profile);
+
+    {
+        MyMutex::MyLock lock(mutex);
+
+        for (auto entry = cache.begin(); entry != cache.end(); ++entry) {
+            if (entry->first == key) {
+                cache.splice(cache.begin(), cache, entry);
+                return cache.front().second;
+            }
+        }
+    }
 
-    if (!cache.get(full_filename, result)) {
-        std::unique_ptr<rtengine::HaldCLUT> clut(new rtengine::HaldCLUT);
+    std::shared_ptr<rtengine::HaldCLUT> result(new rtengine::HaldCLUT);
 
-        if (clut->load(full_filename)) {
-            result = std::move(clut);
-            cache.insert(full_filename, result);
+    if (!result->load(full_filename, working_profile)) {
+        return nullptr;
+    }
+
+    MyMutex::MyLock lock(mutex);
+
+    // another job may have loaded the same CLUT in the meantime, keep its table and count it only once
+    for (auto entry = cache.begin(); entry != cache.end(); ++entry) {
+        if (entry->first == key) {
+            cache.splice(cache.begin(), cache, entry);
+            return cache.front().second;
         }
     }
 
+    cache.emplace_front(key, result);
+    cache_bytes += result->getBytes();
+
+    // Keep at least the CLUT just loaded, evict the least recently used ones beyond the memory budget
+    const std::size_t max_bytes = static_cast<std::size_t>(std::max(options.clutCacheMemory, 0)) << 20;
+    const std::size_t max_count = std::max(options.clutCacheSize, 1);
+
+    while (cache.size() > 1 && (cache_bytes > max_bytes || cache.size() > max_count)) {
+        cache_bytes -= cache.back().second->getBytes();
+        cache.pop_back();
+    }
+
     return result;
 }
 
 void rtengine::CLUTStore::clearCache()
 {
+    MyMutex::MyLock lock(mutex);
+
     cache.clear();
+    cache_bytes = 0;
 }
 
 rtengine::CLUTStore::CLUTStore() :
-    cache(options.clutCacheSize)
+    cache_bytes(0)
 {
 }
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <list>
 #include <memory>
-#include <cstdint>
+#include <utility>
 
-#include "cache.h"
-#include "alignedbuffer.h"
+#include <glibmm/ustring.h>
+
+#include "colorlut3d.h"
 #include "noncopyable.h"
 
+#include "../rtgui/threadutils.h"
+
 namespace rtengine
 {
 
@@ -17,20 +21,25 @@ public:
     HaldCLUT();
     ~HaldCLUT();
 
-    bool load(const Glib::ustring& filename);
+    // The CLUT keeps the sRGB gamma encoded values of its own profile, lookups convert from and to @p working_profile
+    bool load(const Glib::ustring& filename, const Glib::ustring& working_profile);
 
     explicit operator bool() const;
 
     Glib::ustring getFilename() const;
     Glib::ustring getProfile() const;
+    std::size_t getBytes() const;
 
+    // Input and output are linear working space values
     void getRGB(
         float strength,
         std::size_t line_size,
         const float* r,
         const float* g,
         const float* b,
-        float* out_rgbx
+        float* out_r,
+        float* out_g,
+        float* out_b
     ) const;
 
     static void splitClutFilename(
@@ -42,12 +51,15 @@ public:
     );
 
 private:
-    AlignedBuffer<std::uint16_t> clut_image;
-    unsigned int clut_level;
-    float flevel_minus_one;
-    float flevel_minus_two;
+    std::unique_ptr<ColorLUT3D> clut;
     Glib::ustring clut_filename;
     Glib::ustring clut_profile;
+    // working space <-> CLUT profile, used if they differ
+    bool convert;
+    float work2xyz[3][3];
+    float xyz2clut[3][3];
+    float clut2xyz[3][3];
+    float xyz2work[3][3];
 };
 
 class CLUTStore final :
@@ -56,14 +68,18 @@ class CLUTStore final :
 public:
     static CLUTStore& getInstance();
 
-    std::shared_ptr<HaldCLUT> getClut(const Glib::ustring& filename) const;
+    std::shared_ptr<HaldCLUT> getClut(const Glib::ustring& filename, const Glib::ustring& working_profile) const;
 
     void clearCache();
 
 private:
+    using Key = std::pair<Glib::ustring, Glib::ustring>; // filename, working profile
+
     CLUTStore();
 
-    mutable Cache<Glib::ustring, std::shared_ptr<HaldCLUT>> cache;
+    mutable MyMutex mutex;
+    mutable std::list<std::pair<Key, std::shared_ptr<HaldCLUT>>> cache; // most recently used first
+    mutable std::size_t cache_bytes;
 };
 
 }
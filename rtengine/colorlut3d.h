@@ -0,0 +1,150 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "noncopyable.h"
+#include "opthelper.h"
+#include "rt_math.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Float RGB->RGB 3D lookup table with tetrahedral interpolation
+ *
+ * The table has @p size nodes per axis, lookups take grid coordinates in [0, size - 1].
+ * Each node is stored as three floats. The SSE version loads a node into one register together
+ * with the first value of the next node (the table is padded by one value for the last node),
+ * so the three channels are interpolated at once.
+ */
+class ColorLUT3D final :
+    public NonCopyable
+{
+public:
+    explicit ColorLUT3D(int size) :
+        size(size),
+        data(3 * static_cast<std::size_t>(size) * size * size + 1, 0.f)
+    {
+    }
+
+    int getSize() const
+    {
+        return size;
+    }
+
+    std::size_t getBytes() const
+    {
+        return data.size() * sizeof(float);
+    }
+
+    float* getNode(int r, int g, int b)
+    {
+        return &data[3 * ((static_cast<std::size_t>(r) * size + g) * size + b)];
+    }
+
+    void interpolate(float r, float g, float b, float& outR, float& outG, float& outB) const
+    {
+        const float* corners[4];
+        float weights[4];
+        getTetrahedron(r, g, b, corners, weights);
+
+        outR = weights[0] * corners[0][0] + weights[1] * corners[1][0] + weights[2] * corners[2][0] + weights[3] * corners[3][0];
+        outG = weights[0] * corners[0][1] + weights[1] * corners[1][1] + weights[2] * corners[2][1] + weights[3] * corners[3][1];
+        outB = weights[0] * corners[0][2] + weights[1] * corners[1][2] + weights[2] * corners[2][2] + weights[3] * corners[3][2];
+    }
+
+#ifdef __SSE2__
+    // Returns r, g and b in the three lower elements, the highest one is undefined
+    vfloat interpolate(float r, float g, float b) const
+    {
+        const float* corners[4];
+        float weights[4];
+        getTetrahedron(r, g, b, corners, weights);
+
+        return F2V(weights[0]) * LVFU(corners[0][0]) + F2V(weights[1]) * LVFU(corners[1][0]) + F2V(weights[2]) * LVFU(corners[2][0]) + F2V(weights[3]) * LVFU(corners[3][0]);
+    }
+#endif
+
+private:
+    // The cube around (r, g, b) is split into six tetrahedra along its main diagonal. The
+    // containing one follows from the order of the fractional parts, its corners are the
+    // origin of the cube, one or two steps along the larger fractions and the far corner.
+    void getTetrahedron(float r, float g, float b, const float* corners[4], float weights[4]) const
+    {
+        const float maxCoord = size - 1;
+        r = LIM(r, 0.f, maxCoord);
+        g = LIM(g, 0.f, maxCoord);
+        b = LIM(b, 0.f, maxCoord);
+
+        const int ri = std::min<int>(r, size - 2);
+        const int gi = std::min<int>(g, size - 2);
+        const int bi = std::min<int>(b, size - 2);
+        const float fr = r - ri;
+        const float fg = g - gi;
+        const float fb = b - bi;
+
+        const std::size_t stepR = 3 * static_cast<std::size_t>(size) * size;
+        const std::size_t stepG = 3 * static_cast<std::size_t>(size);
+        constexpr std::size_t stepB = 3;
+
+        float f1, f2, f3;
+        std::size_t offset1, offset2;
+
+        if (fr >= fg) {
+            if (fg >= fb) {
+                f1 = fr; f2 = fg; f3 = fb;
+                offset1 = stepR; offset2 = stepR + stepG;
+            } else if (fr >= fb) {
+                f1 = fr; f2 = fb; f3 = fg;
+                offset1 = stepR; offset2 = stepR + stepB;
+            } else {
+                f1 = fb; f2 = fr; f3 = fg;
+                offset1 = stepB; offset2 = stepB + stepR;
+            }
+        } else {
+            if (fr >= fb) {
+                f1 = fg; f2 = fr; f3 = fb;
+                offset1 = stepG; offset2 = stepG + stepR;
+            } else if (fg >= fb) {
+                f1 = fg; f2 = fb; f3 = fr;
+                offset1 = stepG; offset2 = stepG + stepB;
+            } else {
+                f1 = fb; f2 = fg; f3 = fr;
+                offset1 = stepB; offset2 = stepB + stepG;
+            }
+        }
+
+        const float* const origin = &data[3 * ((static_cast<std::size_t>(ri) * size + gi) * size + bi)];
+        corners[0] = origin;
+        corners[1] = origin + offset1;
+        corners[2] = origin + offset2;
+        corners[3] = origin + stepR + stepG + stepB;
+        weights[0] = 1.f - f1;
+        weights[1] = f1 - f2;
+        weights[2] = f2 - f3;
+        weights[3] = f3;
+    }
+
+    int size;
+    std::vector<float> data;
+};
+
+}
@@ -18,11 +18,131 @@
  *  2012 Emil Martinec <ejmartin@uchicago.edu>
  */
 
+#include <algorithm>
+#include <new>
+
 #include "cplx_wavelet_dec.h"
 
+#include "../rtgui/options.h"
+
 namespace rtengine
 {
 
+WaveletBufferPool& WaveletBufferPool::getInstance()
+{
+    static WaveletBufferPool instance;
+    return instance;
+}
+
+WaveletBufferPool::WaveletBufferPool() :
+    statistics{0, 0, 0, 0}
+{
+}
+
+WaveletBufferPool::~WaveletBufferPool()
+{
+    clear();
+}
+
+float* WaveletBufferPool::acquireFloats(std::size_t size)
+{
+    {
+        MyMutex::MyLock lock(mutex);
+
+        const auto sized = buffers.find(size);
+
+        if (sized != buffers.end()) {
+            float* const buffer = sized->second.buffers.back();
+            sized->second.buffers.pop_back();
+            statistics.cachedBytes -= size * sizeof(float);
+            ++statistics.reuses;
+
+            if (sized->second.buffers.empty()) {
+                lru.erase(sized->second.lruPosition);
+                buffers.erase(sized);
+            } else {
+                lru.splice(lru.begin(), lru, sized->second.lruPosition);
+            }
+
+            return buffer;
+        }
+
+        ++statistics.allocations;
+    }
+
+    return new (std::nothrow) float[size];
+}
+
+void WaveletBufferPool::releaseFloats(float* buffer, std::size_t size)
+{
+    if (!buffer) {
+        return;
+    }
+
+    const std::size_t bytes = size * sizeof(float);
+    const std::size_t maxCachedBytes = static_cast<std::size_t>(std::max(options.waveletPoolMemory, 0)) << 20;
+
+    if (bytes <= maxCachedBytes) {
+        MyMutex::MyLock lock(mutex);
+
+        auto sized = buffers.find(size);
+
+        if (sized != buffers.end()) {
+            lru.splice(lru.begin(), lru, sized->second.lruPosition);
+        }
+
+        // Make room by freeing buffers of the least recently used sizes,
+        // the released size is the most recently used one now
+        while (statistics.cachedBytes + bytes > maxCachedBytes && !lru.empty() && lru.back() != size) {
+            const auto oldest = buffers.find(lru.back());
+
+            delete[] oldest->second.buffers.back();
+            oldest->second.buffers.pop_back();
+            statistics.cachedBytes -= oldest->first * sizeof(float);
+            ++statistics.evictions;
+
+            if (oldest->second.buffers.empty()) {
+                lru.pop_back();
+                buffers.erase(oldest);
+            }
+        }
+
+        if (statistics.cachedBytes + bytes <= maxCachedBytes) {
+            if (sized == buffers.end()) {
+                lru.push_front(size);
+                sized = buffers.emplace(size, SizedBuffers{{}, lru.begin()}).first;
+            }
+
+            sized->second.buffers.push_back(buffer);
+            statistics.cachedBytes += bytes;
+            return;
+        }
+    }
+
+    delete[] buffer;
+}
+
+void WaveletBufferPool::clear()
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (const auto& sized : buffers) {
+        for (const auto buffer : sized.second.buffers) {
+            delete[] buffer;
+        }
+    }
+
+    buffers.clear();
+    lru.clear();
+    statistics.cachedBytes = 0;
+}
+
+WaveletBufferPool::Statistics WaveletBufferPool::getStatistics() const
+{
+    MyMutex::MyLock lock(mutex);
+    return statistics;
+}
+
 wavelet_decomposition::~wavelet_decomposition()
 {
     for(int i = 0; i <= lvltot; i++) {
@@ -35,7 +155,7 @@ wavelet_decomposition::~wavelet_decomposition()
     delete[] wavfilt_synth;
 
     if(coeff0) {
-        delete [] coeff0;
+        WaveletBufferPool::getInstance().release(coeff0, bufferSize());
     }
 }
 
@@ -24,6 +24,7 @@
 
 #include "cplx_wavelet_level.h"
 #include "cplx_wavelet_filter_coeffs.h"
+#include "cplx_wavelet_pool.h"
 #include "noncopyable.h"
 
 namespace rtengine
@@ -52,6 +53,12 @@ private:
 
     wavelet_level<internal_type> * wavelet_decomp[maxlevels];
 
+    // size of the two ping-pong buffers holding the lowpass data, coeff0 is one of them
+    std::size_t bufferSize() const
+    {
+        return static_cast<std::size_t>(m_w / 2 + 1) * (m_h / 2 + 1);
+    }
+
 public:
 
     template<typename E>
@@ -149,19 +156,20 @@ wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int
     // wavelet_decomp[scale][channel={lo,hi1,hi2,hi3}][pixel_array]
 
     lvltot = 0;
+    WaveletBufferPool& pool = WaveletBufferPool::getInstance();
     E *buffer[2];
-    buffer[0] = new (std::nothrow) E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[0] = pool.acquire<E>(bufferSize());
 
     if(buffer[0] == nullptr) {
         memoryAllocationFailed = true;
         return;
     }
 
-    buffer[1] = new (std::nothrow) E[(m_w / 2 + 1) * (m_h / 2 + 1)];
+    buffer[1] = pool.acquire<E>(bufferSize());
 
     if(buffer[1] == nullptr) {
         memoryAllocationFailed = true;
-        delete[] buffer[0];
+        pool.release(buffer[0], bufferSize());
         buffer[0] = nullptr;
         return;
     }
@@ -188,7 +196,7 @@ wavelet_decomposition::wavelet_decomposition(E * src, int width, int height, int
     }
 
     coeff0 = buffer[bufferindex ^ 1];
-    delete[] buffer[bufferindex];
+    pool.release(buffer[bufferindex], bufferSize());
 }
 
 template<typename E>
@@ -201,11 +209,13 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
 
     // data structure is wavcoeffs[scale][channel={lo,hi1,hi2,hi3}][pixel_array]
 
+    WaveletBufferPool& pool = WaveletBufferPool::getInstance();
+
     if(lvltot >= 1) {
         int width = wavelet_decomp[1]->m_w;
         int height = wavelet_decomp[1]->m_h;
 
-        E *tmpHi = new (std::nothrow) E[width * height];
+        E *tmpHi = pool.acquire<E>(width * height);
 
         if(tmpHi == nullptr) {
             memoryAllocationFailed = true;
@@ -219,7 +229,7 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
             wavelet_decomp[lvl] = nullptr;
         }
 
-        delete[] tmpHi;
+        pool.release(tmpHi, width * height);
     }
 
     int width = wavelet_decomp[0]->m_w;
@@ -229,7 +239,7 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
     if(wavelet_decomp[0]->bigBlockOfMemoryUsed()) { // bigBlockOfMemoryUsed means that wavcoeffs[2] points to a block of memory big enough to hold the data
         tmpLo = wavelet_decomp[0]->wavcoeffs[2];
     } else {                                      // allocate new block of memory
-        tmpLo = new (std::nothrow) E[width * height];
+        tmpLo = pool.acquire<E>(width * height);
 
         if(tmpLo == nullptr) {
             memoryAllocationFailed = true;
@@ -237,13 +247,13 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
         }
     }
 
-    E *tmpHi = new (std::nothrow) E[width * height];
+    E *tmpHi = pool.acquire<E>(width * height);
 
     if(tmpHi == nullptr) {
         memoryAllocationFailed = true;
 
         if(!wavelet_decomp[0]->bigBlockOfMemoryUsed()) {
-            delete[] tmpLo;
+            pool.release(tmpLo, width * height);
         }
 
         return;
@@ -253,13 +263,13 @@ void wavelet_decomposition::reconstruct(E * dst, const float blend)
     wavelet_decomp[0]->reconstruct_level(tmpLo, tmpHi, coeff0, dst, wavfilt_synth, wavfilt_synth, wavfilt_len, wavfilt_offset, blend);
 
     if(!wavelet_decomp[0]->bigBlockOfMemoryUsed()) {
-        delete[] tmpLo;
+        pool.release(tmpLo, width * height);
     }
 
-    delete[] tmpHi;
+    pool.release(tmpHi, width * height);
     delete wavelet_decomp[0];
     wavelet_decomp[0] = nullptr;
-    delete[] coeff0;
+    pool.release(coeff0, bufferSize());
     coeff0 = nullptr;
 }
 
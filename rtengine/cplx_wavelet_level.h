@@ -21,6 +21,7 @@
 #pragma once
 
 #include <cstddef>
+#include "cplx_wavelet_pool.h"
 #include "rt_math.h"
 #include "opthelper.h"
 #include "stdio.h"
@@ -155,7 +156,8 @@ public:
 template<typename T>
 T ** wavelet_level<T>::create(int n)
 {
-    T * data = new (std::nothrow) T[3 * n];
+    // the big block is recycled through the pool, decompositions of the same size request the same blocks
+    T * data = WaveletBufferPool::getInstance().acquire<T>(3 * n);
 
     if(data == nullptr) {
         bigBlockOfMemory = false;
@@ -184,7 +186,7 @@ void wavelet_level<T>::destroy(T ** subbands)
 {
     if(subbands) {
         if(bigBlockOfMemory) {
-            delete[] subbands[1];
+            WaveletBufferPool::getInstance().release(subbands[1], 3 * static_cast<std::size_t>(m_w2) * m_h2);
         } else {
             for(int j = 1; j < 4; j++) {
                 if(subbands[j] != nullptr) {
@@ -304,6 +306,24 @@ void wavelet_level<T>::AnalysisFilterSubsampHorizontal (T * RESTRICT srcbuffer,
      */
     // calculate coefficients
     for(int i = 0; i < srcwidth; i += 2) {
+#ifdef __SSE2__
+        if (LIKELY(i > skip * taps && i + 6 < srcwidth - skip * taps)) { //bulk, 4 output pixels at once
+            vfloat lov = ZEROV;
+            vfloat hiv = ZEROV;
+
+            for (int j = 0, l = -skip * offset; j < taps; j++, l += skip) {
+                const vfloat srcv = LC2VFU(srcbuffer[i - l]); // pixels i - l, i + 2 - l, i + 4 - l and i + 6 - l
+                lov += F2V(filterLo[j]) * srcv;//lopass channel
+                hiv += F2V(filterHi[j]) * srcv;//hipass channel
+            }
+
+            STVFU(dstLo[row * dstwidth + ((i / 2))], lov);
+            STVFU(dstHi[row * dstwidth + ((i / 2))], hiv);
+            i += 6;
+            continue;
+        }
+
+#endif
         float lo = 0.f, hi = 0.f;
 
         if (LIKELY(i > skip * taps && i < srcwidth - skip * taps)) { //bulk
@@ -474,6 +494,28 @@ template<typename T> void wavelet_level<T>::SynthesisFilterSubsampHorizontal (T
             dst[k * dstwidth + i] = tot;
         }
 
+#ifdef __SSE2__
+        // bulk, 8 output pixels at once. Even and odd output pixels use contiguous source pixels
+        // and alternating filter taps, so both phases are computed separately and interleaved.
+        for(; i + 7 < min(dstwidth - skip * taps, dstwidth); i += 8) {
+            vfloat totv[2];
+
+            for (int phase = 0; phase < 2; phase++) {
+                const int i_src = (i + phase + shift) / 2;
+                const int begin = (i + phase + shift) % 2;
+                totv[phase] = ZEROV;
+
+                for (int j = begin, l = 0; j < taps; j += 2, l += skip) {
+                    totv[phase] += ((F2V(filterLo[j]) * LVFU(srcLo[k * srcwidth + i_src - l]) + F2V(filterHi[j]) * LVFU(srcHi[k * srcwidth + i_src - l])));
+                }
+            }
+
+            STVFU(dst[k * dstwidth + i], _mm_unpacklo_ps(totv[0], totv[1]));
+            STVFU(dst[k * dstwidth + i + 4], _mm_unpackhi_ps(totv[0], totv[1]));
+        }
+
+#endif
+
         for(; i < min(dstwidth - skip * taps, dstwidth); i++) {
             float tot = 0.f;
             //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
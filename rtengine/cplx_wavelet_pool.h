@@ -0,0 +1,93 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Pool of coefficient buffers for wavelet decompositions
+ *
+ * Decompositions of the same dimensions always request the same buffer sizes level by level,
+ * so released buffers are kept by size and handed out again to the next decomposition
+ * (next slider move, next denoise tile, detail crop...) instead of going back to the heap.
+ * The memory kept for reuse is bounded by options.waveletPoolMemory. When a released buffer
+ * does not fit, buffers of the least recently used sizes are freed first.
+ */
+class WaveletBufferPool final :
+    public NonCopyable
+{
+public:
+    struct Statistics {
+        std::size_t allocations; ///< buffers allocated from the heap
+        std::size_t reuses;      ///< requests served from the pool
+        std::size_t evictions;   ///< cached buffers freed to make room for others
+        std::size_t cachedBytes; ///< memory currently kept for reuse
+    };
+
+    static WaveletBufferPool& getInstance();
+
+    /** Returns a buffer of @p size floats, or nullptr if memory allocation failed. */
+    template<typename T>
+    T* acquire(std::size_t size)
+    {
+        static_assert(std::is_same<T, float>::value, "WaveletBufferPool only holds float buffers");
+        return acquireFloats(size);
+    }
+
+    /** Hands back a buffer obtained by acquire() with the same @p size. */
+    template<typename T>
+    void release(T* buffer, std::size_t size)
+    {
+        static_assert(std::is_same<T, float>::value, "WaveletBufferPool only holds float buffers");
+        releaseFloats(buffer, size);
+    }
+
+    /** Frees all cached buffers. */
+    void clear();
+
+    Statistics getStatistics() const;
+
+private:
+    WaveletBufferPool();
+    ~WaveletBufferPool();
+
+    float* acquireFloats(std::size_t size);
+    void releaseFloats(float* buffer, std::size_t size);
+
+    struct SizedBuffers {
+        std::vector<float*> buffers; ///< never empty, sizes without cached buffers are erased
+        std::list<std::size_t>::iterator lruPosition;
+    };
+
+    std::unordered_map<std::size_t, SizedBuffers> buffers;
+    std::list<std::size_t> lru; ///< sizes with cached buffers, most recently used first
+    Statistics statistics;
+    mutable MyMutex mutex;
+};
+
+}
@@ -32,6 +32,7 @@
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagefloat.h"
+#include "opthelper.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
 #include "utils.h"
@@ -1078,7 +1079,23 @@ void DCPProfile::apply(
 #endif
 
         for (int y = 0; y < img->getHeight(); ++y) {
-            for (int x = 0; x < img->getWidth(); x++) {
+            int x = 0;
+#ifdef __SSE2__
+            const vfloat mat00v = F2V(mat[0][0]), mat01v = F2V(mat[0][1]), mat02v = F2V(mat[0][2]);
+            const vfloat mat10v = F2V(mat[1][0]), mat11v = F2V(mat[1][1]), mat12v = F2V(mat[1][2]);
+            const vfloat mat20v = F2V(mat[2][0]), mat21v = F2V(mat[2][1]), mat22v = F2V(mat[2][2]);
+
+            for (; x < img->getWidth() - 3; x += 4) {
+                const vfloat rv = LVFU(img->r(y, x));
+                const vfloat gv = LVFU(img->g(y, x));
+                const vfloat bv = LVFU(img->b(y, x));
+                STVFU(img->r(y, x), mat00v * rv + mat01v * gv + mat02v * bv);
+                STVFU(img->g(y, x), mat10v * rv + mat11v * gv + mat12v * bv);
+                STVFU(img->b(y, x), mat20v * rv + mat21v * gv + mat22v * bv);
+            }
+#endif
+
+            for (; x < img->getWidth(); x++) {
                 const float& newr = mat[0][0] * img->r(y, x) + mat[0][1] * img->g(y, x) + mat[0][2] * img->b(y, x);
                 const float& newg = mat[1][0] * img->r(y, x) + mat[1][1] * img->g(y, x) + mat[1][2] * img->b(y, x);
                 const float& newb = mat[2][0] * img->r(y, x) + mat[2][1] * img->g(y, x) + mat[2][2] * img->b(y, x);
@@ -1120,7 +1137,84 @@ void DCPProfile::apply(
 #endif
 
         for (int y = 0; y < img->getHeight(); ++y) {
-            for (int x = 0; x < img->getWidth(); x++) {
+            int x = 0;
+#ifdef __SSE2__
+            // the common 2.5D table keeps no state per pixel besides hue and saturation, so four pixels are done at once
+            if (delta_info.val_divisions < 2 && !delta_info.srgb_gamma) {
+                const vfloat pro00v = F2V(pro_photo[0][0]), pro01v = F2V(pro_photo[0][1]), pro02v = F2V(pro_photo[0][2]);
+                const vfloat pro10v = F2V(pro_photo[1][0]), pro11v = F2V(pro_photo[1][1]), pro12v = F2V(pro_photo[1][2]);
+                const vfloat pro20v = F2V(pro_photo[2][0]), pro21v = F2V(pro_photo[2][1]), pro22v = F2V(pro_photo[2][2]);
+                const vfloat work00v = F2V(work[0][0]), work01v = F2V(work[0][1]), work02v = F2V(work[0][2]);
+                const vfloat work10v = F2V(work[1][0]), work11v = F2V(work[1][1]), work12v = F2V(work[1][2]);
+                const vfloat work20v = F2V(work[2][0]), work21v = F2V(work[2][1]), work22v = F2V(work[2][2]);
+                const vfloat zerov = ZEROV;
+                const vfloat onev = F2V(1.f);
+                const vfloat twov = F2V(2.f);
+                const vfloat threev = F2V(3.f);
+                const vfloat fourv = F2V(4.f);
+                const vfloat fivev = F2V(5.f);
+                const vfloat sixv = F2V(6.f);
+                const vfloat c65535v = F2V(65535.f);
+                const vfloat epsv = F2V(0.00001f);
+
+                for (; x < img->getWidth() - 3; x += 4) {
+                    const vfloat rv = LVFU(img->r(y, x));
+                    const vfloat gv = LVFU(img->g(y, x));
+                    const vfloat bv = LVFU(img->b(y, x));
+                    vfloat newr = pro00v * rv + pro01v * gv + pro02v * bv;
+                    vfloat newg = pro10v * rv + pro11v * gv + pro12v * bv;
+                    vfloat newb = pro20v * rv + pro21v * gv + pro22v * bv;
+
+                    // Color::rgb2hsvdcp(), pixels in negative area only get the matrix
+                    const vfloat minv = vminf(vminf(newr, newg), newb);
+                    const vfloat maxv = vmaxf(vmaxf(newr, newg), newb);
+                    const vfloat delv = maxv - minv;
+                    const vmask validv = vmaskf_ge(minv, zerov);
+                    const vmask greyv = vmaskf_lt(vabsf(delv), epsv);
+                    const vmask rmaxv = vmaskf_eq(newr, maxv);
+                    const vmask gmaxv = vandnotm(rmaxv, vmaskf_eq(newg, maxv));
+
+                    vfloat h = vself(rmaxv, (newg - newb) / delv, vself(gmaxv, twov + (newb - newr) / delv, fourv + (newr - newg) / delv));
+                    h = vself(vmaskf_lt(h, zerov), h + sixv, vself(vmaskf_gt(h, sixv), h - sixv, h));
+                    h = vself(vorm(greyv, vnotm(validv)), zerov, h);
+                    vfloat s = vself(vorm(greyv, vnotm(validv)), zerov, delv / maxv);
+                    vfloat v = maxv / c65535v;
+
+                    hsdApply(delta_info, delta_base, h, s, v);
+
+                    // RT range correction
+                    h = vself(vmaskf_lt(h, zerov), h + sixv, vself(vmaskf_ge(h, sixv), h - sixv, h));
+
+                    // Color::hsv2rgbdcp()
+                    const vfloat sectorv = vcast_vf_vi2(vtruncate_vi2_vf(h));
+                    const vfloat f = h - sectorv;
+                    v *= c65535v;
+                    const vfloat vs = v * s;
+                    const vfloat p = v - vs;
+                    const vfloat q = v - f * vs;
+                    const vfloat t = p + v - q;
+                    const vmask sector1v = vmaskf_eq(sectorv, onev);
+                    const vmask sector2v = vmaskf_eq(sectorv, twov);
+                    const vmask sector3v = vmaskf_eq(sectorv, threev);
+                    const vmask sector4v = vmaskf_eq(sectorv, fourv);
+                    const vmask sector5v = vmaskf_eq(sectorv, fivev);
+
+                    const vfloat hsvr = vself(sector1v, q, vself(vorm(sector2v, sector3v), p, vself(sector4v, t, v)));
+                    const vfloat hsvg = vself(vorm(sector1v, sector2v), v, vself(sector3v, q, vself(vorm(sector4v, sector5v), p, t)));
+                    const vfloat hsvb = vself(sector2v, t, vself(vorm(sector3v, sector4v), v, vself(sector5v, q, p)));
+
+                    newr = vself(validv, hsvr, newr);
+                    newg = vself(validv, hsvg, newg);
+                    newb = vself(validv, hsvb, newb);
+
+                    STVFU(img->r(y, x), work00v * newr + work01v * newg + work02v * newb);
+                    STVFU(img->g(y, x), work10v * newr + work11v * newg + work12v * newb);
+                    STVFU(img->b(y, x), work20v * newr + work21v * newg + work22v * newb);
+                }
+            }
+#endif
+
+            for (; x < img->getWidth(); x++) {
                 float newr = pro_photo[0][0] * img->r(y, x) + pro_photo[0][1] * img->g(y, x) + pro_photo[0][2] * img->b(y, x);
                 float newg = pro_photo[1][0] * img->r(y, x) + pro_photo[1][1] * img->g(y, x) + pro_photo[1][2] * img->b(y, x);
                 float newb = pro_photo[2][0] * img->r(y, x) + pro_photo[2][1] * img->g(y, x) + pro_photo[2][2] * img->b(y, x);
@@ -1768,6 +1862,64 @@ inline void DCPProfile::hsdApply(const HsdTableInfo& table_info, const std::vect
     }
 }
 
+#ifdef __SSE2__
+void DCPProfile::hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, vfloat& h, vfloat& s, vfloat& v) const
+{
+    // Same as the 2.5D branch of the scalar version, the table entries are gathered per pixel
+    float h_scaled[4];
+    float s_scaled[4];
+    STVFU(h_scaled[0], h * F2V(table_info.pc.h_scale));
+    STVFU(s_scaled[0], s * F2V(table_info.pc.s_scale));
+
+    float h_fract1[4];
+    float s_fract1[4];
+    float entries[4][3][4]; // e00, e01, e00 + 1, e01 + 1; hue, sat, val; pixel
+
+    for (int i = 0; i < 4; ++i) {
+        int h_index0 = max<int>(h_scaled[i], 0);
+        const int s_index0 = std::max(std::min<int>(s_scaled[i], table_info.pc.max_sat_index0), 0);
+
+        int h_index1 = h_index0 + 1;
+
+        if (h_index0 >= table_info.pc.max_hue_index0) {
+            h_index0 = table_info.pc.max_hue_index0;
+            h_index1 = 0;
+        }
+
+        h_fract1[i] = h_scaled[i] - static_cast<float>(h_index0);
+        s_fract1[i] = s_scaled[i] - static_cast<float>(s_index0);
+
+        const std::vector<HsbModify>::size_type e00_index = h_index0 * table_info.pc.hue_step + s_index0;
+        const std::vector<HsbModify>::size_type e01_index = e00_index + (h_index1 - h_index0) * table_info.pc.hue_step;
+        const std::vector<HsbModify>::size_type indices[4] = {e00_index, e01_index, e00_index + 1, e01_index + 1};
+
+        for (int e = 0; e < 4; ++e) {
+            entries[e][0][i] = table_base[indices[e]].hue_shift;
+            entries[e][1][i] = table_base[indices[e]].sat_scale;
+            entries[e][2][i] = table_base[indices[e]].val_scale;
+        }
+    }
+
+    const vfloat onev = F2V(1.f);
+    const vfloat h_fract1v = LVFU(h_fract1[0]);
+    const vfloat s_fract1v = LVFU(s_fract1[0]);
+    const vfloat h_fract0v = onev - h_fract1v;
+    const vfloat s_fract0v = onev - s_fract1v;
+
+    vfloat result[3];
+
+    for (int c = 0; c < 3; ++c) {
+        const vfloat value0 = h_fract0v * LVFU(entries[0][c][0]) + h_fract1v * LVFU(entries[1][c][0]);
+        const vfloat value1 = h_fract0v * LVFU(entries[2][c][0]) + h_fract1v * LVFU(entries[3][c][0]);
+        result[c] = s_fract0v * value0 + s_fract1v * value1;
+    }
+
+    h += result[0] * F2V(6.0f / 360.0f); // Convert to internal hue range.
+    s *= result[1]; // No clipping here, we are RT float :-)
+    v *= result[2];
+}
+#endif
+
 bool DCPProfile::isValid()
 {
     return valid;
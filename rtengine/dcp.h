@@ -30,6 +30,7 @@
 
 #include "curves.h"
 #include "noncopyable.h"
+#include "opthelper.h"
 
 namespace rtengine
 {
@@ -109,6 +110,10 @@ private:
     Matrix makeXyzCam(const ColorTemp& white_balance, const Triple& pre_mul, const Matrix& cam_wb_matrix, int preferred_illuminant) const;
     std::vector<HsbModify> makeHueSatMap(const ColorTemp& white_balance, int preferred_illuminant) const;
     void hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, float& h, float& s, float& v) const;
+#ifdef __SSE2__
+    // Four pixels at once, only for 2.5D tables with linear value encoding
+    void hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, vfloat& h, vfloat& s, vfloat& v) const;
+#endif
 
     Matrix color_matrix_1;
     Matrix color_matrix_2;
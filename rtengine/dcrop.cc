@@ -735,8 +735,8 @@ void Crop::update(int todo)
         }
 
         if (need_fattal) {
-            parent->ipf.dehaze(f);
-            parent->ipf.ToneMapFattal02(f);
+            parent->ipf.dehaze(f, &parent->analysisPyramid);
+            parent->ipf.ToneMapFattal02(f, &parent->fattalAttenuationCache);
         }
 
         // crop back to the size expected by the rest of the pipeline
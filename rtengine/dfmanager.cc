@@ -17,12 +17,14 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include <cstdio>
 #include <giomm.h>
 #include <glibmm/ustring.h>
 
+#include "calibrationindex.h"
 #include "dfmanager.h"
 #include "../rtgui/options.h"
 #include "rawimage.h"
@@ -111,6 +113,8 @@ double dfInfo::distance(const std::string &mak, const std::string &mod, int iso,
 
 RawImage* dfInfo::getRawImage()
 {
+    MyMutex::MyLock lock(templateMutex);
+
     if(ri) {
         return ri;
     }
@@ -123,6 +127,8 @@ RawImage* dfInfo::getRawImage()
 
 std::vector<badPix>& dfInfo::getHotPixels()
 {
+    MyMutex::MyLock lock(templateMutex);
+
     if( !ri ) {
         updateRawImage();
         updateBadPixelList( ri );
@@ -274,47 +280,54 @@ void dfInfo::updateBadPixelList( RawImage *df )
 
 // ************************* class DFManager *********************************
 
+namespace
+{
+
+// Shot information of a dark frame, as kept in the calibration index: maker, model, ISO, shutter, timestamp
+CalibrationIndex::Fields readShotInfo(const RawImage&, const FramesData& idata)
+{
+    return {
+        ((Glib::ustring)idata.getMake()).uppercase(),
+        ((Glib::ustring)idata.getModel()).uppercase(),
+        std::to_string(idata.getISOSpeed()),
+        CalibrationIndex::toString(idata.getShutterSpeed()),
+        std::to_string(idata.getDateTimeAsTS())
+    };
+}
+
+constexpr std::size_t shotInfoSize = 5;
+
+}
+
 void DFManager::init(const Glib::ustring& pathname)
 {
     if (pathname.empty()) {
         return;
     }
-    std::vector<Glib::ustring> names;
-
-    auto dir = Gio::File::create_for_path (pathname);
-    if (!dir || !dir->query_exists()) {
-        return;
-    }
 
-    try {
-
-        auto enumerator = dir->enumerate_children ("standard::name");
+    dfList.clear();
+    bpList.clear();
 
-        while (auto file = enumerator->next_file ()) {
-            names.emplace_back (Glib::build_filename (pathname, file->get_name ()));
+    const auto handleBadPixels = [this](const Glib::ustring& filename) {
+        if (getFileExtension(filename) != "badpixels") {
+            return false;
         }
 
-    } catch (Glib::Exception&) {}
-
-    dfList.clear();
-    bpList.clear();
+        int n = scanBadPixelsFile( filename );
 
-    for (size_t i = 0; i < names.size(); i++) {
-        size_t lastdot = names[i].find_last_of ('.');
+        if( n > 0 && settings->verbose) {
+            printf("Loaded %s: %d pixels\n", filename.c_str(), n);
+        }
 
-        if (lastdot != Glib::ustring::npos && names[i].substr(lastdot) == ".badpixels" ) {
-            int n = scanBadPixelsFile( names[i] );
+        return true;
+    };
 
-            if( n > 0 && settings->verbose) {
-                printf("Loaded %s: %d pixels\n", names[i].c_str(), n);
-            }
+    for (const auto& frame : CalibrationIndex::scan(pathname, "darkframes.idx", handleBadPixels, readShotInfo, "Dark frames")) {
+        const auto& shotInfo = frame.fields;
 
-            continue;
+        if (shotInfo.size() == shotInfoSize) {
+            addFileInfo(frame.filename, shotInfo[0], shotInfo[1], std::atoi(shotInfo[2].c_str()), g_ascii_strtod(shotInfo[3].c_str(), nullptr), std::atoll(shotInfo[4].c_str()));
         }
-
-        try {
-            addFileInfo(names[i]);
-        } catch( std::exception& e ) {}
     }
 
     // Where multiple shots exist for same group, move filename to list
@@ -375,49 +388,55 @@ dfInfo* DFManager::addFileInfo (const Glib::ustring& filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
+        if(!pool) {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
 
-        dfList_t::iterator iter;
+            if (res != 0) {
+                return nullptr;
+            }
 
-        if(!pool) {
             dfInfo n(filename, "", "", 0, 0, 0);
-            iter = dfList.emplace("", n);
+            auto iter = dfList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
-        /* Files are added in the map, divided by same maker/model,ISO and shutter*/
-        std::string key(dfInfo::key(((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed()));
-        iter = dfList.find(key);
-
-        if(iter == dfList.end()) {
-            dfInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed(), idata.getDateTimeAsTS());
-            iter = dfList.emplace(key, n);
-        } else {
-            while(iter != dfList.end() && iter->second.key() == key && ABS(iter->second.timestamp - idata.getDateTimeAsTS()) > 60 * 60 * 6) { // 6 hour difference
-                ++iter;
-            }
+        CalibrationIndex::Fields shotInfo;
 
-            if(iter != dfList.end()) {
-                iter->second.pathNames.push_back(filename);
-            } else {
-                dfInfo n(filename, ((Glib::ustring)idata.getMake()).uppercase(), ((Glib::ustring)idata.getModel()).uppercase(), idata.getISOSpeed(), idata.getShutterSpeed(), idata.getDateTimeAsTS());
-                iter = dfList.emplace(key, n);
-            }
+        if (CalibrationIndex::readFrame(filename, readShotInfo, shotInfo) && shotInfo.size() == shotInfoSize) {
+            return addFileInfo(filename, shotInfo[0], shotInfo[1], std::atoi(shotInfo[2].c_str()), g_ascii_strtod(shotInfo[3].c_str(), nullptr), std::atoll(shotInfo[4].c_str()));
         }
 
-        return &(iter->second);
-
     } catch(Gio::Error&) {}
 
     return nullptr;
 }
 
+dfInfo* DFManager::addFileInfo (const Glib::ustring& filename, const std::string& mak, const std::string& mod, int iso, double shut, time_t t)
+{
+    /* Files are added in the map, divided by same maker/model,ISO and shutter*/
+    std::string key(dfInfo::key(mak, mod, iso, shut));
+    dfList_t::iterator iter = dfList.find(key);
+
+    if(iter == dfList.end()) {
+        dfInfo n(filename, mak, mod, iso, shut, t);
+        iter = dfList.emplace(key, n);
+    } else {
+        while(iter != dfList.end() && iter->second.key() == key && ABS(iter->second.timestamp - t) > 60 * 60 * 6) { // 6 hour difference
+            ++iter;
+        }
+
+        if(iter != dfList.end()) {
+            iter->second.pathNames.push_back(filename);
+        } else {
+            dfInfo n(filename, mak, mod, iso, shut, t);
+            iter = dfList.emplace(key, n);
+        }
+    }
+
+    return &(iter->second);
+}
+
 void DFManager::getStat( int &totFiles, int &totTemplates)
 {
     totFiles = 0;
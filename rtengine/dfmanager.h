@@ -27,6 +27,8 @@
 
 #include "pixelsmap.h"
 
+#include "../rtgui/threadutils.h"
+
 namespace rtengine
 {
 
@@ -69,6 +71,7 @@ public:
 protected:
     RawImage *ri; ///< Dark Frame raw data
     std::vector<badPix> badPixels; ///< Extracted hot pixels
+    MyMutex templateMutex; ///< Serializes building ri, so concurrent jobs needing this dark frame build it once
 
     void updateBadPixelList( RawImage *df );
     void updateRawImage();
@@ -97,6 +100,7 @@ protected:
     bool initialized;
     Glib::ustring currentPath;
     dfInfo *addFileInfo(const Glib::ustring &filename, bool pool = true );
+    dfInfo *addFileInfo(const Glib::ustring &filename, const std::string &mak, const std::string &mod, int iso, double shut, time_t t );
     dfInfo *find( const std::string &mak, const std::string &mod, int isospeed, double shut, time_t t );
     int scanBadPixelsFile( Glib::ustring filename );
 };
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Gradient attenuations of the last Fattal02 tone mappings
+ *
+ * tmo_fattal02 computes the Gaussian pyramid, the gradients and the attenuation matrix from the log
+ * luminance scaled down to at most 1920 pixels, whatever the size of the image. This class keeps the
+ * attenuation together with the scaled log luminance and the parameters it was computed from, so that
+ * another run on the same input (a detail window panned at the same zoom, a second detail window, a
+ * change of the anchor) only has to solve the Poisson equation.
+ *
+ * One attenuation is kept per scaled size and detail level, so that the preview and the detail windows don't
+ * evict each other, the least recently used one is dropped beyond maxEntries. A new attenuation replaces the
+ * one of the same size and detail level, as panning a detail window makes the old one obsolete.
+ *
+ * The cache is only used if the scaled log luminance is bit identical, so the result never differs from
+ * a full computation.
+ */
+class FattalAttenuationCache final :
+    public NonCopyable
+{
+public:
+    FattalAttenuationCache() = default;
+
+    /** Copies the cached attenuation to @p attenuationOut and returns true if the input matches. */
+    bool get(const float* logLuminanceIn, int widthIn, int heightIn, float alphaIn, float betaIn, float noiseIn, int detailLevelIn, float* attenuationOut);
+    void put(const float* logLuminanceIn, int widthIn, int heightIn, float alphaIn, float betaIn, float noiseIn, int detailLevelIn, const float* attenuationIn);
+    void clear();
+
+private:
+    // the preview and two detail windows, each entry takes at most 1920 x 1920 x 2 floats
+    static constexpr std::size_t maxEntries = 3;
+
+    struct Entry {
+        int width;
+        int height;
+        float alpha;
+        float beta;
+        float noise;
+        int detailLevel;
+        std::vector<float> logLuminance;
+        std::vector<float> attenuation;
+    };
+
+    std::list<Entry> entries; // most recently used first
+};
+
+}
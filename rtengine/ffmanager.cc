@@ -17,9 +17,12 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
+
 #include <giomm/file.h>
 #include <glibmm/miscutils.h>
 
+#include "calibrationindex.h"
 #include "ffmanager.h"
 #include "../rtgui/options.h"
 #include "rawimage.h"
@@ -116,6 +119,8 @@ double ffInfo::distance(const std::string &mak, const std::string &mod, const st
 
 RawImage* ffInfo::getRawImage()
 {
+    MyMutex::MyLock lock(templateMutex);
+
     if(ri) {
         return ri;
     }
@@ -238,35 +243,42 @@ void ffInfo::updateRawImage()
 
 // ************************* class FFManager *********************************
 
-void FFManager::init(const Glib::ustring& pathname)
+namespace
 {
-    if (pathname.empty()) {
-        return;
-    }
-    std::vector<Glib::ustring> names;
 
-    auto dir = Gio::File::create_for_path (pathname);
+// Shot information of a flat field, as kept in the calibration index:
+// maker, model, lens, focal length, aperture, timestamp, timestamp of the raw file
+CalibrationIndex::Fields readShotInfo(const RawImage& ri, const FramesData& idata)
+{
+    return {
+        idata.getMake(),
+        idata.getModel(),
+        idata.getLens(),
+        CalibrationIndex::toString(idata.getFocalLen()),
+        CalibrationIndex::toString(idata.getFNumber()),
+        std::to_string(idata.getDateTimeAsTS()),
+        std::to_string(ri.get_timestamp())
+    };
+}
+
+constexpr std::size_t shotInfoSize = 7;
 
-    if (!dir || !dir->query_exists()) {
+}
+
+void FFManager::init(const Glib::ustring& pathname)
+{
+    if (pathname.empty()) {
         return;
     }
 
-    try {
+    ffList.clear();
 
-        auto enumerator = dir->enumerate_children ("standard::name");
+    for (const auto& frame : CalibrationIndex::scan(pathname, "flatfields.idx", nullptr, readShotInfo, "Flat fields")) {
+        const auto& shotInfo = frame.fields;
 
-        while (auto file = enumerator->next_file ()) {
-            names.emplace_back (Glib::build_filename (pathname, file->get_name ()));
+        if (shotInfo.size() == shotInfoSize) {
+            addFileInfo(frame.filename, shotInfo[0], shotInfo[1], shotInfo[2], g_ascii_strtod(shotInfo[3].c_str(), nullptr), g_ascii_strtod(shotInfo[4].c_str(), nullptr), std::atoll(shotInfo[5].c_str()), std::atoll(shotInfo[6].c_str()));
         }
-
-    } catch (Glib::Exception&) {}
-
-    ffList.clear();
-
-    for (size_t i = 0; i < names.size(); i++) {
-        try {
-            addFileInfo(names[i]);
-        } catch( std::exception& e ) {}
     }
 
     // Where multiple shots exist for same group, move filename to list
@@ -327,49 +339,55 @@ ffInfo* FFManager::addFileInfo (const Glib::ustring& filename, bool pool)
             return nullptr;
         }
 
-        RawImage ri(filename);
-        int res = ri.loadRaw(false); // Read information about shot
-
-        if (res != 0) {
-            return nullptr;
-        }
+        if(!pool) {
+            RawImage ri(filename);
+            int res = ri.loadRaw(false); // Read information about shot
 
-        ffList_t::iterator iter;
+            if (res != 0) {
+                return nullptr;
+            }
 
-        if(!pool) {
             ffInfo n(filename, "", "", "", 0, 0, 0);
-            iter = ffList.emplace("", n);
+            auto iter = ffList.emplace("", n);
             return &(iter->second);
         }
 
-        FramesData idata(filename, std::unique_ptr<RawMetaDataLocation>(new RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())), true);
-        /* Files are added in the map, divided by same maker/model,lens and aperture*/
-        std::string key(ffInfo::key(idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber()));
-        iter = ffList.find(key);
+        CalibrationIndex::Fields shotInfo;
 
-        if(iter == ffList.end()) {
-            ffInfo n(filename, idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber(), idata.getDateTimeAsTS());
-            iter = ffList.emplace(key, n);
-        } else {
-            while(iter != ffList.end() && iter->second.key() == key && ABS(iter->second.timestamp - ri.get_timestamp()) > 60 * 60 * 6) { // 6 hour difference
-                ++iter;
-            }
-
-            if(iter != ffList.end()) {
-                iter->second.pathNames.push_back(filename);
-            } else {
-                ffInfo n(filename, idata.getMake(), idata.getModel(), idata.getLens(), idata.getFocalLen(), idata.getFNumber(), idata.getDateTimeAsTS());
-                iter = ffList.emplace(key, n);
-            }
+        if (CalibrationIndex::readFrame(filename, readShotInfo, shotInfo) && shotInfo.size() == shotInfoSize) {
+            return addFileInfo(filename, shotInfo[0], shotInfo[1], shotInfo[2], g_ascii_strtod(shotInfo[3].c_str(), nullptr), g_ascii_strtod(shotInfo[4].c_str(), nullptr), std::atoll(shotInfo[5].c_str()), std::atoll(shotInfo[6].c_str()));
         }
 
-        return &(iter->second);
-
     } catch (Gio::Error&) {}
 
     return nullptr;
 }
 
+ffInfo* FFManager::addFileInfo (const Glib::ustring& filename, const std::string& mak, const std::string& mod, const std::string& len, double focal, double apert, time_t t, time_t rawTimestamp)
+{
+    /* Files are added in the map, divided by same maker/model,lens and aperture*/
+    std::string key(ffInfo::key(mak, mod, len, focal, apert));
+    ffList_t::iterator iter = ffList.find(key);
+
+    if(iter == ffList.end()) {
+        ffInfo n(filename, mak, mod, len, focal, apert, t);
+        iter = ffList.emplace(key, n);
+    } else {
+        while(iter != ffList.end() && iter->second.key() == key && ABS(iter->second.timestamp - rawTimestamp) > 60 * 60 * 6) { // 6 hour difference
+            ++iter;
+        }
+
+        if(iter != ffList.end()) {
+            iter->second.pathNames.push_back(filename);
+        } else {
+            ffInfo n(filename, mak, mod, len, focal, apert, t);
+            iter = ffList.emplace(key, n);
+        }
+    }
+
+    return &(iter->second);
+}
+
 void FFManager::getStat( int &totFiles, int &totTemplates)
 {
     totFiles = 0;
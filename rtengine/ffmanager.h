@@ -25,6 +25,8 @@
 
 #include <glibmm/ustring.h>
 
+#include "../rtgui/threadutils.h"
+
 namespace rtengine
 {
 
@@ -67,6 +69,7 @@ public:
 
 protected:
     RawImage *ri; ///< Flat Field raw data
+    MyMutex templateMutex; ///< Serializes building ri, so concurrent jobs needing this flat field build it once
 
     void updateRawImage();
 };
@@ -89,6 +92,7 @@ protected:
     bool initialized;
     Glib::ustring currentPath;
     ffInfo *addFileInfo(const Glib::ustring &filename, bool pool = true );
+    ffInfo *addFileInfo(const Glib::ustring &filename, const std::string &mak, const std::string &mod, const std::string &len, double focal, double apert, time_t t, time_t rawTimestamp );
     ffInfo *find( const std::string &mak, const std::string &mod, const std::string &len, double focal, double apert, time_t t );
 };
 
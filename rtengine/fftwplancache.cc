@@ -0,0 +1,156 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "fftwplancache.h"
+#include "settings.h"
+
+rtengine::FFTWPlanCache& rtengine::FFTWPlanCache::getInstance()
+{
+    static FFTWPlanCache instance;
+    return instance;
+}
+
+rtengine::FFTWPlanCache::FFTWPlanCache() :
+    wisdomChanged(false)
+{
+}
+
+void rtengine::FFTWPlanCache::init(const Glib::ustring& wisdomFile)
+{
+    MyMutex::MyLock lock(mutex);
+
+#ifdef RT_FFTW3F_OMP
+    fftwf_init_threads();
+#endif
+
+    this->wisdomFile = wisdomFile;
+
+    if (!wisdomFile.empty() && fftwf_import_wisdom_from_filename(wisdomFile.c_str()) && settings->verbose) {
+        std::cout << "FFTW wisdom loaded from " << wisdomFile << std::endl;
+    }
+}
+
+void rtengine::FFTWPlanCache::cleanup()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (wisdomChanged && !wisdomFile.empty()) {
+        if (!fftwf_export_wisdom_to_filename(wisdomFile.c_str()) && settings->verbose) {
+            std::cerr << "Could not save FFTW wisdom to " << wisdomFile << std::endl;
+        }
+
+        wisdomChanged = false;
+    }
+
+    for (const auto& plan : plans) {
+        fftwf_destroy_plan(plan.second);
+    }
+
+    plans.clear();
+}
+
+fftwf_plan rtengine::FFTWPlanCache::getR2R2D(int height, int width, fftwf_r2r_kind kind0, fftwf_r2r_kind kind1, const float* in, const float* out, unsigned int flags, bool multithread)
+{
+    if (fftwf_alignment_of(const_cast<float*>(in)) || fftwf_alignment_of(const_cast<float*>(out))) {
+        // new-array execution requires the same alignment as the arrays used for planning
+        flags |= FFTW_UNALIGNED;
+    }
+
+#ifdef RT_FFTW3F_OMP
+    const int nthreads = multithread ? omp_get_max_threads() : 1;
+#else
+    const int nthreads = 1;
+#endif
+
+    const Key key(height, width, kind0, kind1, 1, flags, nthreads, in == out);
+
+    MyMutex::MyLock lock(mutex);
+
+    const auto it = plans.find(key);
+
+    if (it != plans.end()) {
+        return it->second;
+    }
+
+    return plans[key] = createPlan(key);
+}
+
+fftwf_plan rtengine::FFTWPlanCache::getBlockDCT(int size, int howmany, bool forward)
+{
+    const fftwf_r2r_kind kind = forward ? FFTW_REDFT10 : FFTW_REDFT01;
+    const Key key(size, size, kind, kind, howmany, FFTW_MEASURE | FFTW_DESTROY_INPUT, 1, false);
+
+    MyMutex::MyLock lock(mutex);
+
+    const auto it = plans.find(key);
+
+    if (it != plans.end()) {
+        return it->second;
+    }
+
+    return plans[key] = createPlan(key);
+}
+
+std::size_t rtengine::FFTWPlanCache::getPlanCount() const
+{
+    MyMutex::MyLock lock(mutex);
+    return plans.size();
+}
+
+fftwf_plan rtengine::FFTWPlanCache::createPlan(const Key& key)
+{
+    // called with mutex locked, the planner of FFTW is not thread safe
+    const int height = std::get<0>(key);
+    const int width = std::get<1>(key);
+    const fftwf_r2r_kind kinds[2] = {static_cast<fftwf_r2r_kind>(std::get<2>(key)), static_cast<fftwf_r2r_kind>(std::get<3>(key))};
+    const int howmany = std::get<4>(key);
+    const unsigned int flags = std::get<5>(key);
+    const bool inplace = std::get<7>(key);
+    const int n[2] = {height, width};
+    const int dist = height * width;
+
+    // FFTW_MEASURE overwrites the arrays, so always plan on scratch buffers
+    float* const in = static_cast<float*>(fftwf_malloc(static_cast<std::size_t>(dist) * howmany * sizeof(float)));
+    float* const out = inplace ? in : static_cast<float*>(fftwf_malloc(static_cast<std::size_t>(dist) * howmany * sizeof(float)));
+
+#ifdef RT_FFTW3F_OMP
+    fftwf_plan_with_nthreads(std::get<6>(key));
+#endif
+
+    const fftwf_plan plan = fftwf_plan_many_r2r(2, n, howmany, in, nullptr, 1, dist, out, nullptr, 1, dist, kinds, flags);
+
+#ifdef RT_FFTW3F_OMP
+    fftwf_plan_with_nthreads(1);
+#endif
+
+    if (!inplace) {
+        fftwf_free(out);
+    }
+
+    fftwf_free(in);
+
+    if (!(flags & FFTW_ESTIMATE)) {
+        wisdomChanged = true;
+    }
+
+    return plan;
+}
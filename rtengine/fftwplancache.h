@@ -0,0 +1,87 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <map>
+#include <tuple>
+
+#include <fftw3.h>
+
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Process-wide store of FFTW plans
+ *
+ * Creating a plan (especially with FFTW_MEASURE) is expensive and not thread safe, while
+ * executing a plan is both cheap and thread safe. The store creates each plan once, on
+ * scratch buffers, and hands it out for use with the new-array execute functions
+ * (fftwf_execute_r2r). Plans live until cleanup(), so a returned plan can be executed
+ * concurrently from any thread without holding a lock.
+ *
+ * Accumulated wisdom is loaded from and saved to disk, so FFTW_MEASURE planning is only
+ * paid once per machine and not once per session.
+ */
+class FFTWPlanCache final :
+    public NonCopyable
+{
+public:
+    static FFTWPlanCache& getInstance();
+
+    /** Imports the wisdom stored in @p wisdomFile (if any). An empty filename disables persistence. */
+    void init(const Glib::ustring& wisdomFile);
+    /** Saves new wisdom and destroys all plans. No plan obtained before must be used afterwards. */
+    void cleanup();
+
+    /**
+     * Returns a plan for a 2D real-to-real transform of a @p height x @p width array.
+     * @p in and @p out are the arrays the plan will be executed on. They are only used to
+     * determine in-place/out-of-place execution and alignment, their content is never touched.
+     * If @p multithread is true and FFTW has thread support, the plan uses all OpenMP threads.
+     */
+    fftwf_plan getR2R2D(int height, int width, fftwf_r2r_kind kind0, fftwf_r2r_kind kind1, const float* in, const float* out, unsigned int flags, bool multithread = false);
+
+    /**
+     * Returns a plan transforming @p howmany contiguous @p size x @p size blocks in one call
+     * (DCT-II when @p forward is true, DCT-III otherwise). Arrays have to be allocated with fftwf_malloc().
+     */
+    fftwf_plan getBlockDCT(int size, int howmany, bool forward);
+
+    /** Number of plans created so far, for diagnostics. */
+    std::size_t getPlanCount() const;
+
+private:
+    // height, width, kind0, kind1, howmany, flags, nthreads, inplace
+    using Key = std::tuple<int, int, int, int, int, unsigned int, int, bool>;
+
+    FFTWPlanCache();
+
+    fftwf_plan createPlan(const Key& key);
+
+    std::map<Key, fftwf_plan> plans;
+    mutable MyMutex mutex;
+    Glib::ustring wisdomFile;
+    bool wisdomChanged;
+};
+
+}
@@ -1397,11 +1397,7 @@ template<class T> void gaussianBlurImpl(T** src, T** dst, const int W, const int
             sizes[i] = ((i < m ? wl : wu) - 1) / 2;
         }
 
-        rtengine::boxblur(src, dst, sizes[0], W, H, true);
-
-        for(int i = 1; i < n; i++) {
-            rtengine::boxblur(dst, dst, sizes[i], W, H, true);
-        }
+        rtengine::boxblurIterated(src, dst, sizes, n, W, H, true);
     } else {
         if (sigma < GAUSS_SKIP) {
             // don't perform filtering
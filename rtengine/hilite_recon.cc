@@ -24,11 +24,14 @@
 //
 ////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <vector>
 
 #include "array2D.h"
+#include "boxblur.h"
 #include "opthelper.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
@@ -36,85 +39,75 @@
 namespace
 {
 
-void boxblur2(const float* const* src, float** dst, float** temp, int startY, int startX, int H, int W, int bufferW, int box)
+// One step of the directional extension of the highlight map, for the elements start to end - 1 of a line.
+// Where the highlight map covers the line, the extension is its colour and a coverage of 1. Elsewhere the colour
+// is the coverage weighted average of the five nearest values of the previous line, attenuated by 0.1, and the
+// coverage is 0.1 if any of them is covered at all.
+void extendHighlightLine(const float* const hilite[4], const float* const prev[4], float* const cur[4], int start, int end)
 {
-    constexpr int numCols = 16;
-    assert((bufferW % numCols) == 0);
-
-    //box blur image channel; box size = 2*box+1
-    //horizontal blur
-#ifdef _OPENMP
-    #pragma omp parallel for
-#endif
-    for (int row = 0; row < H; ++row) {
-        int len = box + 1;
-        temp[row][0] = src[row + startY][startX] / len;
+    constexpr float epsilon = 0.00001f;
 
-        for (int j = 1; j <= box; ++j) {
-            temp[row][0] += src[row + startY][j + startX] / len;
-        }
+    int k = start;
+#ifdef __SSE2__
+    const vfloat epsilonv = F2V(epsilon);
+    const vfloat onev = F2V(1.f);
+    const vfloat tenthv = F2V(0.1f);
 
-        for (int col = 1; col <= box; ++col, ++len) {
-            temp[row][col] = (temp[row][col - 1] * len + src[row + startY][col + box + startX]) / (len + 1);
-        }
+    for (; k < end - 3; k += 4) {
+        const vfloat hilite3v = LVFU(hilite[3][k]);
+        const vmask coveredv = vmaskf_gt(hilite3v, epsilonv);
+        const vfloat weightv = LVFU(prev[3][k - 2]) + LVFU(prev[3][k - 1]) + LVFU(prev[3][k]) + LVFU(prev[3][k + 1]) + LVFU(prev[3][k + 2]);
 
-        for (int col = box + 1; col < W - box; ++col) {
-            temp[row][col] = temp[row][col - 1] + (src[row + startY][col + box + startX] - src[row + startY][col - box - 1 + startX]) / len;
+        for (int c = 0; c < 3; ++c) {
+            const vfloat sumv = LVFU(prev[c][k - 2]) + LVFU(prev[c][k - 1]) + LVFU(prev[c][k]) + LVFU(prev[c][k + 1]) + LVFU(prev[c][k + 2]);
+            STVFU(cur[c][k], vself(coveredv, LVFU(hilite[c][k]) / hilite3v, tenthv * (sumv / (weightv + epsilonv))));
         }
 
-        for (int col = W - box; col < W; ++col, --len) {
-            temp[row][col] = (temp[row][col - 1] * len - src[row + startY][col - box - 1 + startX]) / (len - 1);
-        }
+        STVFU(cur[3][k], vself(coveredv, onev, vselfnotzero(vmaskf_eq(weightv, ZEROV), tenthv)));
     }
-
-    //vertical blur
-#ifdef _OPENMP
-    #pragma omp parallel
 #endif
-    {
-        float tempvalN[numCols] ALIGNED64;
-#ifdef _OPENMP
-    #pragma omp for
-#endif
-        for (int col = 0; col < bufferW - numCols + 1; col += numCols) {
-            float len = box + 1;
 
-            for (int n = 0; n < numCols; ++n) {
-                tempvalN[n] = temp[0][col + n] / len;
+    for (; k < end; ++k) {
+        if (hilite[3][k] > epsilon) {
+            for (int c = 0; c < 3; ++c) {
+                cur[c][k] = hilite[c][k] / hilite[3][k];
             }
 
-            for (int i = 1; i <= box; ++i) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += temp[i][col + n] / len;
-                }
-            }
+            cur[3][k] = 1.f;
+        } else {
+            const float weight = prev[3][k - 2] + prev[3][k - 1] + prev[3][k] + prev[3][k + 1] + prev[3][k + 2];
 
-            for (int n = 0; n < numCols; ++n) {
-                dst[0][col + n] = tempvalN[n];
+            for (int c = 0; c < 3; ++c) {
+                cur[c][k] = 0.1f * ((prev[c][k - 2] + prev[c][k - 1] + prev[c][k] + prev[c][k + 1] + prev[c][k + 2]) / (weight + epsilon));
             }
 
-            for (int row = 1; row <= box; ++row, ++len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] = (tempvalN[n] * len + temp[(row + box)][col + n]) / (len + 1);
-                    dst[row][col + n] = tempvalN[n];
-                }
-            }
+            cur[3][k] = weight == 0.f ? 0.f : 0.1f;
+        }
+    }
+}
 
-            const float rlen = 1.f / len;
+// Extends the highlight map to the lines first, first + step, ... up to but excluding last, each one from the line
+// before it. The two outer elements at both ends of a line are left untouched. As a line only depends on the previous
+// one, each line is split into tiles which are processed in parallel. All four channels are extended in the same sweep.
+void extendHighlights(float** const hilite[4], float** const dir[4], int first, int last, int step, int length)
+{
+    constexpr int tileSize = 128;
+    const int numTiles = (length - 4 + tileSize - 1) / tileSize;
+    const int numLines = (last - first) / step;
 
-            for (int row = box + 1; row < H - box; ++row) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] += (temp[(row + box)][col + n] - temp[(row - box - 1)][col + n]) * rlen;
-                    dst[row][col + n] = tempvalN[n];
-                }
-            }
+#ifdef _OPENMP
+    #pragma omp parallel if (numTiles > 1)
+#endif
+    for (int line = first; line != first + numLines * step; line += step) {
+        const float* const hiliteLine[4] = {hilite[0][line], hilite[1][line], hilite[2][line], hilite[3][line]};
+        const float* const prev[4] = {dir[0][line - step], dir[1][line - step], dir[2][line - step], dir[3][line - step]};
+        float* const cur[4] = {dir[0][line], dir[1][line], dir[2][line], dir[3][line]};
 
-            for (int row = H - box; row < H; ++row, --len) {
-                for (int n = 0; n < numCols; ++n) {
-                    tempvalN[n] = (dst[(row - 1)][col + n] * len - temp[(row - box - 1)][col + n]) / (len - 1);
-                    dst[row][col + n] = tempvalN[n];
-                }
-            }
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int tile = 0; tile < numTiles; ++tile) {
+            extendHighlightLine(hiliteLine, prev, cur, 2 + tile * tileSize, std::min(2 + (tile + 1) * tileSize, length - 2));
         }
     }
 }
@@ -389,21 +382,47 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         medFactor[c] = max(1.0f, max_f[c] / medpt) / -blendpt;
     }
 
+    const auto isClipped =
+        [red, green, blue, &max_f](int i, int j) -> bool
+        {
+            return red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2];
+        };
+
+    // first and last + 1 clipped column of each row, the reconstruction only visits these ranges
+    std::vector<int> clipStart(height, 0);
+    std::vector<int> clipEnd(height, 0);
+
     int minx = width - 1;
     int maxx = 0;
     int miny = height - 1;
     int maxy = 0;
 
+#ifdef _OPENMP
     #pragma omp parallel for reduction(min:minx,miny) reduction(max:maxx,maxy) schedule(dynamic, 16)
+#endif
     for (int i = 0; i < height; ++i) {
-        for (int j = 0; j< width; ++j) {
-            if (red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2]) {
-                minx = std::min(minx, j);
-                maxx = std::max(maxx, j);
-                miny = std::min(miny, i);
-                maxy = std::max(maxy, i);
-            }
+        int j = 0;
+
+        while (j < width && !isClipped(i, j)) {
+            ++j;
+        }
+
+        if (j == width) {
+            continue;
         }
+
+        int k = width - 1;
+
+        while (!isClipped(i, k)) {
+            --k;
+        }
+
+        clipStart[i] = j;
+        clipEnd[i] = k + 1;
+        minx = std::min(minx, j);
+        maxx = std::max(maxx, k);
+        miny = std::min(miny, i);
+        maxy = std::max(maxy, i);
     }
 
     if (minx > maxx || miny > maxy) { // nothing to reconstruct
@@ -422,29 +441,38 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     maxy = std::min(height - 1, maxy + blurBorder);
     const int blurWidth = maxx - minx + 1;
     const int blurHeight = maxy - miny + 1;
-    const int bufferWidth = blurWidth + ((16 - (blurWidth % 16)) & 15);
 
-    multi_array2D<float, 3> channelblur(bufferWidth, blurHeight, 0, 48);
-    array2D<float> temp(bufferWidth, blurHeight); // allocate temporary buffer
+    multi_array2D<float, 3> channelblur(blurWidth, blurHeight, 0, 48);
 
     // blur RGB channels
+    const auto blurChannel =
+        [minx, miny, blurWidth, blurHeight](float** channel, float** blurred)
+        {
+            std::vector<float*> rows(blurHeight);
+
+            for (int i = 0; i < blurHeight; ++i) {
+                rows[i] = channel[i + miny] + minx;
+            }
+
+            boxblur(rows.data(), blurred, 4, blurWidth, blurHeight, true);
+        };
 
-    boxblur2(red, channelblur[0], temp, miny, minx, blurHeight, blurWidth, bufferWidth, 4);
+    blurChannel(red, channelblur[0]);
 
     if (plistener) {
         progress += 0.07;
         plistener->setProgress(progress);
     }
 
-    boxblur2(green, channelblur[1], temp, miny, minx, blurHeight, blurWidth, bufferWidth, 4);
+    blurChannel(green, channelblur[1]);
 
     if (plistener) {
         progress += 0.07;
         plistener->setProgress(progress);
     }
 
-    boxblur2(blue, channelblur[2], temp, miny, minx, blurHeight, blurWidth, bufferWidth, 4);
- 
+    blurChannel(blue, channelblur[2]);
+
     if (plistener) {
         progress += 0.07;
         plistener->setProgress(progress);
@@ -469,7 +497,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         plistener->setProgress(progress);
     }
 
-    multi_array2D<float, 4> hilite_full(bufferWidth, blurHeight, ARRAY2D_CLEAR_DATA, 32);
+    multi_array2D<float, 4> hilite_full(blurWidth, blurHeight, ARRAY2D_CLEAR_DATA, 32);
 
     if (plistener) {
         progress += 0.05;
@@ -514,12 +542,10 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         plistener->setProgress(progress);
     }
 
-    array2D<float> hilite_full4(bufferWidth, blurHeight);
+    array2D<float> hilite_full4(blurWidth, blurHeight);
     //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
     //blur highlight data
-    boxblur2(hilite_full[3], hilite_full4, temp, 0, 0, blurHeight, blurWidth, bufferWidth, 1);
-
-    temp.free(); // free temporary buffer
+    boxblur(static_cast<float**>(hilite_full[3]), static_cast<float**>(hilite_full4), 1, blurWidth, blurHeight, true);
 
     if (plistener) {
         progress += 0.07;
@@ -576,247 +602,116 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     // for faster processing we create two buffers using (height,width) instead of (width,height)
     multi_array2D<float, 4> hilite_dir0(hfh, hfw, ARRAY2D_CLEAR_DATA, 64);
     multi_array2D<float, 4> hilite_dir4(hfh, hfw, ARRAY2D_CLEAR_DATA, 64);
+    // and a transposed copy of the highlight map for them
+    multi_array2D<float, 4> hiliteT(hfh, hfw, 0, 64);
 
-    if (plistener) {
-        progress += 0.05;
-        plistener->setProgress(progress);
-    }
-
-    //fill gaps in highlight map by directional extension
-    //raster scan from four corners
-    for (int j = 1; j < hfw - 1; ++j) {
-        for (int i = 2; i < hfh - 2; ++i) {
-            //from left
-            if (hilite[3][i][j] > epsilon) {
-                hilite_dir0[3][j][i] = 1.f;
-            } else {
-                hilite_dir0[3][j][i] = (hilite_dir0[0 + 3][j - 1][i - 2] + hilite_dir0[0 + 3][j - 1][i - 1] + hilite_dir0[0 + 3][j - 1][i] + hilite_dir0[0 + 3][j - 1][i + 1] + hilite_dir0[0 + 3][j - 1][i + 2]) == 0.f ? 0.f : 0.1f;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int j = 0; j < hfw; ++j) {
+        for (int c = 0; c < 4; ++c) {
+            for (int i = 0; i < hfh; ++i) {
+                hiliteT[c][j][i] = hilite[c][i][j];
             }
         }
-
-        if (hilite[3][2][j] <= epsilon) {
-            hilite_dir[0 + 3][0][j]  = hilite_dir0[3][j][2];
-        }
-
-        if (hilite[3][3][j] <= epsilon) {
-            hilite_dir[0 + 3][1][j]  = hilite_dir0[3][j][3];
-        }
-
-        if (hilite[3][hfh - 3][j] <= epsilon) {
-            hilite_dir[4 + 3][hfh - 1][j] = hilite_dir0[3][j][hfh - 3];
-        }
-
-        if (hilite[3][hfh - 4][j] <= epsilon) {
-            hilite_dir[4 + 3][hfh - 2][j] = hilite_dir0[3][j][hfh - 4];
-        }
     }
 
-    for (int i = 2; i < hfh - 2; ++i) {
-        if (hilite[3][i][hfw - 2] <= epsilon) {
-            hilite_dir4[3][hfw - 1][i] = hilite_dir0[3][hfw - 2][i];
-        }
+    if (plistener) {
+        progress += 0.05;
+        plistener->setProgress(progress);
     }
 
-#ifdef _OPENMP
-    #pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-        #pragma omp for nowait
-#endif
-        for (int c = 0; c < 3; ++c) {
-            for (int j = 1; j < hfw - 1; ++j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from left
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir0[c][j][i] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir0[c][j][i] = 0.1f * ((hilite_dir0[0 + c][j - 1][i - 2] + hilite_dir0[0 + c][j - 1][i - 1] + hilite_dir0[0 + c][j - 1][i] + hilite_dir0[0 + c][j - 1][i + 1] + hilite_dir0[0 + c][j - 1][i + 2]) /
-                                                       (hilite_dir0[0 + 3][j - 1][i - 2] + hilite_dir0[0 + 3][j - 1][i - 1] + hilite_dir0[0 + 3][j - 1][i] + hilite_dir0[0 + 3][j - 1][i + 1] + hilite_dir0[0 + 3][j - 1][i + 2] + epsilon));
-                    }
-                }
-
-                if (hilite[3][2][j] <= epsilon) {
-                    hilite_dir[0 + c][0][j]  = hilite_dir0[c][j][2];
-                }
-
-                if (hilite[3][3][j] <= epsilon) {
-                    hilite_dir[0 + c][1][j]  = hilite_dir0[c][j][3];
-                }
+    //fill gaps in highlight map by directional extension
+    //raster scan from four corners, each scan seeds the borders of the following ones
+    float** const hiliteRows[4] = {hilite[0], hilite[1], hilite[2], hilite[3]};
+    float** const hiliteCols[4] = {hiliteT[0], hiliteT[1], hiliteT[2], hiliteT[3]};
+    float** const fromLeft[4] = {hilite_dir0[0], hilite_dir0[1], hilite_dir0[2], hilite_dir0[3]};
+    float** const fromRight[4] = {hilite_dir4[0], hilite_dir4[1], hilite_dir4[2], hilite_dir4[3]};
+    float** const fromTop[4] = {hilite_dir[0], hilite_dir[1], hilite_dir[2], hilite_dir[3]};
+    float** const fromBottom[4] = {hilite_dir[4], hilite_dir[5], hilite_dir[6], hilite_dir[7]};
 
-                if (hilite[3][hfh - 3][j] <= epsilon) {
-                    hilite_dir[4 + c][hfh - 1][j] = hilite_dir0[c][j][hfh - 3];
-                }
+    //from left
+    extendHighlights(hiliteCols, fromLeft, 1, hfw - 1, 1, hfh);
 
-                if (hilite[3][hfh - 4][j] <= epsilon) {
-                    hilite_dir[4 + c][hfh - 2][j] = hilite_dir0[c][j][hfh - 4];
-                }
+    for (int c = 0; c < 4; ++c) {
+        for (int j = 1; j < hfw - 1; ++j) {
+            if (hilite[3][2][j] <= epsilon) {
+                hilite_dir[0 + c][0][j]  = hilite_dir0[c][j][2];
             }
 
-            for (int i = 2; i < hfh - 2; ++i) {
-                if (hilite[3][i][hfw - 2] <= epsilon) {
-                    hilite_dir4[c][hfw - 1][i] = hilite_dir0[c][hfw - 2][i];
-                }
+            if (hilite[3][3][j] <= epsilon) {
+                hilite_dir[0 + c][1][j]  = hilite_dir0[c][j][3];
             }
-        }
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[3][j][i] = 1.f;
-                    } else {
-                        hilite_dir4[3][j][i] = (hilite_dir4[3][(j + 1)][(i - 2)] + hilite_dir4[3][(j + 1)][(i - 1)] + hilite_dir4[3][(j + 1)][(i)] + hilite_dir4[3][(j + 1)][(i + 1)] + hilite_dir4[3][(j + 1)][(i + 2)]) == 0.f ? 0.f : 0.1f;
-                    }
-                }
 
-                if (hilite[3][2][j] <= epsilon) {
-                    hilite_dir[0 + 3][0][j] += hilite_dir4[3][j][2];
-                }
-
-                if (hilite[3][hfh - 3][j] <= epsilon) {
-                    hilite_dir[4 + 3][hfh - 1][j] += hilite_dir4[3][j][hfh - 3];
-                }
+            if (hilite[3][hfh - 3][j] <= epsilon) {
+                hilite_dir[4 + c][hfh - 1][j] = hilite_dir0[c][j][hfh - 3];
             }
 
-            for (int i = 2; i < hfh - 2; ++i) {
-                if (hilite[3][i][0] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][0] += hilite_dir4[3][0][i];
-                    hilite_dir[4 + 3][i + 2][0] += hilite_dir4[3][0][i];
-                }
-
-                if (hilite[3][i][1] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][1] += hilite_dir4[3][1][i];
-                    hilite_dir[4 + 3][i + 2][1] += hilite_dir4[3][1][i];
-                }
+            if (hilite[3][hfh - 4][j] <= epsilon) {
+                hilite_dir[4 + c][hfh - 2][j] = hilite_dir0[c][j][hfh - 4];
+            }
+        }
 
-                if (hilite[3][i][hfw - 2] <= epsilon) {
-                    hilite_dir[0 + 3][i - 2][hfw - 2] += hilite_dir4[3][hfw - 2][i];
-                    hilite_dir[4 + 3][i + 2][hfw - 2] += hilite_dir4[3][hfw - 2][i];
-                }
+        for (int i = 2; i < hfh - 2; ++i) {
+            if (hilite[3][i][hfw - 2] <= epsilon) {
+                hilite_dir4[c][hfw - 1][i] = hilite_dir0[c][hfw - 2][i];
             }
         }
     }
+
     if (plistener) {
         progress += 0.05;
         plistener->setProgress(progress);
     }
 
-#ifdef _OPENMP
-    #pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-        #pragma omp for nowait
-#endif
-        for (int c = 0; c < 3; ++c) {
-            for (int j = hfw - 2; j > 0; --j) {
-                for (int i = 2; i < hfh - 2; ++i) {
-                    //from right
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir4[c][j][i] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir4[c][j][i] = 0.1f * ((hilite_dir4[c][(j + 1)][(i - 2)] + hilite_dir4[c][(j + 1)][(i - 1)] + hilite_dir4[c][(j + 1)][(i)] + hilite_dir4[c][(j + 1)][(i + 1)] + hilite_dir4[c][(j + 1)][(i + 2)]) /
-                                                      (hilite_dir4[3][(j + 1)][(i - 2)] + hilite_dir4[3][(j + 1)][(i - 1)] + hilite_dir4[3][(j + 1)][(i)] + hilite_dir4[3][(j + 1)][(i + 1)] + hilite_dir4[3][(j + 1)][(i + 2)] + epsilon));
-                    }
-                }
+    //from right
+    extendHighlights(hiliteCols, fromRight, hfw - 2, 0, -1, hfh);
 
-                if (hilite[3][2][j] <= epsilon) {
-                    hilite_dir[0 + c][0][j] += hilite_dir4[c][j][2];
-                }
+    for (int c = 0; c < 4; ++c) {
+        hiliteT[c].free();    //free up some memory
+    }
 
-                if (hilite[3][hfh - 3][j] <= epsilon) {
-                    hilite_dir[4 + c][hfh - 1][j] += hilite_dir4[c][j][hfh - 3];
-                }
+    for (int c = 0; c < 4; ++c) {
+        for (int j = 1; j < hfw - 1; ++j) {
+            if (hilite[3][2][j] <= epsilon) {
+                hilite_dir[0 + c][0][j] += hilite_dir4[c][j][2];
             }
 
-            for (int i = 2; i < hfh - 2; ++i) {
-                if (hilite[3][i][0] <= epsilon) {
-                    hilite_dir[0 + c][i - 2][0] += hilite_dir4[c][0][i];
-                    hilite_dir[4 + c][i + 2][0] += hilite_dir4[c][0][i];
-                }
-
-                if (hilite[3][i][1] <= epsilon) {
-                    hilite_dir[0 + c][i - 2][1] += hilite_dir4[c][1][i];
-                    hilite_dir[4 + c][i + 2][1] += hilite_dir4[c][1][i];
-                }
-
-                if (hilite[3][i][hfw - 2] <= epsilon) {
-                    hilite_dir[0 + c][i - 2][hfw - 2] += hilite_dir4[c][hfw - 2][i];
-                    hilite_dir[4 + c][i + 2][hfw - 2] += hilite_dir4[c][hfw - 2][i];
-                }
+            if (hilite[3][hfh - 3][j] <= epsilon) {
+                hilite_dir[4 + c][hfh - 1][j] += hilite_dir4[c][j][hfh - 3];
             }
         }
 
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            for (int i = 1; i < hfh - 1; ++i)
-                for (int j = 2; j < hfw - 2; ++j) {
-                    //from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + 3][i][j] = 1.f;
-                    } else {
-                        hilite_dir[0 + 3][i][j] = (hilite_dir[0 + 3][i - 1][j - 2] + hilite_dir[0 + 3][i - 1][j - 1] + hilite_dir[0 + 3][i - 1][j] + hilite_dir[0 + 3][i - 1][j + 1] + hilite_dir[0 + 3][i - 1][j + 2]) == 0.f ? 0.f : 0.1f;
-                    }
-                }
+        for (int i = 2; i < hfh - 2; ++i) {
+            if (hilite[3][i][0] <= epsilon) {
+                hilite_dir[0 + c][i - 2][0] += hilite_dir4[c][0][i];
+                hilite_dir[4 + c][i + 2][0] += hilite_dir4[c][0][i];
+            }
 
-            for (int j = 2; j < hfw - 2; ++j) {
-                if (hilite[3][hfh - 2][j] <= epsilon) {
-                    hilite_dir[4 + 3][hfh - 1][j] += hilite_dir[0 + 3][hfh - 2][j];
-                }
+            if (hilite[3][i][1] <= epsilon) {
+                hilite_dir[0 + c][i - 2][1] += hilite_dir4[c][1][i];
+                hilite_dir[4 + c][i + 2][1] += hilite_dir4[c][1][i];
+            }
+
+            if (hilite[3][i][hfw - 2] <= epsilon) {
+                hilite_dir[0 + c][i - 2][hfw - 2] += hilite_dir4[c][hfw - 2][i];
+                hilite_dir[4 + c][i + 2][hfw - 2] += hilite_dir4[c][hfw - 2][i];
             }
         }
     }
+
     if (plistener) {
         progress += 0.05;
         plistener->setProgress(progress);
     }
 
-#ifdef _OPENMP
-    #pragma omp parallel
-#endif
-    {
-#ifdef _OPENMP
-        #pragma omp for nowait
-#endif
-        for (int c = 0; c < 3; ++c) {
-            for (int i = 1; i < hfh - 1; ++i) {
-                for (int j = 2; j < hfw - 2; ++j) {
-                    //from top
-                    if (hilite[3][i][j] > epsilon) {
-                        hilite_dir[0 + c][i][j] = hilite[c][i][j] / hilite[3][i][j];
-                    } else {
-                        hilite_dir[0 + c][i][j] = 0.1f * ((hilite_dir[0 + c][i - 1][j - 2] + hilite_dir[0 + c][i - 1][j - 1] + hilite_dir[0 + c][i - 1][j] + hilite_dir[0 + c][i - 1][j + 1] + hilite_dir[0 + c][i - 1][j + 2]) /
-                                                         (hilite_dir[0 + 3][i - 1][j - 2] + hilite_dir[0 + 3][i - 1][j - 1] + hilite_dir[0 + 3][i - 1][j] + hilite_dir[0 + 3][i - 1][j + 1] + hilite_dir[0 + 3][i - 1][j + 2] + epsilon));
-                    }
-                }
-            }
-
-            for (int j = 2; j < hfw - 2; ++j) {
-                if (hilite[3][hfh - 2][j] <= epsilon) {
-                    hilite_dir[4 + c][hfh - 1][j] += hilite_dir[0 + c][hfh - 2][j];
-                }
-            }
-        }
+    //from top
+    extendHighlights(hiliteRows, fromTop, 1, hfh - 1, 1, hfw);
 
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        for (int i = hfh - 2; i > 0; --i) {
-            for (int j = 2; j < hfw - 2; ++j) {
-                //from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + 3][i][j] = 1.f;
-                } else {
-                    hilite_dir[4 + 3][i][j] = (hilite_dir[4 + 3][(i + 1)][(j - 2)] + hilite_dir[4 + 3][(i + 1)][(j - 1)] + hilite_dir[4 + 3][(i + 1)][(j)] + hilite_dir[4 + 3][(i + 1)][(j + 1)] + hilite_dir[4 + 3][(i + 1)][(j + 2)]) == 0.f ? 0.f : 0.1f;
-                }
+    for (int c = 0; c < 4; ++c) {
+        for (int j = 2; j < hfw - 2; ++j) {
+            if (hilite[3][hfh - 2][j] <= epsilon) {
+                hilite_dir[4 + c][hfh - 1][j] += hilite_dir[0 + c][hfh - 2][j];
             }
         }
     }
@@ -826,22 +721,8 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         plistener->setProgress(progress);
     }
 
-#ifdef _OPENMP
-    #pragma omp parallel for
-#endif
-    for (int c = 0; c < 4; ++c) {
-        for (int i = hfh - 2; i > 0; --i) {
-            for (int j = 2; j < hfw - 2; ++j) {
-                //from bottom
-                if (hilite[3][i][j] > epsilon) {
-                    hilite_dir[4 + c][i][j] = hilite[c][i][j] / hilite[3][i][j];
-                } else {
-                    hilite_dir[4 + c][i][j] = 0.1f * ((hilite_dir[4 + c][(i + 1)][(j - 2)] + hilite_dir[4 + c][(i + 1)][(j - 1)] + hilite_dir[4 + c][(i + 1)][(j)] + hilite_dir[4 + c][(i + 1)][(j + 1)] + hilite_dir[4 + c][(i + 1)][(j + 2)]) /
-                                                     (hilite_dir[4 + 3][(i + 1)][(j - 2)] + hilite_dir[4 + 3][(i + 1)][(j - 1)] + hilite_dir[4 + 3][(i + 1)][(j)] + hilite_dir[4 + 3][(i + 1)][(j + 1)] + hilite_dir[4 + 3][(i + 1)][(j + 2)] + epsilon));
-                }
-            }
-        }
-    }
+    //from bottom
+    extendHighlights(hiliteRows, fromBottom, hfh - 2, 0, -1, hfw);
 
     if (plistener) {
         progress += 0.05;
@@ -933,7 +814,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     for (int i = 0; i < blurHeight; ++i) {
         const int i1 = min((i - i % pitch) / pitch, hfh - 1);
 
-        for (int j = 0; j < blurWidth; ++j) {
+        for (int j = clipStart[i + miny] - minx; j < clipEnd[i + miny] - minx; ++j) {
             const float pixel[3] = {
                 red[i + miny][j + minx],
                 green[i + miny][j + minx],
@@ -17,6 +17,8 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cstring>
+#include <set>
+#include <tuple>
 
 #include <glibmm/ustring.h>
 #include <glibmm/fileutils.h>
@@ -34,6 +36,7 @@
 #include "iccstore.h"
 
 #include "iccmatrices.h"
+#include "rtengine.h"
 #include "utils.h"
 
 #include "../rtgui/options.h"
@@ -109,6 +112,93 @@ void loadProfiles(
     }
 }
 
+struct ProfileFile {
+    Glib::ustring path;
+    cmsProfileClassSignature deviceClass;
+    cmsColorSpaceSignature colorSpace;
+};
+
+// Reads the device class and color space from the header of an ICC file, returns false if it isn't one
+bool readProfileHeader(const Glib::ustring& filePath, cmsProfileClassSignature& deviceClass, cmsColorSpaceSignature& colorSpace)
+{
+    FILE* const f = g_fopen(filePath.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    std::uint32_t header[10];
+    const bool complete = fread(header, sizeof(header), 1, f) == 1;
+    fclose(f);
+
+    if (!complete || ntohl(header[9]) != cmsMagicNumber) {
+        return false;
+    }
+
+    deviceClass = static_cast<cmsProfileClassSignature>(ntohl(header[3]));
+    colorSpace = static_cast<cmsColorSpaceSignature>(ntohl(header[4]));
+    return true;
+}
+
+// Not recursive, like loadProfiles() but only reads the file headers
+void indexProfiles(const Glib::ustring& dirName, std::map<Glib::ustring, ProfileFile>& index)
+{
+    if (dirName.empty()) {
+        return;
+    }
+
+    try {
+        Glib::Dir dir(dirName);
+
+        for (Glib::DirIterator entry = dir.begin(); entry != dir.end(); ++entry) {
+            const Glib::ustring fileName = *entry;
+
+            if (fileName.size() < 4) {
+                continue;
+            }
+
+            const Glib::ustring extension = rtengine::getFileExtension(fileName);
+
+            if (extension != "icc" && extension != "icm") {
+                continue;
+            }
+
+            const Glib::ustring filePath = Glib::build_filename(dirName, fileName);
+
+            if (!Glib::file_test(filePath, Glib::FILE_TEST_IS_REGULAR)) {
+                continue;
+            }
+
+            ProfileFile file;
+
+            if (readProfileHeader(filePath, file.deviceClass, file.colorSpace)) {
+                file.path = filePath;
+                index.emplace(fileName.substr(0, fileName.size() - 4), file);
+            }
+        }
+    } catch (Glib::Exception&) {
+    }
+}
+
+bool isProfileOfType(rtengine::ICCStore::ProfileType type, cmsProfileClassSignature deviceClass, cmsColorSpaceSignature colorSpace)
+{
+    switch (type) {
+        case rtengine::ICCStore::ProfileType::MONITOR: {
+            return deviceClass == cmsSigDisplayClass && colorSpace == cmsSigRgbData;
+        }
+
+        case rtengine::ICCStore::ProfileType::PRINTER: {
+            return deviceClass == cmsSigOutputClass;
+        }
+
+        case rtengine::ICCStore::ProfileType::OUTPUT: {
+            return (deviceClass == cmsSigDisplayClass || deviceClass == cmsSigInputClass || deviceClass == cmsSigOutputClass) && colorSpace == cmsSigRgbData;
+        }
+    }
+
+    return false;
+}
+
 // Version dedicated to single profile load when loadAll==false (cli version "-q" mode)
 bool loadProfile(
     const Glib::ustring& profile,
@@ -395,7 +485,8 @@ public:
     Implementation() :
         loadAll(true),
         xyz(createXYZProfile()),
-        srgb(cmsCreate_sRGBProfile())
+        srgb(cmsCreate_sRGBProfile()),
+        lab(cmsCreateLab4Profile(nullptr))
     {
         //cmsErrorAction(LCMS_ERROR_SHOW);
 
@@ -428,6 +519,12 @@ public:
             }
         }
 
+        for (auto &t : transforms) {
+            if (t.second) {
+                cmsDeleteTransform(t.second);
+            }
+        }
+
         if (srgb) {
             cmsCloseProfile(srgb);
         }
@@ -435,6 +532,10 @@ public:
         if (xyz) {
             cmsCloseProfile(xyz);
         }
+
+        if (lab) {
+            cmsCloseProfile(lab);
+        }
     }
 
     void init(const Glib::ustring& usrICCDir, const Glib::ustring& rtICCDir, bool loadAll)
@@ -450,10 +551,12 @@ public:
         userICCDir = usrICCDir;
         fileProfiles.clear();
         fileProfileContents.clear();
+        fileProfileIndex.clear();
 
         if (loadAll) {
-            loadProfiles(profilesDir, &fileProfiles, &fileProfileContents, nullptr, false);
-            loadProfiles(userICCDir, &fileProfiles, &fileProfileContents, nullptr, false);
+            // only the headers are read here, the profiles are opened on first use
+            indexProfiles(profilesDir, fileProfileIndex);
+            indexProfiles(userICCDir, fileProfileIndex);
         }
 
         // Input profiles
@@ -523,7 +626,7 @@ public:
     bool outputProfileExist(const Glib::ustring& name) const
     {
         MyMutex::MyLock lock(mutex);
-        return fileProfiles.find(name) != fileProfiles.end();
+        return fileProfiles.find(name) != fileProfiles.end() || fileProfileIndex.find(name) != fileProfileIndex.end();
     }
 
     cmsHPROFILE getProfile(const Glib::ustring& name)
@@ -536,6 +639,23 @@ public:
             return r->second;
         }
 
+        const IndexMap::iterator indexed = fileProfileIndex.find(name);
+
+        if (indexed != fileProfileIndex.end()) {
+            const ProfileContent content(indexed->second.path);
+            const cmsHPROFILE profile = content.toProfile();
+
+            if (profile) {
+                fileProfiles.emplace(name, profile);
+                fileProfileContents.emplace(name, content);
+            } else {
+                // not listed anymore, like profiles failing to load used to be
+                fileProfileIndex.erase(indexed);
+            }
+
+            return profile;
+        }
+
         if (!name.compare(0, 5, "file:")) {
             const ProfileContent content(name.substr(5));
             const cmsHPROFILE profile = content.toProfile();
@@ -607,8 +727,11 @@ public:
         return profile;
     }
 
-    ProfileContent getContent(const Glib::ustring& name) const
+    ProfileContent getContent(const Glib::ustring& name)
     {
+        // loads the profile if only indexed so far
+        getProfile(name);
+
         MyMutex::MyLock lock(mutex);
 
         const ContentMap::const_iterator r = fileProfileContents.find(name);
@@ -631,45 +754,34 @@ public:
 
     std::vector<Glib::ustring> getProfiles(ProfileType type) const
     {
-        std::vector<Glib::ustring> res;
+        std::set<Glib::ustring> res;
 
         MyMutex::MyLock lock(mutex);
 
         for (const auto& profile : fileProfiles) {
-            if (
-                (
-                    type == ICCStore::ProfileType::MONITOR
-                    && cmsGetDeviceClass(profile.second) == cmsSigDisplayClass
-                    && cmsGetColorSpace(profile.second) == cmsSigRgbData
-                )
-                || (
-                    type == ICCStore::ProfileType::PRINTER
-                    && cmsGetDeviceClass(profile.second) == cmsSigOutputClass
-                )
-                || (
-                    type == ICCStore::ProfileType::OUTPUT
-                    && (cmsGetDeviceClass(profile.second) == cmsSigDisplayClass
-                        || cmsGetDeviceClass(profile.second) == cmsSigInputClass
-                        || cmsGetDeviceClass(profile.second) == cmsSigOutputClass)
-                    && cmsGetColorSpace(profile.second) == cmsSigRgbData
-                )
-            ) {
-                res.push_back(profile.first);
+            if (isProfileOfType(type, cmsGetDeviceClass(profile.second), cmsGetColorSpace(profile.second))) {
+                res.insert(profile.first);
             }
         }
 
-        return res;
+        for (const auto& profile : fileProfileIndex) {
+            if (isProfileOfType(type, profile.second.deviceClass, profile.second.colorSpace)) {
+                res.insert(profile.first);
+            }
+        }
+
+        return std::vector<Glib::ustring>(res.begin(), res.end());
     }
 
     std::vector<Glib::ustring> getProfilesFromDir(const Glib::ustring& dirName) const
     {
         std::vector<Glib::ustring> res;
-        ProfileMap profiles;
+        IndexMap profiles;
 
         MyMutex::MyLock lock(mutex);
 
-        loadProfiles(profilesDir, &profiles, nullptr, nullptr, false);
-        loadProfiles(dirName, &profiles, nullptr, nullptr, false);
+        indexProfiles(profilesDir, profiles);
+        indexProfiles(dirName, profiles);
 
         for (const auto& profile : profiles) {
             res.push_back(profile.first);
@@ -678,6 +790,30 @@ public:
         return res;
     }
 
+    cmsHTRANSFORM getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags)
+    {
+        input = input ? input : lab;
+        output = output ? output : lab;
+
+        const TransformKey key(input, inputFormat, output, outputFormat, intent, flags);
+
+        MyMutex::MyLock lock(mutex);
+
+        const TransformMap::const_iterator t = transforms.find(key);
+
+        if (t != transforms.end()) {
+            return t->second;
+        }
+
+        lcmsMutex->lock();
+        const cmsHTRANSFORM transform = cmsCreateTransform(input, inputFormat, output, outputFormat, intent, flags);
+        lcmsMutex->unlock();
+
+        // failures are remembered too, they would fail again
+        transforms.emplace(key, transform);
+        return transform;
+    }
+
     std::uint8_t getInputIntents(cmsHPROFILE profile)
     {
         MyMutex::MyLock lock(mutex);
@@ -997,6 +1133,9 @@ parse_error:
     using MatrixMap = std::map<Glib::ustring, TMatrix>;
     using ContentMap = std::map<Glib::ustring, ProfileContent>;
     using NameMap = std::map<Glib::ustring, Glib::ustring>;
+    using IndexMap = std::map<Glib::ustring, ProfileFile>;
+    using TransformKey = std::tuple<cmsHPROFILE, cmsUInt32Number, cmsHPROFILE, cmsUInt32Number, cmsUInt32Number, cmsUInt32Number>;
+    using TransformMap = std::map<TransformKey, cmsHTRANSFORM>;
 
     ProfileMap wProfiles;
     // ProfileMap wProfilesGamma;
@@ -1010,6 +1149,8 @@ parse_error:
     Glib::ustring userICCDir;
     ProfileMap fileProfiles;
     ContentMap fileProfileContents;
+    // profiles of the directories not opened yet
+    IndexMap fileProfileIndex;
 
     //These contain standard profiles from RT. Keys are all in uppercase.
     Glib::ustring stdProfilesDir;
@@ -1022,6 +1163,9 @@ parse_error:
 
     const cmsHPROFILE xyz;
     const cmsHPROFILE srgb;
+    const cmsHPROFILE lab;
+
+    TransformMap transforms;
 
     mutable MyMutex mutex;
 };
@@ -1109,6 +1253,11 @@ std::vector<Glib::ustring> rtengine::ICCStore::getProfilesFromDir(const Glib::us
     return implementation->getProfilesFromDir(dirName);
 }
 
+cmsHTRANSFORM rtengine::ICCStore::getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags) const
+{
+    return implementation->getTransform(input, inputFormat, output, outputFormat, intent, flags);
+}
+
 std::uint8_t rtengine::ICCStore::getInputIntents(cmsHPROFILE profile) const
 {
     return implementation->getInputIntents(profile);
@@ -86,6 +86,13 @@ public:
     std::vector<Glib::ustring> getProfiles(ProfileType type = ProfileType::MONITOR) const;
     std::vector<Glib::ustring> getProfilesFromDir(const Glib::ustring& dirName) const;
 
+    /**
+     * Returns the transform between two profiles, created on first use and shared by all callers.
+     * The profiles must be owned by the store (working spaces, getProfile(), getStdProfile(), XYZ, sRGB),
+     * nullptr stands for Lab D50. The transform must not be deleted, use cmsFLAGS_NOCACHE for concurrent use.
+     */
+    cmsHTRANSFORM    getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags) const;
+
     std::uint8_t     getInputIntents(cmsHPROFILE profile) const;
     std::uint8_t     getOutputIntents(cmsHPROFILE profile) const;
     std::uint8_t     getProofIntents(cmsHPROFILE profile) const;
@@ -597,6 +597,7 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             imgsrc->convertColorSpace(orig_prev, params->icm, currWB);
 
             ipf.firstAnalysis(orig_prev, *params, vhist16);
+            analysisPyramid.update(orig_prev, true);
         }
 
         if ((todo & M_HDR) && (params->fattal.enabled || params->dehaze.enabled)) {
@@ -605,14 +606,18 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
                 fattal_11_dcrop_cache = nullptr;
             }
 
-            ipf.dehaze(orig_prev);
-            ipf.ToneMapFattal02(orig_prev);
+            ipf.dehaze(orig_prev, &analysisPyramid);
+            ipf.ToneMapFattal02(orig_prev, &fattalAttenuationCache);
 
             if (oprevi != orig_prev) {
                 delete oprevi;
             }
         }
 
+        if ((todo & M_HDR) && !params->fattal.enabled) {
+            fattalAttenuationCache.clear();
+        }
+
         oprevi = orig_prev;
 
         // Remove transformation if unneeded
@@ -1363,59 +1368,56 @@ void ImProcCoordinator::updateLRGBHistograms()
     int x1, y1, x2, y2;
     params->crop.mapToResized(pW, pH, scale, x1, x2, y1, y2);
 
+    histChroma.clear();
+    histLuma.clear();
+    histRed.clear();
+    histGreen.clear();
+    histBlue.clear();
+
+    // all histograms are built in one pass over the preview, one set of histograms per thread
 #ifdef _OPENMP
-    #pragma omp parallel sections
+    #pragma omp parallel
 #endif
     {
-#ifdef _OPENMP
-        #pragma omp section
-#endif
-        {
-            histChroma.clear();
+        LUTu histChromaThr(histChroma.getSize());
+        LUTu histLumaThr(histLuma.getSize());
+        LUTu histRedThr(histRed.getSize());
+        LUTu histGreenThr(histGreen.getSize());
+        LUTu histBlueThr(histBlue.getSize());
+        histChromaThr.clear();
+        histLumaThr.clear();
+        histRedThr.clear();
+        histGreenThr.clear();
+        histBlueThr.clear();
 
-            for (int i = y1; i < y2; i++)
-                for (int j = x1; j < x2; j++)
-                {
-                    histChroma[(int)(sqrtf(SQR(nprevl->a[i][j]) + SQR(nprevl->b[i][j])) / 188.f)]++;      //188 = 48000/256
-                }
-        }
 #ifdef _OPENMP
-        #pragma omp section
+        #pragma omp for schedule(dynamic,16) nowait
 #endif
-        {
-            histLuma.clear();
 
-            for (int i = y1; i < y2; i++)
-                for (int j = x1; j < x2; j++)
-                {
-                    histLuma[(int)(nprevl->L[i][j] / 128.f)]++;
-                }
+        for (int i = y1; i < y2; i++) {
+            int ofs = (i * pW + x1) * 3;
+
+            for (int j = x1; j < x2; j++) {
+                histChromaThr[(int)(sqrtf(SQR(nprevl->a[i][j]) + SQR(nprevl->b[i][j])) / 188.f)]++;      //188 = 48000/256
+                histLumaThr[(int)(nprevl->L[i][j] / 128.f)]++;
+
+                histRedThr[workimg->data[ofs++]]++;
+                histGreenThr[workimg->data[ofs++]]++;
+                histBlueThr[workimg->data[ofs++]]++;
+            }
         }
+
 #ifdef _OPENMP
-        #pragma omp section
+        #pragma omp critical
 #endif
         {
-            histRed.clear();
-            histGreen.clear();
-            histBlue.clear();
-
-            for (int i = y1; i < y2; i++)
-            {
-                int ofs = (i * pW + x1) * 3;
-
-                for (int j = x1; j < x2; j++) {
-                    int r = workimg->data[ofs++];
-                    int g = workimg->data[ofs++];
-                    int b = workimg->data[ofs++];
-
-                    histRed[r]++;
-                    histGreen[g]++;
-                    histBlue[b]++;
-                }
-            }
+            histChroma += histChromaThr;
+            histLuma += histLumaThr;
+            histRed += histRedThr;
+            histGreen += histGreenThr;
+            histBlue += histBlueThr;
         }
     }
-
 }
 
 bool ImProcCoordinator::getAutoWB(double& temp, double& green, double equal, double tempBias)
@@ -20,10 +20,12 @@
 
 #include <memory>
 
+#include "analysispyramid.h"
 #include "array2D.h"
 #include "colortemp.h"
 #include "curves.h"
 #include "dcrop.h"
+#include "fattalcache.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "LUT.h"
@@ -65,6 +67,8 @@ protected:
     LabImage *oprevl;
     LabImage *nprevl;
     Imagefloat *fattal_11_dcrop_cache; // global cache for ToneMapFattal02 used in 1:1 detail windows (except when denoise is active)
+    AnalysisPyramid analysisPyramid; // of orig_prev, for the global statistics of the preview and the detail windows
+    FattalAttenuationCache fattalAttenuationCache; // attenuations of the last ToneMapFattal02 runs of the preview and the detail windows
     Image8 *previmg;  // displayed image in monitor color space, showing the output profile as well (soft-proofing enabled, which then correspond to workimg) or not
     Image8 *workimg;  // internal image in output color space for analysis
     CieImage *ncie;
@@ -17,6 +17,10 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
 
 #include <glib.h>
 #include <glibmm/ustring.h>
@@ -31,6 +35,7 @@
 #include "cieimage.h"
 #include "clutstore.h"
 #include "color.h"
+#include "colorlut3d.h"
 #include "colortemp.h"
 #include "curves.h"
 #include "dcp.h"
@@ -50,6 +55,7 @@
 #include "utils.h"
 
 #include "../rtgui/editcallbacks.h"
+#include "../rtgui/threadutils.h"
 
 #ifdef _DEBUG
 #include "mytime.h"
@@ -262,6 +268,368 @@ void fillEditFloat(float *editIFloatTmpR, float *editIFloatTmpG, float *editIFlo
         }
     }
 }
+template<bool useR, bool useG, bool useB>
+void rgbCurvesTile(const LUTf &rCurve, const LUTf &gCurve, const LUTf &bCurve, float *rtemp, float *gtemp, float *btemp, int istart, int tH, int jstart, int tW, int tileSize)
+{
+    for (int i = istart, ti = 0; i < tH; i++, ti++) {
+        int j = jstart, tj = 0;
+#ifdef __SSE2__
+
+        for (; j < tW - 3; j += 4, tj += 4) {
+            if (useR) {
+                const vfloat rv = LVF(rtemp[ti * tileSize + tj]);
+                STVF(rtemp[ti * tileSize + tj], vself(OOG(rv), rv, rCurve[rv]));
+            }
+
+            if (useG) {
+                const vfloat gv = LVF(gtemp[ti * tileSize + tj]);
+                STVF(gtemp[ti * tileSize + tj], vself(OOG(gv), gv, gCurve[gv]));
+            }
+
+            if (useB) {
+                const vfloat bv = LVF(btemp[ti * tileSize + tj]);
+                STVF(btemp[ti * tileSize + tj], vself(OOG(bv), bv, bCurve[bv]));
+            }
+        }
+
+#endif
+
+        for (; j < tW; j++, tj++) {
+            if (useR) {
+                setUnlessOOG(rtemp[ti * tileSize + tj], rCurve[rtemp[ti * tileSize + tj]]);
+            }
+
+            if (useG) {
+                setUnlessOOG(gtemp[ti * tileSize + tj], gCurve[gtemp[ti * tileSize + tj]]);
+            }
+
+            if (useB) {
+                setUnlessOOG(btemp[ti * tileSize + tj], bCurve[btemp[ti * tileSize + tj]]);
+            }
+        }
+    }
+}
+
+using RGBCurvesTileFunc = void (*)(const LUTf&, const LUTf&, const LUTf&, float*, float*, float*, int, int, int, int, int);
+
+RGBCurvesTileFunc getRGBCurvesTile(bool useR, bool useG, bool useB)
+{
+    switch ((useR ? 4 : 0) | (useG ? 2 : 0) | (useB ? 1 : 0)) {
+        case 1:
+            return rgbCurvesTile<false, false, true>;
+
+        case 2:
+            return rgbCurvesTile<false, true, false>;
+
+        case 3:
+            return rgbCurvesTile<false, true, true>;
+
+        case 4:
+            return rgbCurvesTile<true, false, false>;
+
+        case 5:
+            return rgbCurvesTile<true, false, true>;
+
+        case 6:
+            return rgbCurvesTile<true, true, false>;
+
+        case 7:
+            return rgbCurvesTile<true, true, true>;
+
+        default:
+            return rgbCurvesTile<false, false, false>;
+    }
+}
+
+enum class SaturationMode {
+    NONE,
+    INCREASE,
+    DECREASE
+};
+
+// saturation slider and HSV equalizer, the tools are template parameters to keep the disabled ones out of the pixel loop
+template<SaturationMode satMode, bool useH, bool useS, bool useV>
+void hsvTile(float satby100, const FlatCurve *hCurve, const FlatCurve *sCurve, const FlatCurve *vCurve, float *rtemp, float *gtemp, float *btemp, int istart, int tH, int jstart, int tW, int tileSize)
+{
+    for (int i = istart, ti = 0; i < tH; i++, ti++) {
+        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+            float h, s, v;
+            Color::rgb2hsvtc(rtemp[ti * tileSize + tj], gtemp[ti * tileSize + tj], btemp[ti * tileSize + tj], h, s, v);
+            h /= 6.f;
+
+            if (satMode == SaturationMode::INCREASE) {
+                s = std::max(0.f, intp(satby100, 1.f - SQR(SQR(1.f - std::min(s, 1.0f))), s));
+            } else if (satMode == SaturationMode::DECREASE) {
+                s *= 1.f + satby100;
+            }
+
+            //HSV equalizer
+            if (useH) {
+                h = (hCurve->getVal(h) - 0.5) * 2.0 + static_cast<double>(h);
+
+                if (h > 1.0f) {
+                    h -= 1.0f;
+                } else if (h < 0.0f) {
+                    h += 1.0f;
+                }
+            }
+
+            if (useS) {
+                //shift saturation
+                float satparam = (sCurve->getVal (double (h)) - 0.5) * 2;
+
+                if (satparam > 0.00001f) {
+                    s = (1.f - satparam) * s + satparam * (1.f - SQR (1.f - min (s, 1.0f)));
+
+                    if (s < 0.f) {
+                        s = 0.f;
+                    }
+                } else if (satparam < -0.00001f) {
+                    s *= 1.f + satparam;
+                }
+            }
+
+            if (useV) {
+                if (v < 0) {
+                    v = 0;    // important
+                }
+
+                //shift value
+                float valparam = vCurve->getVal(h) - 0.5;
+                valparam *= (1.f - SQR (SQR (1.f - min (s, 1.0f))));
+
+                if (valparam > 0.00001f) {
+                    v = (1.f - valparam) * v + valparam * (1.f - SQR (1.f - min (v, 1.0f))); // SQR (SQR  to increase action and avoid artifacts
+
+                    if (v < 0) {
+                        v = 0;
+                    }
+                } else {
+                    if (valparam < -0.00001f) {
+                        v *= (1.f + valparam);    //1.99 to increase action
+                    }
+                }
+            }
+
+            Color::hsv2rgbdcp(h * 6.f, s, v, rtemp[ti * tileSize + tj], gtemp[ti * tileSize + tj], btemp[ti * tileSize + tj]);
+        }
+    }
+}
+
+using HSVTileFunc = void (*)(float, const FlatCurve*, const FlatCurve*, const FlatCurve*, float*, float*, float*, int, int, int, int, int);
+
+template<SaturationMode satMode>
+HSVTileFunc getHSVTile(bool useH, bool useS, bool useV)
+{
+    switch ((useH ? 4 : 0) | (useS ? 2 : 0) | (useV ? 1 : 0)) {
+        case 1:
+            return hsvTile<satMode, false, false, true>;
+
+        case 2:
+            return hsvTile<satMode, false, true, false>;
+
+        case 3:
+            return hsvTile<satMode, false, true, true>;
+
+        case 4:
+            return hsvTile<satMode, true, false, false>;
+
+        case 5:
+            return hsvTile<satMode, true, false, true>;
+
+        case 6:
+            return hsvTile<satMode, true, true, false>;
+
+        case 7:
+            return hsvTile<satMode, true, true, true>;
+
+        default:
+            return hsvTile<satMode, false, false, false>;
+    }
+}
+
+HSVTileFunc getHSVTile(int sat, bool useH, bool useS, bool useV)
+{
+    if (sat > 0) {
+        return getHSVTile<SaturationMode::INCREASE>(useH, useS, useV);
+    } else if (sat < 0) {
+        return getHSVTile<SaturationMode::DECREASE>(useH, useS, useV);
+    } else {
+        return getHSVTile<SaturationMode::NONE>(useH, useS, useV);
+    }
+}
+
+void channelMixerTile(const float mix[3][3], float *rtemp, float *gtemp, float *btemp, int istart, int tH, int jstart, int tW, int tileSize)
+{
+#ifdef __SSE2__
+    vfloat mixv[3][3];
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            mixv[i][j] = F2V(mix[i][j]);
+        }
+    }
+
+    const vfloat c100v = F2V(100.f);
+#endif
+
+    for (int i = istart, ti = 0; i < tH; i++, ti++) {
+        int j = jstart, tj = 0;
+#ifdef __SSE2__
+
+        for (; j < tW - 3; j += 4, tj += 4) {
+            const vfloat rv = LVF(rtemp[ti * tileSize + tj]);
+            const vfloat gv = LVF(gtemp[ti * tileSize + tj]);
+            const vfloat bv = LVF(btemp[ti * tileSize + tj]);
+            STVF(rtemp[ti * tileSize + tj], (rv * mixv[0][0] + gv * mixv[0][1] + bv * mixv[0][2]) / c100v);
+            STVF(gtemp[ti * tileSize + tj], (rv * mixv[1][0] + gv * mixv[1][1] + bv * mixv[1][2]) / c100v);
+            STVF(btemp[ti * tileSize + tj], (rv * mixv[2][0] + gv * mixv[2][1] + bv * mixv[2][2]) / c100v);
+        }
+
+#endif
+
+        for (; j < tW; j++, tj++) {
+            const float r = rtemp[ti * tileSize + tj];
+            const float g = gtemp[ti * tileSize + tj];
+            const float b = btemp[ti * tileSize + tj];
+            rtemp[ti * tileSize + tj] = (r * mix[0][0] + g * mix[0][1] + b * mix[0][2]) / 100.f;
+            gtemp[ti * tileSize + tj] = (r * mix[1][0] + g * mix[1][1] + b * mix[1][2]) / 100.f;
+            btemp[ti * tileSize + tj] = (r * mix[2][0] + g * mix[2][1] + b * mix[2][2]) / 100.f;
+        }
+    }
+}
+
+// Nodes per axis of the LUT the pixel local tools of rgbProc() are sampled into
+constexpr int rgbChainLUTSize = 65;
+
+// The nodes are spaced evenly in the square root of the value, which puts more of them into
+// the shadows, where the tone curves are steep
+float getRGBChainLUTNodeValue(int index, int size)
+{
+    const float x = static_cast<float>(index) / (size - 1);
+    return MAXVALF * x * x;
+}
+
+void applyRGBChainLUT(const ColorLUT3D &lut, float *r, float *g, float *b, int width)
+{
+    const float scale = (lut.getSize() - 1) / std::sqrt(MAXVALF);
+    int j = 0;
+#ifdef __SSE2__
+    const vfloat scalev = F2V(scale);
+    const vfloat maxvalfv = F2V(MAXVALF);
+    float coords[3][4];
+    float out[4];
+
+    for (; j < width - 3; j += 4) {
+        STVFU(coords[0][0], scalev * vsqrtf(vclampf(LVFU(r[j]), ZEROV, maxvalfv)));
+        STVFU(coords[1][0], scalev * vsqrtf(vclampf(LVFU(g[j]), ZEROV, maxvalfv)));
+        STVFU(coords[2][0], scalev * vsqrtf(vclampf(LVFU(b[j]), ZEROV, maxvalfv)));
+
+        for (int k = 0; k < 4; ++k) {
+            STVFU(out[0], lut.interpolate(coords[0][k], coords[1][k], coords[2][k]));
+            r[j + k] = out[0];
+            g[j + k] = out[1];
+            b[j + k] = out[2];
+        }
+    }
+
+#endif
+
+    for (; j < width; ++j) {
+        lut.interpolate(scale * std::sqrt(LIM(r[j], 0.f, MAXVALF)), scale * std::sqrt(LIM(g[j], 0.f, MAXVALF)), scale * std::sqrt(LIM(b[j], 0.f, MAXVALF)), r[j], g[j], b[j]);
+    }
+}
+
+void hashLUT(std::uint64_t &hash, const LUTf &lut)
+{
+    constexpr std::uint64_t prime = 1099511628211ULL;
+    const int size = lut ? lut.getSize() : 0;
+    hash = (hash ^ size) * prime;
+
+    for (int i = 0; i < size; ++i) {
+        const float value = lut[i];
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * prime;
+    }
+}
+
+// Everything the pixel local tools of rgbProc() depend on. The curves are compared by
+// content, as they also depend on the preview scale.
+struct RGBChainKey {
+    procparams::ToneCurveParams toneCurve;
+    procparams::RGBCurvesParams rgbCurves;
+    procparams::HSVEqualizerParams hsvEqualizer;
+    procparams::ColorToningParams colorToning;
+    procparams::FilmSimulationParams filmSimulation;
+    Glib::ustring workingProfile;
+    int sat;
+    float satLimit;
+    float satLimitOpacity;
+    bool opautili;
+    bool lumaModeGamut;
+    std::uint64_t curvesHash;
+
+    bool operator ==(const RGBChainKey &other) const
+    {
+        return
+            curvesHash == other.curvesHash
+            && sat == other.sat
+            && satLimit == other.satLimit
+            && satLimitOpacity == other.satLimitOpacity
+            && opautili == other.opautili
+            && lumaModeGamut == other.lumaModeGamut
+            && workingProfile == other.workingProfile
+            && toneCurve == other.toneCurve
+            && rgbCurves == other.rgbCurves
+            && hsvEqualizer == other.hsvEqualizer
+            && colorToning == other.colorToning
+            && filmSimulation == other.filmSimulation;
+    }
+};
+
+// Keeps the recently baked LUTs, so a batch of images sharing a profile samples the tools once
+class RGBChainLUTStore final :
+    public NonCopyable
+{
+public:
+    static RGBChainLUTStore& getInstance()
+    {
+        static RGBChainLUTStore instance;
+        return instance;
+    }
+
+    std::shared_ptr<const ColorLUT3D> get(const RGBChainKey &key)
+    {
+        MyMutex::MyLock lock(mutex);
+
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (entry->first == key) {
+                entries.splice(entries.begin(), entries, entry);
+                return entries.front().second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void put(const RGBChainKey &key, const std::shared_ptr<const ColorLUT3D> &lut)
+    {
+        MyMutex::MyLock lock(mutex);
+
+        entries.emplace_front(key, lut);
+
+        if (entries.size() > 4) {
+            entries.pop_back();
+        }
+    }
+
+private:
+    RGBChainLUTStore() = default;
+
+    MyMutex mutex;
+    std::list<std::pair<RGBChainKey, std::shared_ptr<const ColorLUT3D>>> entries;
+};
 // end of helper function for rgbProc()
 
 }
@@ -948,13 +1316,15 @@ void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int pW, int pw
         Ciecam02::initcam1float (yb, pilot, f, la, xw, yw, zw, n, d, nbb, ncb, cz, aw, wh, pfl, fl, c);
         //printf ("wh=%f \n", wh);
 
-        const float pow1 = pow_F ( 1.64f - pow_F ( 0.29f, n ), 0.73f );
         float nj, nbbj, ncbj, czj, awj, flj;
         Ciecam02::initcam2float (yb2, pilotout, f2,  la2,  xw2,  yw2,  zw2, nj, dj, nbbj, ncbj, czj, awj, flj);
 #ifdef __SSE2__
-        const float reccmcz = 1.f / (c2 * czj);
-#endif
+        const Ciecam02::ViewingConditions sourceConditions (xw1, yw1, zw1, c, nc, n, nbb, ncb, fl, cz, d, aw);
+        const Ciecam02::ViewingConditions viewingConditions (xw2, yw2, zw2, c2, nc2, nj, nbbj, ncbj, flj, czj, dj, awj);
+#else
+        const float pow1 = pow_F ( 1.64f - pow_F ( 0.29f, n ), 0.73f );
         const float pow1n = pow_F ( 1.64f - pow_F ( 0.29f, nj ), 0.73f );
+#endif
 
         const float epsil = 0.0001f;
         const float coefQ = 32767.f / wh;
@@ -1030,53 +1400,7 @@ void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int pW, int pw
             for (int i = 0; i < height; i++) {
 #ifdef __SSE2__
                 // vectorized conversion from Lab to jchqms
-                int k;
-                vfloat x, y, z;
-                vfloat J, C, h, Q, M, s;
-
-                vfloat c655d35 = F2V (655.35f);
-
-                for (k = 0; k < width - 3; k += 4) {
-                    Color::Lab2XYZ (LVFU (lab->L[i][k]), LVFU (lab->a[i][k]), LVFU (lab->b[i][k]), x, y, z);
-                    x = x / c655d35;
-                    y = y / c655d35;
-                    z = z / c655d35;
-                    Ciecam02::xyz2jchqms_ciecam02float ( J, C,  h,
-                                                         Q,  M,  s, F2V (aw), F2V (fl), F2V (wh),
-                                                         x,  y,  z,
-                                                         F2V (xw1), F2V (yw1),  F2V (zw1),
-                                                         F2V (c),  F2V (nc), F2V (pow1), F2V (nbb), F2V (ncb), F2V (pfl), F2V (cz), F2V (d));
-                    STVF (Jbuffer[k], J);
-                    STVF (Cbuffer[k], C);
-                    STVF (hbuffer[k], h);
-                    STVF (Qbuffer[k], Q);
-                    STVF (Mbuffer[k], M);
-                    STVF (sbuffer[k], s);
-                }
-
-                for (; k < width; k++) {
-                    float L = lab->L[i][k];
-                    float a = lab->a[i][k];
-                    float b = lab->b[i][k];
-                    float x, y, z;
-                    //convert Lab => XYZ
-                    Color::Lab2XYZ (L, a, b, x, y, z);
-                    x = x / 655.35f;
-                    y = y / 655.35f;
-                    z = z / 655.35f;
-                    float J, C, h, Q, M, s;
-                    Ciecam02::xyz2jchqms_ciecam02float ( J, C,  h,
-                                                         Q,  M,  s, aw, fl, wh,
-                                                         x,  y,  z,
-                                                         xw1, yw1,  zw1,
-                                                         c,  nc, pow1, nbb, ncb, pfl, cz, d);
-                    Jbuffer[k] = J;
-                    Cbuffer[k] = C;
-                    hbuffer[k] = h;
-                    Qbuffer[k] = Q;
-                    Mbuffer[k] = M;
-                    sbuffer[k] = s;
-                }
+                Ciecam02::lab2jchqms_ciecam02float (sourceConditions, width, lab->L[i], lab->a[i], lab->b[i], Jbuffer, Cbuffer, hbuffer, Qbuffer, Mbuffer, sbuffer);
 
 #endif // __SSE2__
 
@@ -1574,15 +1898,7 @@ void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int pW, int pw
                 float *ybuffer = Mbuffer;
                 float *zbuffer = sbuffer;
 
-                for (k = 0; k < bufferLength; k += 4) {
-                    Ciecam02::jch2xyz_ciecam02float ( x, y, z,
-                                                      LVF (Jbuffer[k]), LVF (Cbuffer[k]), LVF (hbuffer[k]),
-                                                      F2V (xw2), F2V (yw2), F2V (zw2),
-                                                      F2V (nc2), F2V (pow1n), F2V (nbbj), F2V (ncbj), F2V (flj), F2V (dj), F2V (awj), F2V (reccmcz));
-                    STVF (xbuffer[k], x * c655d35);
-                    STVF (ybuffer[k], y * c655d35);
-                    STVF (zbuffer[k], z * c655d35);
-                }
+                Ciecam02::jch2xyz_ciecam02float (viewingConditions, width, Jbuffer, Cbuffer, hbuffer, xbuffer, ybuffer, zbuffer);
 
                 // XYZ2Lab uses a lookup table. The function behind that lut is a cube root.
                 // SSE can't beat the speed of that lut, so it doesn't make sense to use SSE
@@ -1908,22 +2224,7 @@ void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int pW, int pw
 
 #ifdef __SSE2__
                     // process line buffers
-                    int k;
-                    vfloat x, y, z;
-                    vfloat c655d35 = F2V (655.35f);
-
-                    for (k = 0; k < bufferLength; k += 4) {
-                        Ciecam02::jch2xyz_ciecam02float ( x, y, z,
-                                                          LVF (Jbuffer[k]), LVF (Cbuffer[k]), LVF (hbuffer[k]),
-                                                          F2V (xw2), F2V (yw2), F2V (zw2),
-                                                          F2V (nc2), F2V (pow1n), F2V (nbbj), F2V (ncbj), F2V (flj), F2V (dj), F2V (awj), F2V (reccmcz));
-                        x *= c655d35;
-                        y *= c655d35;
-                        z *= c655d35;
-                        STVF (xbuffer[k], x);
-                        STVF (ybuffer[k], y);
-                        STVF (zbuffer[k], z);
-                    }
+                    Ciecam02::jch2xyz_ciecam02float (viewingConditions, width, Jbuffer, Cbuffer, hbuffer, xbuffer, ybuffer, zbuffer);
 
                     // XYZ2Lab uses a lookup table. The function behind that lut is a cube root.
                     // SSE can't beat the speed of that lut, so it doesn't make sense to use SSE
@@ -2070,7 +2371,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                                const ColorGradientCurve& ctColorCurve, const OpacityCurve& ctOpacityCurve, bool opautili, const LUTf& clToningcurve, const LUTf& cl2Toningcurve,
                                const ToneCurve& customToneCurve1, const ToneCurve& customToneCurve2, const ToneCurve& customToneCurvebw1, const ToneCurve& customToneCurvebw2,
                                double &rrm, double &ggm, double &bbm, float &autor, float &autog, float &autob, double expcomp, int hlcompr, int hlcomprthresh,
-                               DCPProfile *dcpProf, const DCPProfileApplyState& asIn, LUTu& histToneCurve, size_t chunkSize, bool measure)
+                               DCPProfile *dcpProf, const DCPProfileApplyState& asIn, LUTu& histToneCurve, size_t chunkSize, bool measure, bool bakeLUT)
 {
 
     std::unique_ptr<StopWatch> stop;
@@ -2198,40 +2499,9 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
     }
 
     std::shared_ptr<HaldCLUT> hald_clut;
-    bool clutAndWorkingProfilesAreSame = false;
-    TMatrix xyz2clut = {}, clut2xyz = {};
-#ifdef __SSE2__
-    vfloat v_work2xyz[3][3] ALIGNED16;
-    vfloat v_xyz2clut[3][3] ALIGNED16;
-    vfloat v_clut2xyz[3][3] ALIGNED16;
-    vfloat v_xyz2work[3][3] ALIGNED16;
-#endif
-
-    if ( params->filmSimulation.enabled && !params->filmSimulation.clutFilename.empty() ) {
-        hald_clut = CLUTStore::getInstance().getClut ( params->filmSimulation.clutFilename );
-
-        if ( hald_clut ) {
-            clutAndWorkingProfilesAreSame = hald_clut->getProfile() == params->icm.workingProfile;
-
-            if ( !clutAndWorkingProfilesAreSame ) {
-                xyz2clut = ICCStore::getInstance()->workingSpaceInverseMatrix ( hald_clut->getProfile() );
-                clut2xyz = ICCStore::getInstance()->workingSpaceMatrix ( hald_clut->getProfile() );
-
-#ifdef __SSE2__
 
-                for (int i = 0; i < 3; ++i) {
-                    for (int j = 0; j < 3; ++j) {
-                        v_work2xyz[i][j] = F2V (wprof[i][j]);
-                        v_xyz2clut[i][j] = F2V (xyz2clut[i][j]);
-                        v_xyz2work[i][j] = F2V (wiprof[i][j]);
-                        v_clut2xyz[i][j] = F2V (clut2xyz[i][j]);
-                    }
-                }
-
-#endif
-
-            }
-        }
+    if (params->filmSimulation.enabled && !params->filmSimulation.clutFilename.empty()) {
+        hald_clut = CLUTStore::getInstance().getClut(params->filmSimulation.clutFilename, params->icm.workingProfile);
     }
 
     const float film_simulation_strength = static_cast<float> (params->filmSimulation.strength) / 100.0f;
@@ -2315,15 +2585,11 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
     float Balan = params->colorToning.balance;
 
-    float chMixRR = params->chmixer.red[0] / 10.f;
-    float chMixRG = params->chmixer.red[1] / 10.f;
-    float chMixRB = params->chmixer.red[2] / 10.f;
-    float chMixGR = params->chmixer.green[0] / 10.f;
-    float chMixGG = params->chmixer.green[1] / 10.f;
-    float chMixGB = params->chmixer.green[2] / 10.f;
-    float chMixBR = params->chmixer.blue[0] / 10.f;
-    float chMixBG = params->chmixer.blue[1] / 10.f;
-    float chMixBB = params->chmixer.blue[2] / 10.f;
+    const float chMix[3][3] = {
+        {params->chmixer.red[0] / 10.f, params->chmixer.red[1] / 10.f, params->chmixer.red[2] / 10.f},
+        {params->chmixer.green[0] / 10.f, params->chmixer.green[1] / 10.f, params->chmixer.green[2] / 10.f},
+        {params->chmixer.blue[0] / 10.f, params->chmixer.blue[1] / 10.f, params->chmixer.blue[2] / 10.f}
+    };
 
     bool blackwhite = params->blackwhite.enabled;
     bool complem = params->blackwhite.enabledcc;
@@ -2391,11 +2657,55 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
         histToneCurveCompression = log2 (65536 / toneCurveHistSize);
     }
 
+    // the per pixel tools are specialised for the enabled options once per call
+    const RGBCurvesTileFunc rgbCurvesTileFunc = getRGBCurvesTile(rCurve, gCurve, bCurve);
+    const HSVTileFunc hsvTileFunc = getHSVTile(sat, hCurveEnabled, sCurveEnabled, vCurveEnabled);
+
+    // Optionally the tools from the tone curve up to the film simulation are sampled into a 3D LUT.
+    // They are pixel local, but the pipette, the histogram and the whole image black & white mixer
+    // need the exact chain, and the LUT only covers the clamped range.
+    std::shared_ptr<const ColorLUT3D> bakedRGBChainLUT;
+    std::shared_ptr<ColorLUT3D> newRGBChainLUT;
+    RGBChainKey rgbChainKey;
+
+    if (bakeLUT && editID == EUID_None && toneCurveHistSize == 0 && !blackwhite && params->toneCurve.clampOOG) {
+        rgbChainKey.toneCurve = params->toneCurve;
+        rgbChainKey.rgbCurves = params->rgbCurves;
+        rgbChainKey.hsvEqualizer = params->hsvequalizer;
+        rgbChainKey.colorToning = params->colorToning;
+        rgbChainKey.filmSimulation = params->filmSimulation;
+        rgbChainKey.workingProfile = params->icm.workingProfile;
+        rgbChainKey.sat = sat;
+        rgbChainKey.satLimit = satLimit;
+        rgbChainKey.satLimitOpacity = satLimitOpacity;
+        rgbChainKey.opautili = opautili;
+        rgbChainKey.lumaModeGamut = settings->rgbcurveslumamode_gamut;
+        rgbChainKey.curvesHash = 14695981039346656037ULL;
+        hashLUT(rgbChainKey.curvesHash, tonecurve);
+        hashLUT(rgbChainKey.curvesHash, rCurve);
+        hashLUT(rgbChainKey.curvesHash, gCurve);
+        hashLUT(rgbChainKey.curvesHash, bCurve);
+        hashLUT(rgbChainKey.curvesHash, clToningcurve);
+        hashLUT(rgbChainKey.curvesHash, cl2Toningcurve);
+        hashLUT(rgbChainKey.curvesHash, customToneCurve1.lutToneCurve);
+        hashLUT(rgbChainKey.curvesHash, customToneCurve2.lutToneCurve);
+
+        bakedRGBChainLUT = RGBChainLUTStore::getInstance().get(rgbChainKey);
+
+        // sampling costs about as much as processing rgbChainLUTSize^3 pixels
+        if (!bakedRGBChainLUT && static_cast<double>(working->getWidth()) * working->getHeight() >= 4.0 * rgbChainLUTSize * rgbChainLUTSize * rgbChainLUTSize) {
+            newRGBChainLUT.reset(new ColorLUT3D(rgbChainLUTSize));
+        }
+    }
+
+    const ColorLUT3D* const rgbChainLUT = newRGBChainLUT ? newRGBChainLUT.get() : bakedRGBChainLUT.get();
+
     // For tonecurve histogram
     const float lumimulf[3] = {static_cast<float> (lumimul[0]), static_cast<float> (lumimul[1]), static_cast<float> (lumimul[2])};
 
 
 #define TS 112
+    static_assert(rgbChainLUTSize <= TS, "LUT slices are sampled in one tile");
 
 #ifdef _OPENMP
     #pragma omp parallel if (multiThread)
@@ -2409,10 +2719,6 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
         float *rtemp = buffer.data;
         float *gtemp = &rtemp[perChannelSizeBytes / sizeof(float)];
         float *btemp = &gtemp[perChannelSizeBytes / sizeof(float)];
-        int istart;
-        int jstart;
-        int tW;
-        int tH;
 
         // zero out the buffers
         memset(rtemp, 0, 3 * perChannelSizeBytes);
@@ -2436,7 +2742,6 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
             editWhateverTmp = (float (*))data;
         }
 
-        float out_rgbx[4 * TS] ALIGNED16; // Line buffer for CLUT
         float clutr[TS] ALIGNED16;
         float clutg[TS] ALIGNED16;
         float clutb[TS] ALIGNED16;
@@ -2448,72 +2753,10 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
             histToneCurveThr.clear();
         }
 
-#ifdef _OPENMP
-        #pragma omp for schedule(dynamic, chunkSize) collapse(2)
-#endif
-
-        for (int ii = 0; ii < working->getHeight(); ii += TS)
-            for (int jj = 0; jj < working->getWidth(); jj += TS) {
-                istart = ii;
-                jstart = jj;
-                tH = min (ii + TS, working->getHeight());
-                tW = min (jj + TS, working->getWidth());
-
-
-                for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                    for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                        rtemp[ti * TS + tj] = working->r (i, j);
-                        gtemp[ti * TS + tj] = working->g (i, j);
-                        btemp[ti * TS + tj] = working->b (i, j);
-                    }
-                }
-
-                if (mixchannels) {
-                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            float r = rtemp[ti * TS + tj];
-                            float g = gtemp[ti * TS + tj];
-                            float b = btemp[ti * TS + tj];
-
-                            //if (i==100 & j==100) printf("rgbProc input R= %f  G= %f  B= %f  \n",r,g,b);
-                            float rmix = (r * chMixRR + g * chMixRG + b * chMixRB) / 100.f;
-                            float gmix = (r * chMixGR + g * chMixGG + b * chMixGB) / 100.f;
-                            float bmix = (r * chMixBR + g * chMixBG + b * chMixBB) / 100.f;
-
-                            rtemp[ti * TS + tj] = rmix;
-                            gtemp[ti * TS + tj] = gmix;
-                            btemp[ti * TS + tj] = bmix;
-                        }
-                    }
-                }
-
-                highlightToneCurve(hltonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS, exp_scale, comp, hlrange);
-                if (params->toneCurve.black != 0.0) {
-                    shadowToneCurve(shtonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
-                }
-
-                if (dcpProf) {
-                    dcpProf->step2ApplyTile (rtemp, gtemp, btemp, tW - jstart, tH - istart, TS, asIn);
-                }
-
-                if (params->toneCurve.clampOOG) {
-                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            // clip out of gamut colors, without distorting colour too bad
-                            float r = std::max(rtemp[ti * TS + tj], 0.f);
-                            float g = std::max(gtemp[ti * TS + tj], 0.f);
-                            float b = std::max(btemp[ti * TS + tj], 0.f);
-
-                            if (OOG(r) || OOG(g) || OOG(b)) {
-                                filmlike_clip(&r, &g, &b);
-                            }
-                            rtemp[ti * TS + tj] = r;
-                            gtemp[ti * TS + tj] = g;
-                            btemp[ti * TS + tj] = b;
-                        }
-                    }
-                }
-
+        // the per pixel tools from the tone curve up to the film simulation
+        const auto rgbChain =
+            [&](int istart, int tH, int jstart, int tW) -> void
+            {
                 if (histToneCurveThr) {
                     for (int i = istart, ti = 0; i < tH; i++, ti++) {
                         for (int j = jstart, tj = 0; j < tW; j++, tj++) {
@@ -2592,25 +2835,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
                 if (params->rgbCurves.enabled && (rCurve || gCurve || bCurve)) { // if any of the RGB curves is engaged
                     if (!params->rgbCurves.lumamode) { // normal RGB mode
-
-                        for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                            for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                                // individual R tone curve
-                                if (rCurve) {
-                                    setUnlessOOG(rtemp[ti * TS + tj], rCurve[ rtemp[ti * TS + tj] ]);
-                                }
-
-                                // individual G tone curve
-                                if (gCurve) {
-                                    setUnlessOOG(gtemp[ti * TS + tj], gCurve[ gtemp[ti * TS + tj] ]);
-                                }
-
-                                // individual B tone curve
-                                if (bCurve) {
-                                    setUnlessOOG(btemp[ti * TS + tj], bCurve[ btemp[ti * TS + tj] ]);
-                                }
-                            }
-                        }
+                        rgbCurvesTileFunc(rCurve, gCurve, bCurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
                     } else { //params->rgbCurves.lumamode==true (Luminosity mode)
                         // rCurve.dump("r_curve");//debug
 
@@ -2704,71 +2929,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                 }
 
                 if (sat != 0 || hCurveEnabled || sCurveEnabled || vCurveEnabled) {
-                    const float satby100 = sat / 100.f;
-                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            float h, s, v;
-                            Color::rgb2hsvtc(rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj], h, s, v);
-                            h /= 6.f;
-                            if (sat > 0) {
-                                s = std::max(0.f, intp(satby100, 1.f - SQR(SQR(1.f - std::min(s, 1.0f))), s));
-                            } else { /*if (sat < 0)*/
-                                s *= 1.f + satby100;
-                            }
-
-                            //HSV equalizer
-                            if (hCurveEnabled) {
-                                h = (hCurve->getVal(h) - 0.5) * 2.0 + static_cast<double>(h);
-
-                                if (h > 1.0f) {
-                                    h -= 1.0f;
-                                } else if (h < 0.0f) {
-                                    h += 1.0f;
-                                }
-                            }
-
-                            if (sCurveEnabled) {
-                                //shift saturation
-                                float satparam = (sCurve->getVal (double (h)) - 0.5) * 2;
-
-                                if (satparam > 0.00001f) {
-                                    s = (1.f - satparam) * s + satparam * (1.f - SQR (1.f - min (s, 1.0f)));
-
-                                    if (s < 0.f) {
-                                        s = 0.f;
-                                    }
-                                } else if (satparam < -0.00001f) {
-                                    s *= 1.f + satparam;
-                                }
-
-                            }
-
-                            if (vCurveEnabled) {
-                                if (v < 0) {
-                                    v = 0;    // important
-                                }
-
-                                //shift value
-                                float valparam = vCurve->getVal(h) - 0.5;
-                                valparam *= (1.f - SQR (SQR (1.f - min (s, 1.0f))));
-
-                                if (valparam > 0.00001f) {
-                                    v = (1.f - valparam) * v + valparam * (1.f - SQR (1.f - min (v, 1.0f))); // SQR (SQR  to increase action and avoid artifacts
-
-                                    if (v < 0) {
-                                        v = 0;
-                                    }
-                                } else {
-                                    if (valparam < -0.00001f) {
-                                        v *= (1.f + valparam);    //1.99 to increase action
-                                    }
-                                }
-
-                            }
-
-                            Color::hsv2rgbdcp(h * 6.f, s, v, rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj]);
-                        }
-                    }
+                    hsvTileFunc(sat / 100.f, hCurve, sCurve, vCurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
                 }
 
                 if (isProPhoto) { // this is a hack to avoid the blue=>black bug (Issue 2141)
@@ -3117,119 +3278,103 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
                 // Film Simulations
                 if (hald_clut) {
-
                     for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        if (!clutAndWorkingProfilesAreSame) {
-                            // Convert from working to clut profile
-                            int j = jstart;
-                            int tj = 0;
-
-#ifdef __SSE2__
+                        hald_clut->getRGB(film_simulation_strength, tW - jstart, &rtemp[ti * TS], &gtemp[ti * TS], &btemp[ti * TS], clutr, clutg, clutb);
 
-                            for (; j < tW - 3; j += 4, tj += 4) {
-                                vfloat sourceR = LVF (rtemp[ti * TS + tj]);
-                                vfloat sourceG = LVF (gtemp[ti * TS + tj]);
-                                vfloat sourceB = LVF (btemp[ti * TS + tj]);
-
-                                vfloat x;
-                                vfloat y;
-                                vfloat z;
-                                Color::rgbxyz (sourceR, sourceG, sourceB, x, y, z, v_work2xyz);
-                                Color::xyz2rgb (x, y, z, sourceR, sourceG, sourceB, v_xyz2clut);
+                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+                            setUnlessOOG(rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj], clutr[tj], clutg[tj], clutb[tj]);
+                        }
+                    }
+                }
+            };
 
-                                STVF (clutr[tj], sourceR);
-                                STVF (clutg[tj], sourceG);
-                                STVF (clutb[tj], sourceB);
-                            }
+        if (newRGBChainLUT) {
+            // sample the tool chain at the LUT nodes, one slice of red per tile
+            const int lutSize = newRGBChainLUT->getSize();
 
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
 #endif
 
-                            for (; j < tW; j++, tj++) {
-                                float sourceR = rtemp[ti * TS + tj];
-                                float sourceG = gtemp[ti * TS + tj];
-                                float sourceB = btemp[ti * TS + tj];
-
-                                float x, y, z;
-                                Color::rgbxyz ( sourceR, sourceG, sourceB, x, y, z, wprof );
-                                Color::xyz2rgb (x, y, z, clutr[tj], clutg[tj], clutb[tj], xyz2clut);
-                            }
-                        } else {
-                            memcpy(clutr, &rtemp[ti * TS], sizeof(float) * TS);
-                            memcpy(clutg, &gtemp[ti * TS], sizeof(float) * TS);
-                            memcpy(clutb, &btemp[ti * TS], sizeof(float) * TS);
-                        }
+            for (int r = 0; r < lutSize; ++r) {
+                for (int g = 0; g < lutSize; ++g) {
+                    for (int b = 0; b < lutSize; ++b) {
+                        rtemp[g * TS + b] = getRGBChainLUTNodeValue(r, lutSize);
+                        gtemp[g * TS + b] = getRGBChainLUTNodeValue(g, lutSize);
+                        btemp[g * TS + b] = getRGBChainLUTNodeValue(b, lutSize);
+                    }
+                }
 
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            float &sourceR = clutr[tj];
-                            float &sourceG = clutg[tj];
-                            float &sourceB = clutb[tj];
-
-                            // Apply gamma sRGB (default RT)
-                            sourceR = Color::gamma_srgbclipped (sourceR);
-                            sourceG = Color::gamma_srgbclipped (sourceG);
-                            sourceB = Color::gamma_srgbclipped (sourceB);
-                        }
+                rgbChain(0, lutSize, 0, lutSize);
 
-                        hald_clut->getRGB (
-                            film_simulation_strength,
-                            std::min (TS, tW - jstart),
-                            clutr,
-                            clutg,
-                            clutb,
-                            out_rgbx
-                        );
+                for (int g = 0; g < lutSize; ++g) {
+                    for (int b = 0; b < lutSize; ++b) {
+                        float* const node = newRGBChainLUT->getNode(r, g, b);
+                        node[0] = rtemp[g * TS + b];
+                        node[1] = gtemp[g * TS + b];
+                        node[2] = btemp[g * TS + b];
+                    }
+                }
+            }
+        }
 
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            float &sourceR = clutr[tj];
-                            float &sourceG = clutg[tj];
-                            float &sourceB = clutb[tj];
-
-                            // Apply inverse gamma sRGB
-                            sourceR = Color::igamma_srgb (out_rgbx[tj * 4 + 0]);
-                            sourceG = Color::igamma_srgb (out_rgbx[tj * 4 + 1]);
-                            sourceB = Color::igamma_srgb (out_rgbx[tj * 4 + 2]);
-                        }
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic, chunkSize) collapse(2)
+#endif
 
-                        if (!clutAndWorkingProfilesAreSame) {
-                            // Convert from clut to working profile
-                            int j = jstart;
-                            int tj = 0;
+        for (int ii = 0; ii < working->getHeight(); ii += TS)
+            for (int jj = 0; jj < working->getWidth(); jj += TS) {
+                const int istart = ii;
+                const int jstart = jj;
+                const int tH = min (ii + TS, working->getHeight());
+                const int tW = min (jj + TS, working->getWidth());
 
-#ifdef __SSE2__
 
-                            for (; j < tW - 3; j += 4, tj += 4) {
-                                vfloat sourceR = LVF (clutr[tj]);
-                                vfloat sourceG = LVF (clutg[tj]);
-                                vfloat sourceB = LVF (clutb[tj]);
+                for (int i = istart, ti = 0; i < tH; i++, ti++) {
+                    for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+                        rtemp[ti * TS + tj] = working->r (i, j);
+                        gtemp[ti * TS + tj] = working->g (i, j);
+                        btemp[ti * TS + tj] = working->b (i, j);
+                    }
+                }
 
-                                vfloat x;
-                                vfloat y;
-                                vfloat z;
-                                Color::rgbxyz (sourceR, sourceG, sourceB, x, y, z, v_clut2xyz);
-                                Color::xyz2rgb (x, y, z, sourceR, sourceG, sourceB, v_xyz2work);
+                if (mixchannels) {
+                    channelMixerTile(chMix, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
+                }
 
-                                STVF (clutr[tj], sourceR);
-                                STVF (clutg[tj], sourceG);
-                                STVF (clutb[tj], sourceB);
-                            }
+                highlightToneCurve(hltonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS, exp_scale, comp, hlrange);
+                if (params->toneCurve.black != 0.0) {
+                    shadowToneCurve(shtonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
+                }
 
-#endif
+                if (dcpProf) {
+                    dcpProf->step2ApplyTile (rtemp, gtemp, btemp, tW - jstart, tH - istart, TS, asIn);
+                }
 
-                            for (; j < tW; j++, tj++) {
-                                float &sourceR = clutr[tj];
-                                float &sourceG = clutg[tj];
-                                float &sourceB = clutb[tj];
+                if (params->toneCurve.clampOOG) {
+                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
+                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+                            // clip out of gamut colors, without distorting colour too bad
+                            float r = std::max(rtemp[ti * TS + tj], 0.f);
+                            float g = std::max(gtemp[ti * TS + tj], 0.f);
+                            float b = std::max(btemp[ti * TS + tj], 0.f);
 
-                                float x, y, z;
-                                Color::rgbxyz (sourceR, sourceG, sourceB, x, y, z, clut2xyz);
-                                Color::xyz2rgb ( x, y, z, sourceR, sourceG, sourceB, wiprof );
+                            if (OOG(r) || OOG(g) || OOG(b)) {
+                                filmlike_clip(&r, &g, &b);
                             }
+                            rtemp[ti * TS + tj] = r;
+                            gtemp[ti * TS + tj] = g;
+                            btemp[ti * TS + tj] = b;
                         }
+                    }
+                }
 
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            setUnlessOOG(rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj], clutr[tj], clutg[tj], clutb[tj]);
-                        }
+                if (rgbChainLUT) {
+                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
+                        applyRGBChainLUT(*rgbChainLUT, &rtemp[ti * TS], &gtemp[ti * TS], &btemp[ti * TS], tW - jstart);
                     }
+                } else {
+                    rgbChain(istart, tH, jstart, tW);
                 }
 
                 //softLight(rtemp, gtemp, btemp, istart, jstart, tW, tH, TS);
@@ -3296,6 +3441,10 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 #endif // _OPENMP
     }
 
+    if (newRGBChainLUT) {
+        RGBChainLUTStore::getInstance().put(rgbChainKey, newRGBChainLUT);
+    }
+
     // starting a new tile processing with a 'reduction' clause for the auto mixer computing
     if (blackwhite) {//channel-mixer
         int tW = working->getWidth();
@@ -21,7 +21,9 @@
 #include "color.h"
 #include "rtengine.h"
 #include "iccstore.h"
+#include "cplx_wavelet_pool.h"
 #include "dcp.h"
+#include "fftwplancache.h"
 #include "camconst.h"
 #include "curves.h"
 #include "rawimagesource.h"
@@ -88,24 +90,17 @@ int init (const Settings* s, const Glib::ustring& baseDir, const Glib::ustring&
 {
     CameraConstantsStore::getInstance()->init(baseDir, userSettingsDir);
 }
-#ifdef _OPENMP
-#pragma omp section
-#endif
-{
-    dfm.init(s->darkFramesPath);
 }
-#ifdef _OPENMP
-#pragma omp section
-#endif
-{
+
+    // not in a section above, their scan of the calibration directories runs multithreaded itself
+    dfm.init(s->darkFramesPath);
     ffm.init(s->flatFieldsPath);
-}
-}
 
     Color::init ();
     delete lcmsMutex;
     lcmsMutex = new MyMutex;
     fftwMutex = new MyMutex;
+    FFTWPlanCache::getInstance().init(s->fftwWisdomFile);
     return 0;
 }
 
@@ -114,6 +109,8 @@ void cleanup ()
     ProcParams::cleanup ();
     Color::cleanup ();
     RawImageSource::cleanup ();
+    FFTWPlanCache::getInstance().cleanup();
+    WaveletBufferPool::getInstance().clear();
 
 #ifdef RT_FFTW3F_OMP
     fftwf_cleanup_threads();
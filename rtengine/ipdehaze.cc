@@ -32,6 +32,7 @@
 #include <iostream>
 #include <vector>
 
+#include "analysispyramid.h"
 #include "array2D.h"
 #include "color.h"
 #include "guidedfilter.h"
@@ -275,12 +276,19 @@ void extract_channels(Imagefloat *img, array2D<float> &r, array2D<float> &g, arr
 
 } // namespace
 
-void ImProcFunctions::dehaze(Imagefloat *img)
+void ImProcFunctions::dehaze(Imagefloat *img, const AnalysisPyramid* analysis)
 {
     if (!params->dehaze.enabled || params->dehaze.strength == 0.0) {
         return;
     }
 
+    AnalysisPyramid localAnalysis;
+
+    if (!analysis || analysis->empty()) {
+        localAnalysis.update(img, multiThread);
+        analysis = &localAnalysis;
+    }
+
     const float maxChannel = normalize(img, multiThread);
 
     const int W = img->getWidth();
@@ -304,28 +312,35 @@ void ImProcFunctions::dehaze(Imagefloat *img)
         extract_channels(img, R, G, B, patchsize, 1e-1, multiThread);
 
         {
+            // The ambient light is a property of the whole picture. Estimate it on the analysis pyramid
+            // and with a fixed patch size, so that preview, detail windows and export agree.
             constexpr int sizecap = 200;
-            const float r = static_cast<float>(W) / static_cast<float>(H);
-            const int hh = r >= 1.f ? sizecap : sizecap / r;
-            const int ww = r >= 1.f ? sizecap * r : sizecap;
-
-            if (W <= ww && H <= hh) {
-                // don't rescale small thumbs
-                array2D<float> D(W, H);
-                const int npatches = get_dark_channel_downsized(R, G, B, D, 2, multiThread);
-                maxDistance = estimate_ambient_light(R, G, B, D, patchsize, npatches, ambient);
-            } else {
-                array2D<float> RR(ww, hh);
-                array2D<float> GG(ww, hh);
-                array2D<float> BB(ww, hh);
-                rescaleNearest(R, RR, multiThread);
-                rescaleNearest(G, GG, multiThread);
-                rescaleNearest(B, BB, multiThread);
-                array2D<float> D(ww, hh);
-
-                const int npatches = get_dark_channel_downsized(RR, GG, BB, D, 2, multiThread);
-                maxDistance = estimate_ambient_light(RR, GG, BB, D, patchsize, npatches, ambient);
+            constexpr int ambientPatchSize = 5;
+            const AnalysisPyramid::Level& level = analysis->getLevel(sizecap);
+            const int lw = level.r.width();
+            const int lh = level.r.height();
+            const float r = static_cast<float>(lw) / static_cast<float>(lh);
+            const int hh = min(r >= 1.f ? sizecap : static_cast<int>(sizecap / r), lh);
+            const int ww = min(r >= 1.f ? static_cast<int>(sizecap * r) : sizecap, lw);
+
+            array2D<float> RR(ww, hh);
+            array2D<float> GG(ww, hh);
+            array2D<float> BB(ww, hh);
+            rescaleBilinear(level.r, RR, multiThread);
+            rescaleBilinear(level.g, GG, multiThread);
+            rescaleBilinear(level.b, BB, multiThread);
+
+            for (int y = 0; y < hh; ++y) {
+                for (int x = 0; x < ww; ++x) {
+                    RR[y][x] /= maxChannel;
+                    GG[y][x] /= maxChannel;
+                    BB[y][x] /= maxChannel;
+                }
             }
+
+            array2D<float> D(ww, hh);
+            const int npatches = get_dark_channel_downsized(RR, GG, BB, D, 2, multiThread);
+            maxDistance = estimate_ambient_light(RR, GG, BB, D, ambientPatchSize, npatches, ambient);
         }
 
         if (min(ambient[0], ambient[1], ambient[2]) < 0.01f) {
@@ -202,11 +202,18 @@ Image8* ImProcFunctions::lab2rgb(LabImage* lab, int cx, int cy, int cw, int ch,
             flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
         }
 
-        lcmsMutex->lock();
-        cmsHPROFILE LabIProf  = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform (LabIProf, TYPE_Lab_DBL, oprofG, TYPE_RGB_FLT, icm.outputIntent, flags);  // NOCACHE is important for thread safety
-        cmsCloseProfile(LabIProf);
-        lcmsMutex->unlock();
+        cmsHTRANSFORM hTransform;
+
+        if (oprofG == oprof) {
+            // the store keeps the transform for the next image
+            hTransform = ICCStore::getInstance()->getTransform(nullptr, TYPE_Lab_DBL, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);  // NOCACHE is important for thread safety
+        } else {
+            lcmsMutex->lock();
+            cmsHPROFILE LabIProf  = cmsCreateLab4Profile(nullptr);
+            hTransform = cmsCreateTransform (LabIProf, TYPE_Lab_DBL, oprofG, TYPE_RGB_FLT, icm.outputIntent, flags);  // NOCACHE is important for thread safety
+            cmsCloseProfile(LabIProf);
+            lcmsMutex->unlock();
+        }
 
         unsigned char *data = image->data;
 
@@ -243,9 +250,8 @@ Image8* ImProcFunctions::lab2rgb(LabImage* lab, int cx, int cy, int cw, int ch,
             }
         } // End of parallelization
 
-        cmsDeleteTransform(hTransform);
-
         if (oprofG != oprof) {
+            cmsDeleteTransform(hTransform);
             cmsCloseProfile(oprofG);
         }
     } else {
@@ -301,13 +307,9 @@ Imagefloat* ImProcFunctions::lab2rgbOut(LabImage* lab, int cx, int cy, int cw, i
             flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
         }
 
-        lcmsMutex->lock();
-        cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform(iprof, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
-        lcmsMutex->unlock();
+        const cmsHTRANSFORM hTransform = ICCStore::getInstance()->getTransform(nullptr, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
 
         image->ExecCMSTransform(hTransform, *lab, cx, cy);
-        cmsDeleteTransform(hTransform);
         image->normalizeFloatTo65535();
     } else {
         
@@ -92,6 +92,25 @@ void retinex_scales( float* scales, int nscales, int mode, int s, float high)
     }
 }
 
+void finish_mean_stddv(double sum, double vsquared, int W_L, int H_L, float &mean, float &stddv)
+{
+    mean = sum / (double) (W_L * H_L);
+    vsquared /= (double) W_L * H_L;
+    stddv = vsquared - rtengine::SQR<double>(mean);
+    stddv = std::sqrt(stddv);
+}
+
+// adds a row to the sums of mean_stddv2, used to gather the statistics while a row is in cache
+inline void add_mean_stddv_row(const float *row, int W_L, double &sum, double &vsquared, float &maxtr, float &mintr)
+{
+    for (int j = 0; j < W_L; j++) {
+        sum += static_cast<double>(row[j]);
+        vsquared += rtengine::SQR<double>(row[j]);
+        maxtr = row[j] > maxtr ? row[j] : maxtr;
+        mintr = row[j] < mintr ? row[j] : mintr;
+    }
+}
+
 void mean_stddv2( float **dst, float &mean, float &stddv, int W_L, int H_L, float &maxtr, float &mintr)
 {
     // summation using double precision to avoid too large summation error for large pictures
@@ -126,10 +145,7 @@ void mean_stddv2( float **dst, float &mean, float &stddv, int W_L, int H_L, floa
         }
 
     }
-    mean = sum / (double) (W_L * H_L);
-    vsquared /= (double) W_L * H_L;
-    stddv = vsquared - rtengine::SQR<double>(mean);
-    stddv = std::sqrt(stddv);
+    finish_mean_stddv(sum, vsquared, W_L, H_L, mean, stddv);
 }
 
 }
@@ -379,6 +395,12 @@ BENCHFUN
             buffer.reset(new float[W_L * H_L]);
         }
 
+        // statistics of the accumulated luminance, gathered in the pass of the last scale
+        double lumSum = 0.0;
+        double lumSquared = 0.0;
+        float maxtr = -999999.f;
+        float mintr = 999999.f;
+
         for (int scale = scal - 1; scale >= 0; --scale) {
             if (scale == scal - 1) {
                 gaussianBlur(src, out, W_L, H_L, RetinexScales[scale], true);
@@ -458,7 +480,7 @@ BENCHFUN
             }
 
 #ifdef _OPENMP
-            #pragma omp parallel for
+            #pragma omp parallel for reduction(+:lumSum,lumSquared) reduction(max:maxtr) reduction(min:mintr)
 #endif
 
             for (int i = 0; i < H_L; i++) {
@@ -489,6 +511,10 @@ BENCHFUN
                         luminance[i][j] +=  pond * xlogf(LIM(src[i][j] / out[i][j], ilimdx, limdx)); //  /logt ?
                     }
                 }
+
+                if (scale == 0) {
+                    add_mean_stddv_row(luminance[i], W_L, lumSum, lumSquared, maxtr, mintr);
+                }
             }
         }
 
@@ -496,10 +522,8 @@ BENCHFUN
 
         float mean = 0.f;
         float stddv = 0.f;
-        // I call mean_stddv2 instead of mean_stddv ==> logBetaGain
-
-        float maxtr, mintr;
-        mean_stddv2(luminance, mean, stddv, W_L, H_L, maxtr, mintr);
+        // same as mean_stddv2 instead of mean_stddv ==> logBetaGain
+        finish_mean_stddv(lumSum, lumSquared, W_L, H_L, mean, stddv);
         //printf("mean=%f std=%f delta=%f maxtr=%f mintr=%f\n", mean, stddv, delta, maxtr, mintr);
 
         //mean_stddv( luminance, mean, stddv, W_L, H_L, logBetaGain, maxtr, mintr);
@@ -518,8 +542,11 @@ BENCHFUN
             amin *= 500.f;
             bmin *= 500.f;
 
+            lumSum = lumSquared = 0.0;
+            maxtr = -999999.f;
+            mintr = 999999.f;
 #ifdef _OPENMP
-            #pragma omp parallel for schedule(dynamic,16)
+            #pragma omp parallel for reduction(+:lumSum,lumSquared) reduction(max:maxtr) reduction(min:mintr) schedule(dynamic,16)
 #endif
 
             for (int i = 0; i < H_L; i++ ) {
@@ -540,6 +567,8 @@ BENCHFUN
                         tran[i][j] = luminance[i][j];
                     }
                 }
+
+                add_mean_stddv_row(luminance[i], W_L, lumSum, lumSquared, maxtr, mintr);
             }
 
             // median filter on transmission  ==> reduce artifacts
@@ -566,11 +595,13 @@ BENCHFUN
                         luminance[i][j] = tmL[i][j];
                     }
                 }
-            }
 
-            // I call mean_stddv2 instead of mean_stddv ==> logBetaGain
-            //mean_stddv( luminance, mean, stddv, W_L, H_L, 1.f, maxtr, mintr);
-            mean_stddv2(luminance, mean, stddv, W_L, H_L, maxtr, mintr);
+                // I call mean_stddv2 instead of mean_stddv ==> logBetaGain
+                //mean_stddv( luminance, mean, stddv, W_L, H_L, 1.f, maxtr, mintr);
+                mean_stddv2(luminance, mean, stddv, W_L, H_L, maxtr, mintr);
+            } else {
+                finish_mean_stddv(lumSum, lumSquared, W_L, H_L, mean, stddv);
+            }
         }
 
         constexpr float epsil = 0.1f;
@@ -601,21 +632,10 @@ BENCHFUN
         const float bzb = 16300.f - bza * (mean);
 
 //prepare work for curve gain
-#ifdef _OPENMP
-        #pragma omp parallel for
-#endif
-
-        for (int i = 0; i < H_L; i++) {
-            for (int j = 0; j < W_L; j++) {
-                luminance[i][j] = luminance[i][j] - mini;
-            }
-        }
-
-        mean = 0.f;
-        stddv = 0.f;
-        // I call mean_stddv2 instead of mean_stddv ==> logBetaGain
-
-        mean_stddv2(luminance, mean, stddv, W_L, H_L, maxtr, mintr);
+        // the luminance is shifted by -mini in the loop below, shift its statistics accordingly
+        mean -= mini;
+        maxtr -= mini;
+        mintr -= mini;
         float asig = 0.f, bsig = 0.f, amax = 0.f, bmax = 0.f, amin = 0.f, bmin = 0.f;
 
         if (dehagaintransmissionCurve && mean != 0.f && stddv != 0.f) { //if curve
@@ -644,17 +664,18 @@ BENCHFUN
 
         for ( int i = 0; i < H_L; i ++ ) {
             for (int j = 0; j < W_L; j++) {
+                const float lum = luminance[i][j] - mini;
                 float gan;
 
                 if (dehagaintransmissionCurve && mean != 0.f && stddv != 0.f) {
                     float absciss;
 
-                    if (LIKELY(fabsf(luminance[i][j] - mean) < stddv)) {
-                        absciss = asig * luminance[i][j] + bsig;
-                    } else if (luminance[i][j] >= mean) {
-                        absciss = amax * luminance[i][j] + bmax;
+                    if (LIKELY(fabsf(lum - mean) < stddv)) {
+                        absciss = asig * lum + bsig;
+                    } else if (lum >= mean) {
+                        absciss = amax * lum + bmax;
                     } else { /*if(luminance[i][j] <= mean - stddv)*/
-                        absciss = amin * luminance[i][j] + bmin;
+                        absciss = amin * lum + bmin;
                     }
 
 
@@ -665,7 +686,7 @@ BENCHFUN
                     gan = 0.5f;
                 }
 
-                const float cd = gan * cdfactor * luminance[i][j] + offse;
+                const float cd = gan * cdfactor * lum + offse;
 
                 maxCD = cd > maxCD ? cd : maxCD;
                 minCD = cd < minCD ? cd : minCD;
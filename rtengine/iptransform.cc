@@ -16,11 +16,18 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "imagefloat.h"
 #include "improcfun.h"
 
+#include "lensgrid.h"
 #include "procparams.h"
 #include "rt_math.h"
 #include "rtengine.h"
@@ -109,6 +116,141 @@ void logEncode(rtengine::Imagefloat *src, rtengine::Imagefloat *dest, bool multi
     }
 }
 
+// Describes everything the lens correction of transform() depends on
+std::string getLensCorrectionKey(const rtengine::procparams::ProcParams& params, const rtengine::FramesMetaData* metadata, int oW, int oH, int rawRotationDeg)
+{
+    const rtengine::procparams::LensProfParams& lensProf = params.lensProf;
+
+    std::ostringstream key;
+    key.precision(12);
+    key << static_cast<int>(lensProf.lcMode) << '\t' << lensProf.lcpFile << '\t'
+        << lensProf.lfCameraMake << '\t' << lensProf.lfCameraModel << '\t' << lensProf.lfLens << '\t'
+        << metadata->getMake() << '\t' << metadata->getModel() << '\t' << metadata->getLens() << '\t'
+        << metadata->getFocalLen() << '\t' << metadata->getFocalLen35mm() << '\t' << metadata->getFocusDist() << '\t' << metadata->getFNumber() << '\t'
+        << params.coarse.rotate << '\t' << params.coarse.hflip << '\t' << params.coarse.vflip << '\t' << rawRotationDeg << '\t'
+        << oW << '\t' << oH;
+    return key.str();
+}
+
+// The composite mapping of transformGeneral() sampled every gridStep output pixels. Each node holds
+// the centered source position before CA correction and the distortion factor. Cells in which
+// the interpolated source position deviates from the exact one by more than maxError pixels
+// (checked at the cell center and the edge midpoints, where bilinear interpolation is worst) are
+// left to exact evaluation.
+// The mapping evaluates the lens distortion model itself, not an interpolation of it, so the check
+// bounds the whole error of the grid.
+class TransformGrid final
+{
+public:
+    template<typename MapPixel>
+    TransformGrid(int width, int height, const MapPixel& mapPixel, const std::array<double, 3>& chDist, int channels, bool multiThread) :
+        gridWidth((width - 1) / gridStep + 2),
+        gridHeight((height - 1) / gridStep + 2),
+        nodes(3 * gridWidth * gridHeight),
+        exact((gridWidth - 1) * (gridHeight - 1))
+    {
+#ifdef _OPENMP
+        #pragma omp parallel if (multiThread)
+#endif
+        {
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic, 4)
+#endif
+
+            for (int i = 0; i < gridHeight; ++i) {
+                for (int j = 0; j < gridWidth; ++j) {
+                    double Dxc, Dyc, s;
+                    mapPixel(j * gridStep, i * gridStep, Dxc, Dyc, s);
+                    float* const node = &nodes[3 * (i * gridWidth + j)];
+                    node[0] = Dxc;
+                    node[1] = Dyc;
+                    node[2] = s;
+                }
+            }
+
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic, 4)
+#endif
+
+            for (int i = 0; i < gridHeight - 1; ++i) {
+                for (int j = 0; j < gridWidth - 1; ++j) {
+                    const int left = j * gridStep;
+                    const int top = i * gridStep;
+                    const int half = gridStep / 2;
+                    // the curvature of the mapping can be along a single axis, which the center alone misses
+                    const bool accurate =
+                        isAccurate(mapPixel, left + half, top + half, chDist, channels)
+                        && isAccurate(mapPixel, left + half, top, chDist, channels)
+                        && isAccurate(mapPixel, left, top + half, chDist, channels)
+                        && isAccurate(mapPixel, left + half, top + gridStep, chDist, channels)
+                        && isAccurate(mapPixel, left + gridStep, top + half, chDist, channels);
+
+                    exact[i * (gridWidth - 1) + j] = !accurate;
+                }
+            }
+        }
+    }
+
+    // Returns false if (x, y) has to be evaluated exactly
+    bool interpolate(int x, int y, double& Dxc, double& Dyc, double& s) const
+    {
+        if (exact[(y / gridStep) * (gridWidth - 1) + x / gridStep]) {
+            return false;
+        }
+
+        interpolateNodes(x, y, Dxc, Dyc, s);
+        return true;
+    }
+
+private:
+    static constexpr int gridStep = 8;
+    static constexpr double maxError = 1.0 / 64.0;
+
+    template<typename MapPixel>
+    bool isAccurate(const MapPixel& mapPixel, int x, int y, const std::array<double, 3>& chDist, int channels) const
+    {
+        double Dxc, Dyc, s;
+        double gridDxc, gridDyc, gridS;
+        mapPixel(x, y, Dxc, Dyc, s);
+        interpolateNodes(x, y, gridDxc, gridDyc, gridS);
+
+        for (int c = 0; c < channels; ++c) {
+            const double errorX = gridDxc * (gridS + chDist[c]) - Dxc * (s + chDist[c]);
+            const double errorY = gridDyc * (gridS + chDist[c]) - Dyc * (s + chDist[c]);
+
+            // also catches non finite values near perspective singularities
+            if (!(std::fabs(errorX) <= maxError && std::fabs(errorY) <= maxError)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void interpolateNodes(int x, int y, double& Dxc, double& Dyc, double& s) const
+    {
+        // points on the bottom or right edge of the last cells belong to them
+        const int j = std::min(x / gridStep, gridWidth - 2);
+        const int i = std::min(y / gridStep, gridHeight - 2);
+        const double fx = static_cast<double>(x - j * gridStep) / gridStep;
+        const double fy = static_cast<double>(y - i * gridStep) / gridStep;
+        const float* const top = &nodes[3 * (i * gridWidth + j)];
+        const float* const bottom = top + 3 * gridWidth;
+
+        Dxc = (1.0 - fy) * ((1.0 - fx) * top[0] + fx * top[3]) + fy * ((1.0 - fx) * bottom[0] + fx * bottom[3]);
+        Dyc = (1.0 - fy) * ((1.0 - fx) * top[1] + fx * top[4]) + fy * ((1.0 - fx) * bottom[1] + fx * bottom[4]);
+        s = (1.0 - fy) * ((1.0 - fx) * top[2] + fx * top[5]) + fy * ((1.0 - fx) * bottom[2] + fx * bottom[5]);
+    }
+
+    const int gridWidth;
+    const int gridHeight;
+    std::vector<float> nodes;
+    std::vector<char> exact;
+};
+
+constexpr int TransformGrid::gridStep;
+constexpr double TransformGrid::maxError;
+
 #ifdef __SSE2__
 inline void interpolateTransformCubic(rtengine::Imagefloat* src, int xs, int ys, float Dx, float Dy, float &r, float &g, float &b, float mul)
 {
@@ -543,7 +685,7 @@ void ImProcFunctions::transform (Imagefloat* original, Imagefloat* transformed,
     float focusDist = metadata->getFocusDist();
     double fNumber = metadata->getFNumber();
 
-    std::unique_ptr<const LensCorrection> pLCPMap;
+    std::shared_ptr<const LensCorrection> pLCPMap;
 
     if (needsLensfun()) {
         pLCPMap = LFDatabase::getInstance()->findModifier(params->lensProf, metadata, oW, oH, params->coarse, rawRotationDeg);
@@ -584,9 +726,28 @@ void ImProcFunctions::transform (Imagefloat* original, Imagefloat* transformed,
                 dest = tmpimg.get();
             }
         }
-        transformGeneral(highQuality, original, dest, cx, cy, sx, sy, oW, oH, fW, fH, pLCPMap.get(), useOriginalBuffer);
+
+        const double ascale = params->commonTrans.autofill ? getTransformAutoFill(oW, oH, pLCPMap.get()) : 1.0;
+
+        // the distortion is sampled by transformGeneral() from the exact lens model
+        transformGeneral(highQuality, original, dest, cx, cy, sx, sy, oW, oH, fW, fH, pLCPMap.get(), ascale, useOriginalBuffer);
         
         if (highQuality && dest != transformed) {
+            // evaluating the lens CA model for every pixel is expensive, interpolate it from a grid instead
+            LensCorrectionGridStore& gridStore = LensCorrectionGridStore::getInstance();
+            const std::string key = getLensCorrectionKey(*params, metadata, oW, oH, rawRotationDeg);
+            std::shared_ptr<const LensCorrectionGrid> grid = gridStore.get(key);
+
+            // sampling the full frame doesn't pay off for small crops (detail windows) unless the grid is known already
+            if (!grid && 4 * transformed->getWidth() * transformed->getHeight() >= oW * oH) {
+                grid = std::make_shared<const LensCorrectionGrid>(pLCPMap, oW, oH);
+                gridStore.put(key, grid);
+            }
+
+            if (grid) {
+                pLCPMap = grid;
+            }
+
             transformLCPCAOnly(dest, transformed, cx, cy, pLCPMap.get(), useOriginalBuffer);
         }
     }
@@ -974,7 +1135,7 @@ void ImProcFunctions::transformLuminanceOnly (Imagefloat* original, Imagefloat*
 }
 
 
-void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, Imagefloat *transformed, int cx, int cy, int sx, int sy, int oW, int oH, int fW, int fH, const LensCorrection *pLCPMap, bool useOriginalBuffer)
+void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, Imagefloat *transformed, int cx, int cy, int sx, int sy, int oW, int oH, int fW, int fH, const LensCorrection *pLCPMap, double ascale, bool useOriginalBuffer)
 {
 
     // set up stuff, depending on the mode we are
@@ -1044,8 +1205,6 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, I
     const double hpcospt = (hpdeg >= 0 ? 1.0 : -1.0) * cos(hpteta);
     const double hptanpt = tan(hpteta);
 
-    const double ascale = params->commonTrans.autofill ? getTransformAutoFill(oW, oH, pLCPMap) : 1.0;
-
     const bool darkening = (params->vignetting.amount <= 0.0);
     const bool useLog = params->commonTrans.method == "log" && highQuality;
     const double centerFactorx = cx - w2;
@@ -1068,13 +1227,10 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, I
         original->b.ptrs
     };
 
-    // main cycle
-#ifdef _OPENMP
-    #pragma omp parallel for schedule(dynamic, 16) if(multiThread)
-#endif
-
-    for (int y = 0; y < transformed->getHeight(); ++y) {
-        for (int x = 0; x < transformed->getWidth(); ++x) {
+    // maps an output pixel to the centered source position before CA correction, and the distortion factor
+    const auto mapPixel =
+        [&](int x, int y, double& Dxc, double& Dyc, double& s)
+        {
             double x_d = x;
             double y_d = y;
 
@@ -1099,112 +1255,142 @@ void ImProcFunctions::transformGeneral(bool highQuality, Imagefloat *original, I
             }
 
             // rotate
-            const double Dxc = x_d * cost - y_d * sint;
-            const double Dyc = x_d * sint + y_d * cost;
+            Dxc = x_d * cost - y_d * sint;
+            Dyc = x_d * sint + y_d * cost;
 
             // distortion correction
-            double s = 1.0;
+            s = 1.0;
 
             if (enableDistortion) {
                 const double r = sqrt(Dxc * Dxc + Dyc * Dyc) / maxRadius;
                 s = 1.0 - distAmount + distAmount * r;
             }
+        };
 
-            for (int c = 0; c < (enableCA ? 3 : 1); ++c) {
-                double Dx = Dxc * (s + chDist[c]);
-                double Dy = Dyc * (s + chDist[c]);
+    // Lens correction, perspective and distortion are smooth but expensive to evaluate per pixel,
+    // so they are sampled on a grid and interpolated, except where interpolation is not accurate enough.
+    std::unique_ptr<TransformGrid> grid;
 
-                // de-center
-                Dx += w2;
-                Dy += h2;
+    if (enableLCPDist || enablePerspective || enableDistortion) {
+        grid.reset(new TransformGrid(transformed->getWidth(), transformed->getHeight(), mapPixel, chDist, enableCA ? 3 : 1, multiThread));
+    }
 
-                // Extract integer and fractions of source screen coordinates
-                int xc = Dx;
-                Dx -= xc;
-                xc -= sx;
-                int yc = Dy;
-                Dy -= yc;
-                yc -= sy;
+    // main cycle, in tiles to keep the source region of a rotated or perspective corrected tile in cache
+    constexpr int tileSize = 64;
+    const int W = transformed->getWidth();
+    const int H = transformed->getHeight();
 
-                // Convert only valid pixels
-                if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
-                    // multiplier for vignetting correction
-                    double vignmul = 1.0;
-
-                    if (enableVignetting) {
-                        const double vig_x_d = ascale * (x + cx - vig_w2); // centering x coord & scale
-                        const double vig_y_d = ascale * (y + cy - vig_h2); // centering y coord & scale
-                        const double vig_Dx = vig_x_d * cost - vig_y_d * sint;
-                        const double vig_Dy = vig_x_d * sint + vig_y_d * cost;
-                        const double r2 = sqrt(vig_Dx * vig_Dx + vig_Dy * vig_Dy);
-                        if (darkening) {
-                            vignmul /= std::max(v + mul * tanh(b * (maxRadius - s * r2) / maxRadius), 0.001);
-                        } else {
-                            vignmul *= (v + mul * tanh(b * (maxRadius - s * r2) / maxRadius));
-                        }
-                    }
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) collapse(2) if(multiThread)
+#endif
 
-                    if (enableGradient) {
-                        vignmul *= static_cast<double>(calcGradientFactor(gp, cx + x, cy + y));
-                    }
+    for (int tileY = 0; tileY < H; tileY += tileSize) {
+        for (int tileX = 0; tileX < W; tileX += tileSize) {
+            for (int y = tileY; y < std::min(tileY + tileSize, H); ++y) {
+                for (int x = tileX; x < std::min(tileX + tileSize, W); ++x) {
+                    double Dxc, Dyc, s;
 
-                    if (enablePCVignetting) {
-                        vignmul *= static_cast<double>(calcPCVignetteFactor(pcv, cx + x, cy + y));
+                    if (!grid || !grid->interpolate(x, y, Dxc, Dyc, s)) {
+                        mapPixel(x, y, Dxc, Dyc, s);
                     }
 
-                    if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
-                        // all interpolation pixels inside image
-                        if (!highQuality) {
-                            transformed->r(y, x) = vignmul * (original->r(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->r(yc, xc + 1) * Dx * (1.0 - Dy) + original->r(yc + 1, xc) * (1.0 - Dx) * Dy + original->r(yc + 1, xc + 1) * Dx * Dy);
-                            transformed->g(y, x) = vignmul * (original->g(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->g(yc, xc + 1) * Dx * (1.0 - Dy) + original->g(yc + 1, xc) * (1.0 - Dx) * Dy + original->g(yc + 1, xc + 1) * Dx * Dy);
-                            transformed->b(y, x) = vignmul * (original->b(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->b(yc, xc + 1) * Dx * (1.0 - Dy) + original->b(yc + 1, xc) * (1.0 - Dx) * Dy + original->b(yc + 1, xc + 1) * Dx * Dy);
-                        } else if (!useLog) {
-                            if (enableCA) {
-                                interpolateTransformChannelsCubic(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
-                            } else {
-                                interpolateTransformCubic(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+                    for (int c = 0; c < (enableCA ? 3 : 1); ++c) {
+                        double Dx = Dxc * (s + chDist[c]);
+                        double Dy = Dyc * (s + chDist[c]);
+
+                        // de-center
+                        Dx += w2;
+                        Dy += h2;
+
+                        // Extract integer and fractions of source screen coordinates
+                        int xc = Dx;
+                        Dx -= xc;
+                        xc -= sx;
+                        int yc = Dy;
+                        Dy -= yc;
+                        yc -= sy;
+
+                        // Convert only valid pixels
+                        if (yc >= 0 && yc < original->getHeight() && xc >= 0 && xc < original->getWidth()) {
+                            // multiplier for vignetting correction
+                            double vignmul = 1.0;
+
+                            if (enableVignetting) {
+                                const double vig_x_d = ascale * (x + cx - vig_w2); // centering x coord & scale
+                                const double vig_y_d = ascale * (y + cy - vig_h2); // centering y coord & scale
+                                const double vig_Dx = vig_x_d * cost - vig_y_d * sint;
+                                const double vig_Dy = vig_x_d * sint + vig_y_d * cost;
+                                const double r2 = sqrt(vig_Dx * vig_Dx + vig_Dy * vig_Dy);
+                                if (darkening) {
+                                    vignmul /= std::max(v + mul * tanh(b * (maxRadius - s * r2) / maxRadius), 0.001);
+                                } else {
+                                    vignmul *= (v + mul * tanh(b * (maxRadius - s * r2) / maxRadius));
+                                }
                             }
-                        } else {
-                            if (enableCA) {
-                                interpolateTransformChannelsCubicLog(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
-                            } else {
-                                interpolateTransformCubicLog(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+
+                            if (enableGradient) {
+                                vignmul *= static_cast<double>(calcGradientFactor(gp, cx + x, cy + y));
                             }
-                        }
-                    } else {
-                        // edge pixels
-                        const int y1 = LIM(yc, 0, original->getHeight() - 1);
-                        const int y2 = LIM(yc + 1, 0, original->getHeight() - 1);
-                        const int x1 = LIM(xc, 0, original->getWidth() - 1);
-                        const int x2 = LIM(xc + 1, 0, original->getWidth() - 1);
 
-                        if (useLog) {
-                            if (enableCA) {
-                                chTrans[c][y][x] = vignmul * xexpf(chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                            if (enablePCVignetting) {
+                                vignmul *= static_cast<double>(calcPCVignetteFactor(pcv, cx + x, cy + y));
+                            }
+
+                            if (yc > 0 && yc < original->getHeight() - 2 && xc > 0 && xc < original->getWidth() - 2) {
+                                // all interpolation pixels inside image
+                                if (!highQuality) {
+                                    transformed->r(y, x) = vignmul * (original->r(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->r(yc, xc + 1) * Dx * (1.0 - Dy) + original->r(yc + 1, xc) * (1.0 - Dx) * Dy + original->r(yc + 1, xc + 1) * Dx * Dy);
+                                    transformed->g(y, x) = vignmul * (original->g(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->g(yc, xc + 1) * Dx * (1.0 - Dy) + original->g(yc + 1, xc) * (1.0 - Dx) * Dy + original->g(yc + 1, xc + 1) * Dx * Dy);
+                                    transformed->b(y, x) = vignmul * (original->b(yc, xc) * (1.0 - Dx) * (1.0 - Dy) + original->b(yc, xc + 1) * Dx * (1.0 - Dy) + original->b(yc + 1, xc) * (1.0 - Dx) * Dy + original->b(yc + 1, xc + 1) * Dx * Dy);
+                                } else if (!useLog) {
+                                    if (enableCA) {
+                                        interpolateTransformChannelsCubic(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
+                                    } else {
+                                        interpolateTransformCubic(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+                                    }
+                                } else {
+                                    if (enableCA) {
+                                        interpolateTransformChannelsCubicLog(chOrig[c], xc - 1, yc - 1, Dx, Dy, chTrans[c][y][x], vignmul);
+                                    } else {
+                                        interpolateTransformCubicLog(original, xc - 1, yc - 1, Dx, Dy, transformed->r(y, x), transformed->g(y, x), transformed->b(y, x), vignmul);
+                                    }
+                                }
                             } else {
-                                transformed->r(y, x) = vignmul * xexpf(original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
-                                transformed->g(y, x) = vignmul * xexpf(original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
-                                transformed->b(y, x) = vignmul * xexpf(original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                                // edge pixels
+                                const int y1 = LIM(yc, 0, original->getHeight() - 1);
+                                const int y2 = LIM(yc + 1, 0, original->getHeight() - 1);
+                                const int x1 = LIM(xc, 0, original->getWidth() - 1);
+                                const int x2 = LIM(xc + 1, 0, original->getWidth() - 1);
+
+                                if (useLog) {
+                                    if (enableCA) {
+                                        chTrans[c][y][x] = vignmul * xexpf(chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                                    } else {
+                                        transformed->r(y, x) = vignmul * xexpf(original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
+                                        transformed->g(y, x) = vignmul * xexpf(original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
+                                        transformed->b(y, x) = vignmul * xexpf(original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                                    }
+                                } else {
+                                    if (enableCA) {
+                                        chTrans[c][y][x] = vignmul * (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                                    } else {
+                                        transformed->r(y, x) = vignmul * (original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
+                                        transformed->g(y, x) = vignmul * (original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
+                                        transformed->b(y, x) = vignmul * (original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                                    }
+                                }
                             }
                         } else {
                             if (enableCA) {
-                                chTrans[c][y][x] = vignmul * (chOrig[c][y1][x1] * (1.0 - Dx) * (1.0 - Dy) + chOrig[c][y1][x2] * Dx * (1.0 - Dy) + chOrig[c][y2][x1] * (1.0 - Dx) * Dy + chOrig[c][y2][x2] * Dx * Dy);
+                                // not valid (source pixel x,y not inside source image, etc.)
+                                chTrans[c][y][x] = 0;
                             } else {
-                                transformed->r(y, x) = vignmul * (original->r(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->r(y1, x2) * Dx * (1.0 - Dy) + original->r(y2, x1) * (1.0 - Dx) * Dy + original->r(y2, x2) * Dx * Dy);
-                                transformed->g(y, x) = vignmul * (original->g(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->g(y1, x2) * Dx * (1.0 - Dy) + original->g(y2, x1) * (1.0 - Dx) * Dy + original->g(y2, x2) * Dx * Dy);
-                                transformed->b(y, x) = vignmul * (original->b(y1, x1) * (1.0 - Dx) * (1.0 - Dy) + original->b(y1, x2) * Dx * (1.0 - Dy) + original->b(y2, x1) * (1.0 - Dx) * Dy + original->b(y2, x2) * Dx * Dy);
+                                transformed->r(y, x) = 0;
+                                transformed->g(y, x) = 0;
+                                transformed->b(y, x) = 0;
                             }
                         }
                     }
-                } else {
-                    if (enableCA) {
-                        // not valid (source pixel x,y not inside source image, etc.)
-                        chTrans[c][y][x] = 0;
-                    } else {
-                        transformed->r(y, x) = 0;
-                        transformed->g(y, x) = 0;
-                        transformed->b(y, x) = 0;
-                    }
                 }
             }
         }
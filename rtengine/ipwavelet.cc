@@ -1597,6 +1597,11 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
         }
     }
 
+    if (settings->verbose) {
+        const WaveletBufferPool::Statistics poolStats = WaveletBufferPool::getInstance().getStatistics();
+        printf("Wavelet buffer pool: %zu allocations, %zu reuses, %zu evictions, %zu MB cached\n", poolStats.allocations, poolStats.reuses, poolStats.evictions, poolStats.cachedBytes >> 20);
+    }
+
 #ifdef _DEBUG
     delete MunsDebugInfo;
 #endif
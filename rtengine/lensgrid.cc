@@ -0,0 +1,143 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lensgrid.h"
+
+namespace
+{
+
+// Distance of the grid nodes in pixels. Lens CA models are low order polynomials of the radius,
+// the bilinear interpolation error at this spacing stays in the hundredths of a pixel.
+constexpr int gridStep = 16;
+
+}
+
+rtengine::LensCorrectionGrid::LensCorrectionGrid(
+    const std::shared_ptr<const LensCorrection>& correction,
+    int width,
+    int height
+) :
+    correction(correction),
+    gridWidth(width / gridStep + 2),
+    gridHeight(height / gridStep + 2)
+{
+    if (!correction->isCACorrectionAvailable()) {
+        return;
+    }
+
+    ca.resize(6 * gridWidth * gridHeight);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 4)
+#endif
+
+    for (int i = 0; i < gridHeight; ++i) {
+        for (int j = 0; j < gridWidth; ++j) {
+            const int node = i * gridWidth + j;
+
+            for (int c = 0; c < 3; ++c) {
+                double x = j * gridStep;
+                double y = i * gridStep;
+                correction->correctCA(x, y, 0, 0, c);
+                ca[6 * node + 2 * c] = x;
+                ca[6 * node + 2 * c + 1] = y;
+            }
+        }
+    }
+}
+
+void rtengine::LensCorrectionGrid::correctDistortion(double &x, double &y, int cx, int cy, double scale) const
+{
+    correction->correctDistortion(x, y, cx, cy, scale);
+}
+
+bool rtengine::LensCorrectionGrid::isCACorrectionAvailable() const
+{
+    return correction->isCACorrectionAvailable();
+}
+
+void rtengine::LensCorrectionGrid::correctCA(double &x, double &y, int cx, int cy, int channel) const
+{
+    double resX, resY;
+
+    // both corrections satisfy f(x, y, cx, cy) = f(x + cx, y + cy, 0, 0) - (cx, cy)
+    if (interpolate(ca, 3, channel, x + cx, y + cy, resX, resY)) {
+        x = resX - cx;
+        y = resY - cy;
+    } else {
+        correction->correctCA(x, y, cx, cy, channel);
+    }
+}
+
+void rtengine::LensCorrectionGrid::processVignette(int width, int height, float** rawData) const
+{
+    correction->processVignette(width, height, rawData);
+}
+
+void rtengine::LensCorrectionGrid::processVignette3Channels(int width, int height, float** rawData) const
+{
+    correction->processVignette3Channels(width, height, rawData);
+}
+
+bool rtengine::LensCorrectionGrid::interpolate(const std::vector<float>& samples, int components, int component, double x, double y, double& resX, double& resY) const
+{
+    if (samples.empty() || x < 0.0 || y < 0.0) {
+        return false;
+    }
+
+    const double gx = x / gridStep;
+    const double gy = y / gridStep;
+    const int j = gx;
+    const int i = gy;
+
+    if (j >= gridWidth - 1 || i >= gridHeight - 1) {
+        return false;
+    }
+
+    const double fx = gx - j;
+    const double fy = gy - i;
+    const int stride = 2 * components;
+    const float* const top = samples.data() + (i * gridWidth + j) * stride + 2 * component;
+    const float* const bottom = top + gridWidth * stride;
+
+    resX = (1.0 - fy) * ((1.0 - fx) * top[0] + fx * top[stride]) + fy * ((1.0 - fx) * bottom[0] + fx * bottom[stride]);
+    resY = (1.0 - fy) * ((1.0 - fx) * top[1] + fx * top[stride + 1]) + fy * ((1.0 - fx) * bottom[1] + fx * bottom[stride + 1]);
+
+    return true;
+}
+
+rtengine::LensCorrectionGridStore& rtengine::LensCorrectionGridStore::getInstance()
+{
+    static LensCorrectionGridStore instance;
+    return instance;
+}
+
+std::shared_ptr<const rtengine::LensCorrectionGrid> rtengine::LensCorrectionGridStore::get(const std::string& key) const
+{
+    std::shared_ptr<const LensCorrectionGrid> grid;
+    cache.get(key, grid);
+    return grid;
+}
+
+void rtengine::LensCorrectionGridStore::put(const std::string& key, const std::shared_ptr<const LensCorrectionGrid>& grid)
+{
+    cache.set(key, grid);
+}
+
+rtengine::LensCorrectionGridStore::LensCorrectionGridStore() :
+    cache(8)
+{
+}
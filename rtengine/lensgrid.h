@@ -0,0 +1,89 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "lcp.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Lens CA correction sampled on a coarse grid
+ *
+ * Evaluating the lensfun or LCP CA correction is expensive (lensfun even computes all three
+ * channels to return one of them), and the CA pass of transform() needs it for every pixel.
+ * The models are smooth, so this class evaluates the wrapped correction once per grid node over
+ * the full frame and interpolates bilinearly in between. Positions outside of the frame are
+ * passed to the wrapped correction.
+ *
+ * Distortion and vignetting are always passed through. transformGeneral() samples the composite
+ * mapping including the exact distortion itself, sampling it here as well would add the errors.
+ */
+class LensCorrectionGrid final :
+    public LensCorrection,
+    public NonCopyable
+{
+public:
+    LensCorrectionGrid(
+        const std::shared_ptr<const LensCorrection>& correction,
+        int width,
+        int height
+    );
+
+    void correctDistortion(double &x, double &y, int cx, int cy, double scale) const override;
+    bool isCACorrectionAvailable() const override;
+    void correctCA(double &x, double &y, int cx, int cy, int channel) const override;
+    void processVignette(int width, int height, float** rawData) const override;
+    void processVignette3Channels(int width, int height, float** rawData) const override;
+
+private:
+    bool interpolate(const std::vector<float>& samples, int components, int component, double x, double y, double& resX, double& resY) const;
+
+    std::shared_ptr<const LensCorrection> correction;
+    int gridWidth;
+    int gridHeight;
+    std::vector<float> ca; // x, y per channel per node
+};
+
+/**
+ * @brief Keeps the recently used lens correction grids
+ *
+ * Keyed by a description of the lens correction (profile, shot settings, frame size and
+ * orientation), so batches of images from the same lens sample their grid once.
+ */
+class LensCorrectionGridStore final :
+    public NonCopyable
+{
+public:
+    static LensCorrectionGridStore& getInstance();
+
+    std::shared_ptr<const LensCorrectionGrid> get(const std::string& key) const;
+    void put(const std::string& key, const std::shared_ptr<const LensCorrectionGrid>& grid);
+
+private:
+    LensCorrectionGridStore();
+
+    mutable Cache<std::string, std::shared_ptr<const LensCorrectionGrid>> cache;
+};
+
+}
@@ -17,13 +17,22 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cstring>
+#include <exception>
+#include <future>
+#include <list>
 #include <memory>
 #include <new>
+#include <string>
+#include <tuple>
 
 #include "rawimagesource.h"
+#include "noncopyable.h"
 #include "procparams.h"
 #include "rawimage.h"
+#include "../rtgui/options.h"
+#include "../rtgui/threadutils.h"
 //#define BENCHMARK
 //#include "StopWatch.h"
 #include "opthelper.h"
@@ -258,6 +267,98 @@ void cfaboxblur(const float* const * riFlatFile, float* cfablur, int boxH, int b
     }
 }
 
+/*
+ * The blurred flat field only depends on the flat field and the blur settings, so it is kept
+ * for the next image corrected with the same flat (batches of images from the same session).
+ * Least recently used maps are dropped when the cache exceeds options.flatFieldCacheMemory,
+ * a map in use by a running correction stays valid through its shared_ptr. A map is blurred
+ * once, concurrent jobs needing it while it is computed wait for it.
+ */
+class FlatFieldBlurCache final :
+    public rtengine::NonCopyable
+{
+public:
+    static FlatFieldBlurCache& getInstance()
+    {
+        static FlatFieldBlurCache instance;
+        return instance;
+    }
+
+    std::shared_ptr<const float> get(const rtengine::RawImage* flatField, int boxH, int boxW, int H, int W)
+    {
+        const Key key(flatField, flatField->get_filename(), boxH, boxW, H, W);
+        std::promise<Map> promise;
+
+        {
+            MyMutex::MyLock lock(mutex);
+
+            for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+                if (entry->first == key) {
+                    entries.splice(entries.begin(), entries, entry);
+                    const std::shared_future<Map> map = entries.front().second;
+                    lock.release();
+                    // waits if another job is still blurring this map
+                    return map.get();
+                }
+            }
+
+            entries.emplace_front(key, promise.get_future().share());
+            cachedBytes += getBytes(key);
+
+            const std::size_t maxCachedBytes = static_cast<std::size_t>(std::max(options.flatFieldCacheMemory, 0)) << 20;
+
+            while (cachedBytes > maxCachedBytes && entries.size() > 1) {
+                cachedBytes -= getBytes(entries.back().first);
+                entries.pop_back();
+            }
+        }
+
+        // blur without holding the lock, a concurrent job might need another map
+        try {
+            const std::shared_ptr<float> blurred(new float[H * W], std::default_delete<float[]>());
+            cfaboxblur(flatField->data, blurred.get(), boxH, boxW, H, W);
+            promise.set_value(blurred);
+            return blurred;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            remove(key);
+            throw;
+        }
+    }
+
+private:
+    // flat field, its file name (the address alone could be reused after a rescan), boxH, boxW, H, W
+    using Key = std::tuple<const rtengine::RawImage*, std::string, int, int, int, int>;
+    using Map = std::shared_ptr<const float>;
+
+    FlatFieldBlurCache() :
+        cachedBytes(0)
+    {
+    }
+
+    static std::size_t getBytes(const Key& key)
+    {
+        return static_cast<std::size_t>(std::get<4>(key)) * std::get<5>(key) * sizeof(float);
+    }
+
+    void remove(const Key& key)
+    {
+        MyMutex::MyLock lock(mutex);
+
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (entry->first == key) {
+                cachedBytes -= getBytes(key);
+                entries.erase(entry);
+                return;
+            }
+        }
+    }
+
+    std::list<std::pair<Key, std::shared_future<Map>>> entries; // most recently used first
+    std::size_t cachedBytes;
+    MyMutex mutex;
+};
+
 }
 
 namespace rtengine
@@ -266,21 +367,24 @@ namespace rtengine
 void RawImageSource::processFlatField(const procparams::RAWParams &raw, const RawImage *riFlatFile, const float black[4])
 {
 //    BENCHFUN
-    std::unique_ptr<float[]> cfablur(new float[H * W]);
+    FlatFieldBlurCache& blurCache = FlatFieldBlurCache::getInstance();
+    std::shared_ptr<const float> cfablurMap;
 
     const int BS = raw.ff_BlurRadius + (raw.ff_BlurRadius & 1);
 
     if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::V)) {
-        cfaboxblur(riFlatFile->data, cfablur.get(), 2 * BS, 0, H, W);
+        cfablurMap = blurCache.get(riFlatFile, 2 * BS, 0, H, W);
     } else if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::H)) {
-        cfaboxblur(riFlatFile->data, cfablur.get(), 0, 2 * BS, H, W);
+        cfablurMap = blurCache.get(riFlatFile, 0, 2 * BS, H, W);
     } else if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::VH)) {
         //slightly more complicated blur if trying to correct both vertical and horizontal anomalies
-        cfaboxblur(riFlatFile->data, cfablur.get(), BS, BS, H, W);    //first do area blur to correct vignette
+        cfablurMap = blurCache.get(riFlatFile, BS, BS, H, W);    //first do area blur to correct vignette
     } else { //(raw.ff_BlurType == RAWParams::getFlatFieldBlurTypeString(RAWParams::area_ff))
-        cfaboxblur(riFlatFile->data, cfablur.get(), BS, BS, H, W);
+        cfablurMap = blurCache.get(riFlatFile, BS, BS, H, W);
     }
 
+    const float* const cfablur = cfablurMap.get();
+
     if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
         float refcolor[2][2];
 
@@ -465,11 +569,11 @@ void RawImageSource::processFlatField(const procparams::RAWParams &raw, const Ra
     }
 
     if (raw.ff_BlurType == procparams::RAWParams::getFlatFieldBlurTypeString(procparams::RAWParams::FlatFieldBlurType::VH)) {
-        std::unique_ptr<float []> cfablur1(new float[H * W]);
-        std::unique_ptr<float []> cfablur2(new float[H * W]);
         //slightly more complicated blur if trying to correct both vertical and horizontal anomalies
-        cfaboxblur(riFlatFile->data, cfablur1.get(), 0, 2 * BS, H, W); //now do horizontal blur
-        cfaboxblur(riFlatFile->data, cfablur2.get(), 2 * BS, 0, H, W); //now do vertical blur
+        const std::shared_ptr<const float> cfablur1Map = blurCache.get(riFlatFile, 0, 2 * BS, H, W); //now do horizontal blur
+        const std::shared_ptr<const float> cfablur2Map = blurCache.get(riFlatFile, 2 * BS, 0, H, W); //now do vertical blur
+        const float* const cfablur1 = cfablur1Map.get();
+        const float* const cfablur2 = cfablur2Map.get();
 
         if (ri->getSensorType() == ST_BAYER || ri->get_colors() == 1) {
             unsigned int c[2][2] {};
@@ -462,6 +462,12 @@ RawImageSource::RawImageSource ()
     , blueCache(nullptr)
     , rawDirty(true)
     , histMatchingParams(new procparams::ColorManagementParams)
+    , aeHistogramCacheValid(false)
+    , captureSharpeningRadiusCache(0.0)
+    , captureSharpeningRadiusCacheValid(false)
+    , captureSharpeningBlendCacheValid(false)
+    , captureSharpeningBlendAutoContrast(false)
+    , captureSharpeningBlendContrast(0.f)
 {
     embProfile = nullptr;
     rgbSourceModified = false;
@@ -1249,6 +1255,10 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
     MyTime t1, t2;
     t1.set();
 
+    aeHistogramCacheValid = false;
+    captureSharpeningRadiusCacheValid = false;
+    captureSharpeningBlendCacheValid = false;
+
     Glib::ustring newDF = raw.dark_frame;
     RawImage *rid = nullptr;
 
@@ -1564,6 +1574,8 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
     MyTime t1, t2;
     t1.set();
 
+    captureSharpeningBlendCacheValid = false;
+
     if (ri->getSensorType() == ST_BAYER) {
         if (raw.bayersensor.method == RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::HPHD)) {
             hphd_demosaic ();
@@ -1672,6 +1684,7 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
         greenCache = nullptr;
         delete blueCache;
         blueCache = nullptr;
+        captureSharpeningBlendCache.reset();
     }
     if (settings->verbose) {
         if (getSensorType() == ST_BAYER) {
@@ -2380,6 +2393,10 @@ void RawImageSource::flush()
     if (blueloc) {
         blueloc(0, 0);
     }
+
+    // the histogram describes the raw data freed above
+    aeHistogramCache.reset();
+    aeHistogramCacheValid = false;
 }
 
 void RawImageSource::HLRecovery_Global(const ToneCurveParams &hrp)
@@ -3644,6 +3661,11 @@ void RawImageSource::getAutoExpHistogram (LUTu & histogram, int& histcompr)
 //    BENCHFUN
     histcompr = 3;
 
+    if (aeHistogramCacheValid) {
+        histogram = aeHistogramCache;
+        return;
+    }
+
     histogram(65536 >> histcompr);
     histogram.clear();
     const float refwb[3] = {static_cast<float>(refwb_red  / (1 << histcompr)), static_cast<float>(refwb_green / (1 << histcompr)), static_cast<float>(refwb_blue / (1 << histcompr))};
@@ -3718,6 +3740,9 @@ void RawImageSource::getAutoExpHistogram (LUTu & histogram, int& histcompr)
             histogram += tmphistogram;
         }
     }
+
+    aeHistogramCache = histogram;
+    aeHistogramCacheValid = true;
 }
 
 // Histogram MUST be 256 in size; gamma is applied, blackpoint and gain also
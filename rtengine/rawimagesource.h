@@ -107,6 +107,19 @@ protected:
     std::vector<double> histMatchingCache;
     const std::unique_ptr<procparams::ColorManagementParams> histMatchingParams;
 
+    // histogram of rawData for auto exposure, shared by all auto tools until the next preprocess()
+    LUTu aeHistogramCache;
+    bool aeHistogramCacheValid;
+
+    // auto radius of capture sharpening, valid until the next preprocess()
+    double captureSharpeningRadiusCache;
+    bool captureSharpeningRadiusCacheValid;
+    // blend mask of capture sharpening and the contrast it was built with, kept while demosaic() caches its result
+    std::unique_ptr<array2D<float>> captureSharpeningBlendCache;
+    bool captureSharpeningBlendCacheValid;
+    bool captureSharpeningBlendAutoContrast;
+    float captureSharpeningBlendContrast;
+
     void processFalseColorCorrectionThread (Imagefloat* im, array2D<float> &rbconv_Y, array2D<float> &rbconv_I, array2D<float> &rbconv_Q, array2D<float> &rbout_I, array2D<float> &rbout_Q, const int row_from, const int row_to);
     void hlRecovery          (const std::string &method, float* red, float* green, float* blue, int width, float* hlmax);
     void transformRect       (const PreviewProps &pp, int tran, int &sx1, int &sy1, int &width, int &height, int &fw);
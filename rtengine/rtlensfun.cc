@@ -442,11 +442,17 @@ LFCamera LFDatabase::findCamera(const Glib::ustring &make, const Glib::ustring &
     LFCamera ret;
     if (data_) {
         MyMutex::MyLock lock(lfDBMutex);
+        const auto match = cameraMatches.find(std::make_pair(make.raw(), model.raw()));
+        if (match != cameraMatches.end()) {
+            ret.data_ = match->second;
+            return ret;
+        }
         auto found = data_->FindCamerasExt(make.c_str(), model.c_str());
         if (found) {
             ret.data_ = found[0];
             lf_free(found);
         }
+        cameraMatches[std::make_pair(make.raw(), model.raw())] = ret.data_;
     }
     return ret;
 }
@@ -457,6 +463,11 @@ LFLens LFDatabase::findLens(const LFCamera &camera, const Glib::ustring &name) c
     LFLens ret;
     if (data_) {
         MyMutex::MyLock lock(lfDBMutex);
+        const auto match = lensMatches.find(std::make_pair(camera.data_, name.raw()));
+        if (match != lensMatches.end()) {
+            ret.data_ = match->second;
+            return ret;
+        }
         auto found = data_->FindLenses(camera.data_, nullptr, name.c_str());
         for (size_t pos = 0; !found && pos < name.size(); ) {
             // try to split the maker from the model of the lens -- we have to
@@ -483,6 +494,7 @@ LFLens LFDatabase::findLens(const LFCamera &camera, const Glib::ustring &name) c
             ret.data_ = found[0];
             lf_free(found);
         }
+        lensMatches[std::make_pair(camera.data_, name.raw())] = ret.data_;
     }
     return ret;
 }
@@ -538,9 +550,12 @@ std::unique_ptr<LFModifier> LFDatabase::findModifier(
     }
 
     const std::string key = (make + model + lens).collate_key();
-    if (notFound.find(key) != notFound.end()) {
-        // This combination was not found => do not search again
-        return nullptr;
+    {
+        MyMutex::MyLock lock(lfDBMutex);
+        if (notFound.find(key) != notFound.end()) {
+            // This combination was not found => do not search again
+            return nullptr;
+        }
     }
 
     const LFCamera c = findCamera(make, model);
@@ -581,6 +596,7 @@ std::unique_ptr<LFModifier> LFDatabase::findModifier(
     }
 
     if (!ret) {
+        MyMutex::MyLock lock(lfDBMutex);
         notFound.insert(key);
     }
 
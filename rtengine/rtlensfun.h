@@ -20,8 +20,11 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <glibmm/ustring.h>
@@ -142,6 +145,9 @@ private:
     static LFDatabase instance_;
     lfDatabase *data_;
     mutable std::set<std::string> notFound;
+    // lensfun's fuzzy matching is slow and every transform asks for the same camera and lens again
+    mutable std::map<std::pair<std::string, std::string>, const lfCamera *> cameraMatches;
+    mutable std::map<std::pair<const lfCamera *, std::string>, const lfLens *> lensMatches;
 };
 
 } // namespace rtengine
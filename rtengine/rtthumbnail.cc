@@ -17,8 +17,10 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <clocale>
+#include <vector>
 
 #include <lcms2.h>
+#include <zlib.h>
 
 #include <glib/gstdio.h>
 
@@ -1915,6 +1917,180 @@ unsigned char* Thumbnail::getGrayscaleHistEQ (int trim_width)
     return tmpdata;
 }
 
+namespace
+{
+
+// Compressed thumbnail image file:
+//   "RTTI\n", then guint32 version, type, width, height, payload size, compressed size,
+//   then the zlib compressed payload.
+// The payload holds the red, green and blue planes one after the other. Samples are stored as
+// the difference to their left neighbour, 16 bit planes with all low bytes before all high bytes.
+// Imagefloat samples are stored as half floats (in 0..1 range to keep the headroom), which is
+// plenty for a thumbnail and halves the size before compression.
+// Files not starting with the magic are read as the legacy uncompressed dump.
+constexpr char rttiMagic[] = "RTTI";
+constexpr guint32 rttiVersion = 1;
+
+enum : guint32 {
+    RTTI_IMAGE8 = 0,
+    RTTI_IMAGE16 = 1,
+    RTTI_IMAGEFLOAT = 2
+};
+
+template<typename T, typename F>
+void packPlane (int width, int height, F sample, unsigned char* dst)
+{
+    const std::size_t planeSize = static_cast<std::size_t>(width) * height;
+    std::size_t k = 0;
+
+    for (int i = 0; i < height; ++i) {
+        T prev = 0;
+
+        for (int j = 0; j < width; ++j, ++k) {
+            const T value = sample (i, j);
+            const T delta = value - prev;
+            prev = value;
+            dst[k] = delta & 0xff;
+
+            if (sizeof(T) == 2) {
+                dst[planeSize + k] = delta >> 8;
+            }
+        }
+    }
+}
+
+template<typename T, typename F>
+void unpackPlane (int width, int height, const unsigned char* src, F store)
+{
+    const std::size_t planeSize = static_cast<std::size_t>(width) * height;
+    std::size_t k = 0;
+
+    for (int i = 0; i < height; ++i) {
+        T value = 0;
+
+        for (int j = 0; j < width; ++j, ++k) {
+            const T delta = sizeof(T) == 2 ? src[k] | (src[planeSize + k] << 8) : src[k];
+            value += delta;
+            store (i, j, value);
+        }
+    }
+}
+
+bool writeCompressedImage (FILE* f, const ImageIO* thumbImg)
+{
+    const int width = thumbImg->getWidth();
+    const int height = thumbImg->getHeight();
+    const std::size_t planeSize = static_cast<std::size_t>(width) * height;
+
+    guint32 type;
+    std::size_t bytesPerSample;
+
+    if (thumbImg->getType() == sImage8) {
+        type = RTTI_IMAGE8;
+        bytesPerSample = 1;
+    } else if (thumbImg->getType() == sImage16) {
+        type = RTTI_IMAGE16;
+        bytesPerSample = 2;
+    } else if (thumbImg->getType() == sImagefloat) {
+        type = RTTI_IMAGEFLOAT;
+        bytesPerSample = 2;
+    } else {
+        return false;
+    }
+
+    const std::size_t planeBytes = planeSize * bytesPerSample;
+    std::vector<unsigned char> payload(3 * planeBytes);
+
+    if (type == RTTI_IMAGE8) {
+        const Image8* image = static_cast<const Image8*> (thumbImg);
+        packPlane<unsigned char> (width, height, [image](int i, int j) { return image->r(i, j); }, payload.data());
+        packPlane<unsigned char> (width, height, [image](int i, int j) { return image->g(i, j); }, payload.data() + planeBytes);
+        packPlane<unsigned char> (width, height, [image](int i, int j) { return image->b(i, j); }, payload.data() + 2 * planeBytes);
+    } else if (type == RTTI_IMAGE16) {
+        const Image16* image = static_cast<const Image16*> (thumbImg);
+        packPlane<unsigned short> (width, height, [image](int i, int j) { return image->r(i, j); }, payload.data());
+        packPlane<unsigned short> (width, height, [image](int i, int j) { return image->g(i, j); }, payload.data() + planeBytes);
+        packPlane<unsigned short> (width, height, [image](int i, int j) { return image->b(i, j); }, payload.data() + 2 * planeBytes);
+    } else {
+        const Imagefloat* image = static_cast<const Imagefloat*> (thumbImg);
+        constexpr float scale = 1.f / 65535.f;
+        packPlane<unsigned short> (width, height, [image, scale](int i, int j) { return image->DNG_FloatToHalf(image->r(i, j) * scale); }, payload.data());
+        packPlane<unsigned short> (width, height, [image, scale](int i, int j) { return image->DNG_FloatToHalf(image->g(i, j) * scale); }, payload.data() + planeBytes);
+        packPlane<unsigned short> (width, height, [image, scale](int i, int j) { return image->DNG_FloatToHalf(image->b(i, j) * scale); }, payload.data() + 2 * planeBytes);
+    }
+
+    uLongf compressedSize = compressBound (payload.size());
+    std::vector<unsigned char> compressed(compressedSize);
+
+    // fastest level, decoding speed does not depend on it
+    if (compress2 (compressed.data(), &compressedSize, payload.data(), payload.size(), Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    const guint32 header[6] = {rttiVersion, type, guint32(width), guint32(height), guint32(payload.size()), guint32(compressedSize)};
+
+    fputs (rttiMagic, f);
+    fputc ('\n', f);
+    fwrite (header, sizeof (guint32), 6, f);
+    fwrite (compressed.data(), 1, compressedSize, f);
+
+    return !ferror (f);
+}
+
+ImageIO* readCompressedImage (FILE* f)
+{
+    guint32 header[6];
+
+    if (fread (header, sizeof (guint32), 6, f) < 6 || header[0] != rttiVersion) {
+        return nullptr;
+    }
+
+    const guint32 type = header[1];
+    const int width = header[2];
+    const int height = header[3];
+    const std::size_t planeSize = static_cast<std::size_t>(width) * height;
+    const std::size_t planeBytes = planeSize * (type == RTTI_IMAGE8 ? 1 : 2);
+
+    if (width <= 0 || height <= 0 || type > RTTI_IMAGEFLOAT || header[4] != 3 * planeBytes) {
+        return nullptr;
+    }
+
+    std::vector<unsigned char> compressed(header[5]);
+
+    if (fread (compressed.data(), 1, compressed.size(), f) < compressed.size()) {
+        return nullptr;
+    }
+
+    std::vector<unsigned char> payload(header[4]);
+    uLongf payloadSize = payload.size();
+
+    if (uncompress (payload.data(), &payloadSize, compressed.data(), compressed.size()) != Z_OK || payloadSize != payload.size()) {
+        return nullptr;
+    }
+
+    if (type == RTTI_IMAGE8) {
+        Image8* image = new Image8(width, height);
+        unpackPlane<unsigned char> (width, height, payload.data(), [image](int i, int j, unsigned char v) { image->r(i, j) = v; });
+        unpackPlane<unsigned char> (width, height, payload.data() + planeBytes, [image](int i, int j, unsigned char v) { image->g(i, j) = v; });
+        unpackPlane<unsigned char> (width, height, payload.data() + 2 * planeBytes, [image](int i, int j, unsigned char v) { image->b(i, j) = v; });
+        return image;
+    } else if (type == RTTI_IMAGE16) {
+        Image16* image = new Image16(width, height);
+        unpackPlane<unsigned short> (width, height, payload.data(), [image](int i, int j, unsigned short v) { image->r(i, j) = v; });
+        unpackPlane<unsigned short> (width, height, payload.data() + planeBytes, [image](int i, int j, unsigned short v) { image->g(i, j) = v; });
+        unpackPlane<unsigned short> (width, height, payload.data() + 2 * planeBytes, [image](int i, int j, unsigned short v) { image->b(i, j) = v; });
+        return image;
+    } else {
+        Imagefloat* image = new Imagefloat(width, height);
+        unpackPlane<unsigned short> (width, height, payload.data(), [image](int i, int j, unsigned short v) { image->r(i, j) = image->DNG_HalfToFloat(v) * 65535.f; });
+        unpackPlane<unsigned short> (width, height, payload.data() + planeBytes, [image](int i, int j, unsigned short v) { image->g(i, j) = image->DNG_HalfToFloat(v) * 65535.f; });
+        unpackPlane<unsigned short> (width, height, payload.data() + 2 * planeBytes, [image](int i, int j, unsigned short v) { image->b(i, j) = image->DNG_HalfToFloat(v) * 65535.f; });
+        return image;
+    }
+}
+
+}
+
 bool Thumbnail::writeImage (const Glib::ustring& fname)
 {
 
@@ -1930,27 +2106,14 @@ bool Thumbnail::writeImage (const Glib::ustring& fname)
         return false;
     }
 
-    fwrite (thumbImg->getType(), sizeof (char), strlen (thumbImg->getType()), f);
-    fputc ('\n', f);
-    guint32 w = guint32 (thumbImg->getWidth());
-    guint32 h = guint32 (thumbImg->getHeight());
-    fwrite (&w, sizeof (guint32), 1, f);
-    fwrite (&h, sizeof (guint32), 1, f);
+    const bool success = writeCompressedImage (f, thumbImg);
+    fclose (f);
 
-    if (thumbImg->getType() == sImage8) {
-        Image8 *image = static_cast<Image8*> (thumbImg);
-        image->writeData (f);
-    } else if (thumbImg->getType() == sImage16) {
-        Image16 *image = static_cast<Image16*> (thumbImg);
-        image->writeData (f);
-    } else if (thumbImg->getType() == sImagefloat) {
-        Imagefloat *image = static_cast<Imagefloat*> (thumbImg);
-        image->writeData (f);
+    if (!success) {
+        g_remove (fullFName.c_str ());
     }
 
-    //thumbImg->writeData(f);
-    fclose (f);
-    return true;
+    return success;
 }
 
 bool Thumbnail::readImage (const Glib::ustring& fname)
@@ -1974,9 +2137,19 @@ bool Thumbnail::readImage (const Glib::ustring& fname)
     }
 
     char imgType[31];  // 30 -> arbitrary size, but should be enough for all image type's name
-    fgets(imgType, 30, f);
+    if (!fgets(imgType, 30, f)) {
+        fclose(f);
+        return false;
+    }
     imgType[strlen(imgType) - 1] = '\0'; // imgType has a \n trailing character, so we overwrite it by the \0 char
 
+    if (!strcmp(imgType, rttiMagic)) {
+        thumbImg = readCompressedImage(f);
+        fclose(f);
+        return thumbImg;
+    }
+
+    // legacy uncompressed file
     guint32 width, height;
 
     if (fread(&width, 1, sizeof(guint32), f) < sizeof(guint32)) {
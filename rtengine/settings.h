@@ -90,6 +90,7 @@ public:
     int             itcwb_delta;
     bool            itcwb_stdobserver10;
     int             itcwb_precis;
+    Glib::ustring   fftwWisdomFile;         ///< File used to keep FFTW plan wisdom between sessions, empty to disable
 
 
     enum class ThumbnailInspectorMode {
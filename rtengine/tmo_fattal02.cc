@@ -56,6 +56,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <limits>
@@ -67,6 +68,8 @@
 
 #include "array2D.h"
 #include "color.h"
+#include "fattalcache.h"
+#include "fftwplancache.h"
 #include "iccstore.h"
 #include "imagefloat.h"
 #include "improcfun.h"
@@ -85,8 +88,6 @@ namespace rtengine
  * RT code
  ******************************************************************************/
 
-extern MyMutex *fftwMutex;
-
 using namespace std;
 
 namespace
@@ -422,7 +423,8 @@ void tmo_fattal02 (size_t width,
                    float beta,
                    float noise,
                    int detail_level,
-                   bool multithread)
+                   bool multithread,
+                   FattalAttenuationCache* attenuationCache)
 {
 // #ifdef TIMER_PROFILING
 //     msec_timer stop_watch;
@@ -545,28 +547,36 @@ void tmo_fattal02 (size_t width,
 
     const int nlevels = 7; // RT -- see above
 
-    Array2Df* pyramids[nlevels];
-    pyramids[0] = H;
-    createGaussianPyramids (pyramids, nlevels, multithread);
+    Array2Df* FI = new Array2Df (width, height);
 
-    // calculate gradients and its average values on pyramid levels
-    Array2Df* gradients[nlevels];
-    float avgGrad[nlevels];
+    // RT - the attenuation only depends on the (scaled) H, reuse it if that didn't change
+    if (!attenuationCache || !attenuationCache->get (H->data(), width, height, alfa, beta, noise, detail_level, FI->data())) {
+        Array2Df* pyramids[nlevels];
+        pyramids[0] = H;
+        createGaussianPyramids (pyramids, nlevels, multithread);
+
+        // calculate gradients and its average values on pyramid levels
+        Array2Df* gradients[nlevels];
+        float avgGrad[nlevels];
+
+        for ( int k = 0 ; k < nlevels ; k++ ) {
+            gradients[k] = new Array2Df (pyramids[k]->getCols(), pyramids[k]->getRows());
+            avgGrad[k] = calculateGradients (pyramids[k], gradients[k], k, multithread);
+            if(k != 0) // pyramids[0] is H. Will be deleted later
+                delete pyramids[k];
+        }
 
-    for ( int k = 0 ; k < nlevels ; k++ ) {
-        gradients[k] = new Array2Df (pyramids[k]->getCols(), pyramids[k]->getRows());
-        avgGrad[k] = calculateGradients (pyramids[k], gradients[k], k, multithread);
-        if(k != 0) // pyramids[0] is H. Will be deleted later
-            delete pyramids[k];
-    }
 
+        // calculate fi matrix
+        calculateFiMatrix (FI, gradients, avgGrad, nlevels, detail_level, alfa, beta, noise, multithread);
 
-    // calculate fi matrix
-    Array2Df* FI = new Array2Df (width, height);
-    calculateFiMatrix (FI, gradients, avgGrad, nlevels, detail_level, alfa, beta, noise, multithread);
+        for ( int i = 0 ; i < nlevels ; i++ ) {
+            delete gradients[i];
+        }
 
-    for ( int i = 0 ; i < nlevels ; i++ ) {
-        delete gradients[i];
+        if (attenuationCache) {
+            attenuationCache->put (H->data(), width, height, alfa, beta, noise, detail_level, FI->data());
+        }
     }
 
     /** - RT - bring back the FI image to the input size if it was downscaled */
@@ -641,10 +651,7 @@ void tmo_fattal02 (size_t width,
     //delete Gx; // RT - reused as temp buffer in solve_pde_fft, deleted later
 
     // solve pde and exponentiate (ie recover compressed image)
-    {
-        MyMutex::MyLock lock (*fftwMutex);
-        solve_pde_fft (FI, &L, Gx, multithread);
-    }
+    solve_pde_fft (FI, &L, Gx, multithread);
     delete Gx;
     delete FI;
 
@@ -761,11 +768,10 @@ void transform_ev2normal (Array2Df *A, Array2Df *T, bool multithread)
     // fftwf_free(in);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d (height, width, A->data(), T->data(),
-                           FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute (p);
-    fftwf_destroy_plan (p);
+    // RT - the plan is owned by FFTWPlanCache and reused for all images of the same size
+    const fftwf_plan p = FFTWPlanCache::getInstance().getR2R2D (height, width, FFTW_REDFT00, FFTW_REDFT00,
+                         A->data(), T->data(), FFTW_ESTIMATE, multithread);
+    fftwf_execute_r2r (p, A->data(), T->data());
 }
 
 
@@ -777,11 +783,10 @@ void transform_normal2ev (Array2Df *A, Array2Df *T, bool multithread)
     assert ((int)T->getCols() == width && (int)T->getRows() == height);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d (height, width, A->data(), T->data(),
-                           FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute (p);
-    fftwf_destroy_plan (p);
+    // RT - the plan is owned by FFTWPlanCache and reused for all images of the same size
+    const fftwf_plan p = FFTWPlanCache::getInstance().getR2R2D (height, width, FFTW_REDFT00, FFTW_REDFT00,
+                         A->data(), T->data(), FFTW_ESTIMATE, multithread);
+    fftwf_execute_r2r (p, A->data(), T->data());
 
     // need to scale the output matrix to get the right transform
     float factor = (1.0f / ((height - 1) * (width - 1)));
@@ -872,17 +877,7 @@ void solve_pde_fft (Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread)/*
     assert ((int)U->getCols() == width && (int)U->getRows() == height);
     assert (buf->getCols() == width && buf->getRows() == height);
 
-    // activate parallel execution of fft routines
-#ifdef RT_FFTW3F_OMP
-
-    if (multithread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads ( omp_get_max_threads() );
-    }
-
-// #else
-//   fftwf_plan_with_nthreads( 2 );
-#endif
+    // RT - parallel execution of fft routines is set up by FFTWPlanCache
 
     // in general there might not be a solution to the Poisson pde
     // with Neumann boundary conditions unless the boundary satisfies
@@ -1048,7 +1043,72 @@ inline int find_fast_dim (int dim)
 } // namespace
 
 
-void ImProcFunctions::ToneMapFattal02 (Imagefloat *rgb)
+bool FattalAttenuationCache::get(const float* logLuminanceIn, int widthIn, int heightIn, float alphaIn, float betaIn, float noiseIn, int detailLevelIn, float* attenuationOut)
+{
+    const std::size_t size = static_cast<std::size_t>(widthIn) * heightIn;
+
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+        if (entry->width != widthIn || entry->height != heightIn || entry->detailLevel != detailLevelIn) {
+            continue;
+        }
+
+        // at most one entry per size and detail level
+        if (
+            alphaIn != entry->alpha
+            || betaIn != entry->beta
+            || noiseIn != entry->noise
+            || entry->logLuminance.size() != size
+            || std::memcmp(logLuminanceIn, entry->logLuminance.data(), size * sizeof(float))
+        ) {
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, entry);
+        std::copy(entries.front().attenuation.begin(), entries.front().attenuation.end(), attenuationOut);
+        return true;
+    }
+
+    return false;
+}
+
+void FattalAttenuationCache::put(const float* logLuminanceIn, int widthIn, int heightIn, float alphaIn, float betaIn, float noiseIn, int detailLevelIn, const float* attenuationIn)
+{
+    const std::size_t size = static_cast<std::size_t>(widthIn) * heightIn;
+
+    // replaces the entry of the same size and detail level, or the least recently used one if there are too many
+    auto entry = entries.begin();
+
+    while (entry != entries.end() && (entry->width != widthIn || entry->height != heightIn || entry->detailLevel != detailLevelIn)) {
+        ++entry;
+    }
+
+    if (entry == entries.end()) {
+        if (entries.size() < maxEntries) {
+            entries.emplace_front();
+        } else {
+            entries.splice(entries.begin(), entries, std::prev(entries.end()));
+        }
+    } else {
+        entries.splice(entries.begin(), entries, entry);
+    }
+
+    Entry& front = entries.front();
+    front.width = widthIn;
+    front.height = heightIn;
+    front.alpha = alphaIn;
+    front.beta = betaIn;
+    front.noise = noiseIn;
+    front.detailLevel = detailLevelIn;
+    front.logLuminance.assign(logLuminanceIn, logLuminanceIn + size);
+    front.attenuation.assign(attenuationIn, attenuationIn + size);
+}
+
+void FattalAttenuationCache::clear()
+{
+    entries.clear();
+}
+
+void ImProcFunctions::ToneMapFattal02 (Imagefloat *rgb, FattalAttenuationCache* attenuationCache)
 {
     if (!params->fattal.enabled) {
         return;
@@ -1130,7 +1190,7 @@ void ImProcFunctions::ToneMapFattal02 (Imagefloat *rgb)
     }
 
     rescale_nearest (Yr, L, multiThread);
-    tmo_fattal02 (w2, h2, L, L, alpha, beta, noise, detail_level, multiThread);
+    tmo_fattal02 (w2, h2, L, L, alpha, beta, noise, detail_level, multiThread, attenuationCache);
 
     const float hr = float(h2) / float(h);
     const float wr = float(w2) / float(w);
@@ -73,6 +73,25 @@ TagDirectory::TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib*
 
     for (int i = 0; i < numOfTags; i++) {
 
+        if (skipIgnored) {
+            // peek at the tag ID, so that the value (and possibly whole sub-directories) of tags
+            // which are dropped anyway is neither read nor parsed
+            const long entryPos = ftell (f);
+            const int id = get2 (f, order);
+
+            // tags whose parsing has side effects on other directories always go through the full path
+            if (id != TIFFTAG_SUBFILETYPE && id != 0x002e && id != 0xc634) {
+                const TagAttrib* attrib = getAttrib (id);
+
+                if (!attrib || attrib->ignore == 1 || (thumbdescr && attrib->ignore == 2)) {
+                    fseek (f, entryPos + 12, SEEK_SET);
+                    continue;
+                }
+            }
+
+            fseek (f, entryPos, SEEK_SET);
+        }
+
         Tag* newTag = new Tag (this, f, base);
 
         // filter out tags with unknown type
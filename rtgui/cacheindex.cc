@@ -0,0 +1,334 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "cacheindex.h"
+
+namespace
+{
+
+// Journal records are lines "<op>\t<time>\t<key>\n" with op being
+// 'T' (touch), 'D' (delete) or 'C' (clear, empty key)
+constexpr char opTouch = 'T';
+constexpr char opDelete = 'D';
+constexpr char opClear = 'C';
+
+std::int64_t now()
+{
+    return g_get_real_time() / G_USEC_PER_SEC;
+}
+
+}
+
+CacheIndex::CacheIndex() :
+    journal(nullptr),
+    records(0),
+    journalSize(-1),
+    journalInode(0)
+{
+}
+
+CacheIndex::~CacheIndex()
+{
+    close();
+}
+
+bool CacheIndex::open(const Glib::ustring& fname)
+{
+    close();
+
+    this->fname = fname;
+    entries.clear();
+    records = 0;
+
+    bool found = false;
+
+    if (FILE* const f = g_fopen(fname.c_str(), "rb")) {
+        found = true;
+
+        char line[4096];
+
+        while (fgets(line, sizeof(line), f)) {
+            const std::size_t length = std::strlen(line);
+
+            if (length < 4 || line[length - 1] != '\n' || line[1] != '\t') {
+                // truncated or garbled record, e.g. after a crash while writing
+                break;
+            }
+
+            line[length - 1] = 0;
+
+            char* const keyStart = std::strchr(line + 2, '\t');
+
+            if (!keyStart) {
+                break;
+            }
+
+            *keyStart = 0;
+            const std::int64_t time = g_ascii_strtoll(line + 2, nullptr, 10);
+            const std::string key(keyStart + 1);
+
+            switch (line[0]) {
+                case opTouch:
+                    entries[key] = time;
+                    break;
+
+                case opDelete:
+                    entries.erase(key);
+                    break;
+
+                case opClear:
+                    entries.clear();
+                    break;
+            }
+
+            ++records;
+        }
+
+        fclose(f);
+    }
+
+    journal = g_fopen(fname.c_str(), "ab");
+    updateJournalStat();
+
+    return found && journal;
+}
+
+void CacheIndex::reload()
+{
+    if (fname.empty()) {
+        return;
+    }
+
+    if (journal) {
+        // our own records are already counted in journalSize
+        fflush(journal);
+    }
+
+    std::int64_t size;
+    std::uint64_t inode;
+
+    if (statJournal(size, inode) && (size != journalSize || inode != journalInode)) {
+        open(fname);
+    }
+}
+
+void CacheIndex::close()
+{
+    if (journal) {
+        fclose(journal);
+        journal = nullptr;
+    }
+}
+
+bool CacheIndex::contains(const std::string& key) const
+{
+    return entries.count(key);
+}
+
+std::size_t CacheIndex::size() const
+{
+    return entries.size();
+}
+
+void CacheIndex::touch(const std::string& key)
+{
+    const std::int64_t time = now();
+    auto& lastUse = entries[key];
+
+    // a minute resolution is plenty for eviction and keeps the journal small when browsing
+    if (time - lastUse >= 60) {
+        lastUse = time;
+        append(opTouch, key, time);
+
+        if (journal) {
+            fflush(journal);
+        }
+    }
+}
+
+void CacheIndex::remove(const std::string& key)
+{
+    if (entries.erase(key)) {
+        append(opDelete, key, 0);
+
+        if (journal) {
+            fflush(journal);
+        }
+    }
+}
+
+void CacheIndex::rename(const std::string& oldKey, const std::string& newKey)
+{
+    const auto iterator = entries.find(oldKey);
+    const std::int64_t time = iterator != entries.end() ? iterator->second : now();
+
+    remove(oldKey);
+    entries[newKey] = time;
+    append(opTouch, newKey, time);
+
+    if (journal) {
+        fflush(journal);
+    }
+}
+
+void CacheIndex::clear()
+{
+    entries.clear();
+
+    // nothing of the old journal is needed anymore
+    close();
+    records = 0;
+    journal = g_fopen(fname.c_str(), "wb");
+    updateJournalStat();
+}
+
+void CacheIndex::insert(const std::string& key, std::int64_t time)
+{
+    entries[key] = time;
+    append(opTouch, key, time);
+}
+
+std::vector<std::string> CacheIndex::getOldest(std::size_t count) const
+{
+    using KeyTime = std::pair<const std::string*, std::int64_t>;
+
+    std::vector<KeyTime> all;
+    all.reserve(entries.size());
+
+    for (const auto& entry : entries) {
+        all.emplace_back(&entry.first, entry.second);
+    }
+
+    count = std::min(count, all.size());
+
+    std::nth_element(
+        all.begin(),
+        all.begin() + count,
+        all.end(),
+        [](const KeyTime& lhs, const KeyTime& rhs) -> bool
+        {
+            return lhs.second < rhs.second;
+        }
+    );
+
+    std::vector<std::string> result;
+    result.reserve(count);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        result.push_back(*all[i].first);
+    }
+
+    return result;
+}
+
+void CacheIndex::compact()
+{
+    if (records <= 2 * entries.size() + 1024) {
+        return;
+    }
+
+    write();
+}
+
+void CacheIndex::append(char op, const std::string& key, std::int64_t time)
+{
+    if (!journal || key.find_first_of("\t\n") != std::string::npos) {
+        return;
+    }
+
+    std::int64_t size;
+    std::uint64_t inode;
+
+    if (statJournal(size, inode) && inode != journalInode) {
+        // another instance compacted the journal, records appended to the old file would be lost.
+        // Append to the new one and have the next reload() pick up what the other instance wrote.
+        fclose(journal);
+        journal = g_fopen(fname.c_str(), "ab");
+
+        if (!journal) {
+            return;
+        }
+
+        journalSize = -1;
+        journalInode = inode;
+    }
+
+    const int written = fprintf(journal, "%c\t%" PRId64 "\t%s\n", op, time, key.c_str());
+
+    if (written > 0 && journalSize >= 0) {
+        journalSize += written;
+    }
+
+    ++records;
+}
+
+bool CacheIndex::write()
+{
+    close();
+
+    const Glib::ustring tmpName = fname + ".tmp";
+    FILE* const f = g_fopen(tmpName.c_str(), "wb");
+
+    if (f) {
+        for (const auto& entry : entries) {
+            if (entry.first.find_first_of("\t\n") == std::string::npos) {
+                fprintf(f, "%c\t%" PRId64 "\t%s\n", opTouch, entry.second, entry.first.c_str());
+            }
+        }
+
+        const bool success = !ferror(f);
+        fclose(f);
+
+        if (success && g_rename(tmpName.c_str(), fname.c_str()) == 0) {
+            records = entries.size();
+        } else {
+            g_remove(tmpName.c_str());
+        }
+    }
+
+    journal = g_fopen(fname.c_str(), "ab");
+    updateJournalStat();
+
+    return f && journal;
+}
+
+bool CacheIndex::statJournal(std::int64_t& size, std::uint64_t& inode) const
+{
+    GStatBuf buf;
+
+    if (g_stat(fname.c_str(), &buf) != 0) {
+        return false;
+    }
+
+    size = buf.st_size;
+    inode = buf.st_ino;
+    return true;
+}
+
+void CacheIndex::updateJournalStat()
+{
+    if (!statJournal(journalSize, journalInode)) {
+        journalSize = -1;
+        journalInode = 0;
+    }
+}
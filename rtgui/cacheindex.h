@@ -0,0 +1,93 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+#include "../rtengine/noncopyable.h"
+
+/**
+ * @brief Index of the entries stored in the thumbnail cache
+ *
+ * Maps the cache key of an image (file base name + "." + md5, as used for the cache file names)
+ * to the time it was last used. The index lives in memory and is persisted as an append-only
+ * journal: every change appends one line, the journal is rewritten only when it contains
+ * much more records than live entries.
+ *
+ * This gives O(1) lookup of whether an image has cache files at all, and lets the cache size
+ * limitation pick the least recently used entries without listing and stating the cache directory.
+ *
+ * Other instances sharing the cache append to the same journal. reload() rereads it when its size or
+ * inode differ from what this instance read and wrote itself, appending notices when another instance
+ * compacted the journal and switches to the new file.
+ *
+ * Only the index is shared, the entries themselves stay in the per-image files of the cache directory:
+ * rtengine::Thumbnail reads and writes its parts of them directly, and older versions share the directory.
+ *
+ * The class is not thread safe, CacheManager serializes access.
+ */
+class CacheIndex :
+    public rtengine::NonCopyable
+{
+public:
+    CacheIndex();
+    ~CacheIndex();
+
+    /** Loads the journal @p fname. Returns false if it doesn't exist or can't be opened for appending. */
+    bool open(const Glib::ustring& fname);
+    void close();
+    /** Rereads the journal if another process changed it since it was read. */
+    void reload();
+
+    bool contains(const std::string& key) const;
+    std::size_t size() const;
+
+    /** Marks @p key as used now. */
+    void touch(const std::string& key);
+    void remove(const std::string& key);
+    void rename(const std::string& oldKey, const std::string& newKey);
+    void clear();
+
+    /** Adds @p key with last use @p time (seconds since epoch), used to seed a new index. */
+    void insert(const std::string& key, std::int64_t time);
+
+    /** Returns the @p count least recently used keys. */
+    std::vector<std::string> getOldest(std::size_t count) const;
+
+    /** Rewrites the journal if it contains too many obsolete records. */
+    void compact();
+
+private:
+    void append(char op, const std::string& key, std::int64_t time);
+    bool write();
+    bool statJournal(std::int64_t& size, std::uint64_t& inode) const;
+    void updateJournalStat();
+
+    std::unordered_map<std::string, std::int64_t> entries;
+    Glib::ustring fname;
+    FILE* journal;
+    std::size_t records;
+    // size and inode of the journal as far as this instance knows
+    std::int64_t journalSize;
+    std::uint64_t journalInode;
+};
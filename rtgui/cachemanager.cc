@@ -40,7 +40,18 @@ namespace
 
 constexpr int cacheDirMode = 0777;
 constexpr const char* cacheDirs[] = { "profiles", "images", "embprofiles", "data" };
+constexpr std::size_t md5_size = 32;
 
+std::string getCacheKey (const Glib::ustring& fname, const std::string& md5)
+{
+    return Glib::path_get_basename (fname) + "." + md5;
+}
+
+}
+
+CacheManager::CacheManager () :
+    indexValid (false)
+{
 }
 
 CacheManager* CacheManager::getInstance ()
@@ -65,9 +76,38 @@ void CacheManager::init ()
     if (error != 0 && rtengine::settings->verbose) {
         std::cerr << "Failed to create all cache directories: " << g_strerror(errno) << std::endl;
     }
+
+    indexValid = index.open (Glib::build_filename (baseDir, "cacheindex"));
+    if (!indexValid) {
+        seedIndex ();
+    }
+}
+
+void CacheManager::seedIndex ()
+{
+    // first run with an index (or index lost): register the existing entries once,
+    // using the modification time of their data file as last use
+    try {
+        const auto dir = Gio::File::create_for_path (Glib::build_filename (baseDir, "data"));
+        const auto enumerator = dir->enumerate_children ("standard::name,time::modified");
+
+        while (const auto file = enumerator->next_file ()) {
+            const std::string name = file->get_name ();
+            if (name.size () >= md5_size + 5 && name.compare (name.size () - 4, 4, ".txt") == 0) {
+                index.insert (name.substr (0, name.size () - 4), file->modification_time ().tv_sec);
+            }
+        }
+
+        indexValid = true;
+
+    } catch (Glib::Exception&) {}
+
+    if (rtengine::settings->verbose) {
+        std::cout << "Thumbnail cache index created with " << index.size () << " entries" << std::endl;
+    }
 }
 
-Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
+Thumbnail* CacheManager::getEntry (const Glib::ustring& fname, bool deferGeneration)
 {
     std::unique_ptr<Thumbnail> thumbnail;
 
@@ -96,8 +136,12 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
     }
 
     const auto cacheName = getCacheFileName ("data", fname, ".txt", md5);
+    const auto cacheKey = getCacheKey (fname, md5);
 
-    // let's see if we have it in the cache
+    // let's see if we have it in the cache,
+    // the data file is tried even if the index doesn't know the key,
+    // another instance sharing the cache may have added it
+    bool cached = false;
     {
         CacheImageData imageData;
 
@@ -108,13 +152,15 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
             if (!thumbnail->isSupported ()) {
                 thumbnail.reset ();
             }
+
+            cached = static_cast<bool> (thumbnail);
         }
     }
 
     // if not, create a new one
     if (!thumbnail) {
 
-        thumbnail.reset (new Thumbnail (this, fname, md5));
+        thumbnail.reset (new Thumbnail (this, fname, md5, deferGeneration));
         if (!thumbnail->isSupported ()) {
             thumbnail.reset ();
         }
@@ -136,12 +182,24 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
 
         // it wasn't, create a new entry
         openEntries.emplace (fname, thumbnail.get ());
+
+        // a new thumbnail indexes itself once its data file is written, see touchEntry
+        if (cached) {
+            index.touch (cacheKey);
+        }
     }
 
     return thumbnail.release ();
 }
 
 
+void CacheManager::touchEntry (const Glib::ustring& fname, const std::string& md5)
+{
+    MyMutex::MyLock lock (mutex);
+
+    index.touch (getCacheKey (fname, md5));
+}
+
 void CacheManager::deleteEntry (const Glib::ustring& fname)
 {
     MyMutex::MyLock lock (mutex);
@@ -174,6 +232,8 @@ void CacheManager::deleteEntry (const Glib::ustring& fname)
 
 void CacheManager::clearFromCache (const Glib::ustring& fname, bool purge) const
 {
+    MyMutex::MyLock lock (mutex);
+
     deleteFiles (fname, getMD5 (fname), true, purge);
 }
 
@@ -192,6 +252,8 @@ void CacheManager::renameEntry (const std::string& oldfilename, const std::strin
         std::cerr << "Failed to rename all files for cache entry '" << oldfilename << "': " << g_strerror(errno) << std::endl;
     }
 
+    index.rename (getCacheKey (oldfilename, oldmd5), getCacheKey (newfilename, newmd5));
+
     // check if it is opened
     // if it is open, update md5
     const auto iterator = openEntries.find (oldfilename);
@@ -203,6 +265,10 @@ void CacheManager::renameEntry (const std::string& oldfilename, const std::strin
     openEntries.erase (iterator);
     openEntries.emplace (newfilename, thumbnail);
 
+    // saving locks the thumbnail, which may call back into
+    // CacheManager while generating, so we release the lock for it
+    lock.release ();
+
     thumbnail->setFileName (newfilename);
     thumbnail->updateCache ();
     thumbnail->saveThumbnail ();
@@ -221,6 +287,7 @@ void CacheManager::closeCache () const
     MyMutex::MyLock lock (mutex);
 
     applyCacheSizeLimitation ();
+    index.compact ();
 }
 
 void CacheManager::clearAll () const
@@ -230,6 +297,8 @@ void CacheManager::clearAll () const
     for (const auto& cacheDir : cacheDirs) {
         deleteDir (cacheDir);
     }
+
+    index.clear ();
 }
 
 void CacheManager::clearImages () const
@@ -239,6 +308,8 @@ void CacheManager::clearImages () const
     deleteDir ("data");
     deleteDir ("images");
     deleteDir ("embprofiles");
+
+    index.clear ();
 }
 
 void CacheManager::clearProfiles () const
@@ -277,6 +348,7 @@ void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& m
 
     if (purgeData) {
         error |= g_remove (getCacheFileName ("data", fname, ".txt", md5).c_str ());
+        index.remove (getCacheKey (fname, md5));
     }
 
     if (purgeProfile) {
@@ -336,6 +408,27 @@ Glib::ustring CacheManager::getCacheFileName (const Glib::ustring& subDir,
 
 void CacheManager::applyCacheSizeLimitation () const
 {
+    if (indexValid) {
+        // the index knows the entries and their last use, no need to look at the directory
+        index.reload ();
+
+        if (index.size () <= options.maxCacheEntries) {
+            return;
+        }
+
+        const std::size_t toDelete = index.size () - options.maxCacheEntries + options.maxCacheEntries * 5 / 100; // reserve 5% free cache space
+
+        for (const auto& key : index.getOldest (toDelete)) {
+            if (key.size () > md5_size) {
+                deleteFiles (key.substr (0, key.size () - md5_size - 1), key.substr (key.size () - md5_size), true, false);
+            } else {
+                index.remove (key);
+            }
+        }
+
+        return;
+    }
+
     // first count files without fetching file name and timestamp.
     auto cachedir = opendir(Glib::build_filename(baseDir, "data").c_str());
     if (!cachedir) {
@@ -361,7 +454,6 @@ void CacheManager::applyCacheSizeLimitation () const
     std::vector<FNameMTime> files;
     files.reserve(numFiles);
 
-    constexpr std::size_t md5_size = 32;
     // get filenames and timestamps
     try {
         const auto dir = Gio::File::create_for_path(Glib::build_filename(baseDir, "data"));
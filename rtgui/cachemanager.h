@@ -23,6 +23,7 @@
 
 #include <glibmm/ustring.h>
 
+#include "cacheindex.h"
 #include "threadutils.h"
 
 #include "../rtengine/noncopyable.h"
@@ -37,18 +38,27 @@ private:
     Entries openEntries;
     Glib::ustring    baseDir;
     mutable MyMutex  mutex;
+    mutable CacheIndex index;
+    bool indexValid;
 
     void deleteDir   (const Glib::ustring& dirName) const;
+    // callers must hold mutex
     void deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const;
 
     void applyCacheSizeLimitation () const;
+    void seedIndex ();
 
 public:
+    CacheManager ();
+
     static CacheManager* getInstance ();
 
     void        init        ();
 
-    Thumbnail*  getEntry    (const Glib::ustring& fname);
+    // if deferGeneration is true, an uncached image only gets its metadata read, its thumbnail is generated when first requested
+    Thumbnail*  getEntry    (const Glib::ustring& fname, bool deferGeneration = false);
+    // records in the index that the data file of fname has been written
+    void        touchEntry  (const Glib::ustring& fname, const std::string& md5);
     void        deleteEntry (const Glib::ustring& fname);
     void        renameEntry (const std::string& oldfilename, const std::string& oldmd5, const std::string& newfilename);
 
@@ -45,9 +45,10 @@ Glib::RefPtr<Gdk::Pixbuf> FileBrowserEntry::hdr;
 Glib::RefPtr<Gdk::Pixbuf> FileBrowserEntry::ps;
 
 FileBrowserEntry::FileBrowserEntry (Thumbnail* thm, const Glib::ustring& fname)
-    : ThumbBrowserEntryBase (fname), wasInside(false), iatlistener(nullptr), press_x(0), press_y(0), action_x(0), action_y(0), rot_deg(0.0), landscape(true), cropParams(new rtengine::procparams::CropParams), cropgl(nullptr), state(SNormal), crop_custom_ratio(0.f)
+    : ThumbBrowserEntryBase (fname), wasInside(false), iatlistener(nullptr), press_x(0), press_y(0), action_x(0), action_y(0), rot_deg(0.0), landscape(true), placeholderSize(false), cropParams(new rtengine::procparams::CropParams), cropgl(nullptr), state(SNormal), crop_custom_ratio(0.f)
 {
     thumbnail = thm;
+    placeholderSize = thumbnail->isDeferred();
 
     feih = new FileBrowserEntryIdleHelper;
     feih->fbentry = this;
@@ -254,12 +255,18 @@ void FileBrowserEntry::_updateImage(rtengine::IImage8* img, double s, const rten
     bool newLandscape = img->getWidth() > img->getHeight();
     bool rotated = false;
 
+    if (placeholderSize && thumbnail && !thumbnail->isDeferred()) {
+        // first real image of a thumbnail laid out with an assumed aspect ratio
+        placeholderSize = false;
+        rotated = preh == img->getHeight() && prew != img->getWidth();
+    }
+
     if (preh == img->getHeight()) {
         const bool resize = !preview || prew != img->getWidth();
         prew = img->getWidth ();
 
         // Check if image has been rotated since last time
-        rotated = preview && newLandscape != landscape;
+        rotated = rotated || (preview && newLandscape != landscape);
 
         if (resize) {
             if (preview) {
@@ -56,6 +56,7 @@ class FileBrowserEntry final : public ThumbBrowserEntryBase,
     int press_x, press_y, action_x, action_y;
     double rot_deg;
     bool landscape;
+    bool placeholderSize; // laid out before the thumbnail image was generated
     const std::unique_ptr<rtengine::procparams::CropParams> cropParams;
     CropGUIListener* cropgl;
     FileBrowserEntryIdleHelper* feih;
@@ -221,6 +221,8 @@ int main (int argc, char **argv)
         std::cout << "Terminating without anything to do." << std::endl;
     }
 
+    rtengine::cleanup();
+
     return ret;
 }
 
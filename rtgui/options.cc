@@ -431,6 +431,7 @@ void Options::setDefaults()
     overlayedFileNames = false;
     filmStripOverlayedFileNames = false;
     internalThumbIfUntouched = true;    // if TRUE, only fast, internal preview images are taken if the image is not edited yet
+    deferThumbnailGeneration = true;    // if TRUE, opening a folder only reads the metadata of uncached images, thumbnails are generated when shown
     showFileNames = true;
     filmStripShowFileNames = false;
     tabbedUI = false;
@@ -449,11 +450,16 @@ void Options::setDefaults()
     curvebboxpos = 1;
     prevdemo = PD_Sidecar;
     rgbDenoiseThreadLimit = 0;
+    rgbDenoiseStreamTiles = false;
+    bakeRGBLUT = false;
 #if defined( _OPENMP ) && defined( __x86_64__ )
     clutCacheSize = omp_get_num_procs();
 #else
     clutCacheSize = 1;
 #endif
+    clutCacheMemory = 128;
+    waveletPoolMemory = 128;
+    flatFieldCacheMemory = 128;
     filledProfile = false;
     maxInspectorBuffers = 2; //  a rather conservative value for low specced systems...
     inspectorDelay = 0;
@@ -1035,6 +1041,10 @@ void Options::readFromFile(Glib::ustring fname)
                     internalThumbIfUntouched = keyFile.get_boolean("File Browser", "InternalThumbIfUntouched");
                 }
 
+                if (keyFile.has_key("File Browser", "DeferThumbnailGeneration")) {
+                    deferThumbnailGeneration = keyFile.get_boolean("File Browser", "DeferThumbnailGeneration");
+                }
+
                 if (keyFile.has_key("File Browser", "menuGroupRank")) {
                     menuGroupRank = keyFile.get_boolean("File Browser", "menuGroupRank");
                 }
@@ -1085,10 +1095,30 @@ void Options::readFromFile(Glib::ustring fname)
                     rgbDenoiseThreadLimit = keyFile.get_integer("Performance", "RgbDenoiseThreadLimit");
                 }
 
+                if (keyFile.has_key("Performance", "RgbDenoiseStreamTiles")) {
+                    rgbDenoiseStreamTiles = keyFile.get_boolean("Performance", "RgbDenoiseStreamTiles");
+                }
+
+                if (keyFile.has_key("Performance", "BakeRGBLUT")) {
+                    bakeRGBLUT = keyFile.get_boolean("Performance", "BakeRGBLUT");
+                }
+
                 if (keyFile.has_key("Performance", "ClutCacheSize")) {
                     clutCacheSize = keyFile.get_integer("Performance", "ClutCacheSize");
                 }
 
+                if (keyFile.has_key("Performance", "ClutCacheMemory")) {
+                    clutCacheMemory = keyFile.get_integer("Performance", "ClutCacheMemory");
+                }
+
+                if (keyFile.has_key("Performance", "WaveletPoolMemory")) {
+                    waveletPoolMemory = keyFile.get_integer("Performance", "WaveletPoolMemory");
+                }
+
+                if (keyFile.has_key("Performance", "FlatFieldCacheMemory")) {
+                    flatFieldCacheMemory = keyFile.get_integer("Performance", "FlatFieldCacheMemory");
+                }
+
                 if (keyFile.has_key("Performance", "MaxInspectorBuffers")) {
                     maxInspectorBuffers = keyFile.get_integer("Performance", "MaxInspectorBuffers");
                 }
@@ -2014,6 +2044,7 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_boolean("File Browser", "ShowFileNames", showFileNames);
         keyFile.set_boolean("File Browser", "FilmStripShowFileNames", filmStripShowFileNames);
         keyFile.set_boolean("File Browser", "InternalThumbIfUntouched", internalThumbIfUntouched);
+        keyFile.set_boolean("File Browser", "DeferThumbnailGeneration", deferThumbnailGeneration);
         keyFile.set_boolean("File Browser", "menuGroupRank", menuGroupRank);
         keyFile.set_boolean("File Browser", "menuGroupLabel", menuGroupLabel);
         keyFile.set_boolean("File Browser", "menuGroupFileOperations", menuGroupFileOperations);
@@ -2035,7 +2066,12 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_boolean("Clipping Indication", "BlinkClipped", blinkClipped);
 
         keyFile.set_integer("Performance", "RgbDenoiseThreadLimit", rgbDenoiseThreadLimit);
+        keyFile.set_boolean("Performance", "RgbDenoiseStreamTiles", rgbDenoiseStreamTiles);
+        keyFile.set_boolean("Performance", "BakeRGBLUT", bakeRGBLUT);
         keyFile.set_integer("Performance", "ClutCacheSize", clutCacheSize);
+        keyFile.set_integer("Performance", "ClutCacheMemory", clutCacheMemory);
+        keyFile.set_integer("Performance", "WaveletPoolMemory", waveletPoolMemory);
+        keyFile.set_integer("Performance", "FlatFieldCacheMemory", flatFieldCacheMemory);
         keyFile.set_integer("Performance", "MaxInspectorBuffers", maxInspectorBuffers);
         keyFile.set_integer("Performance", "InspectorDelay", inspectorDelay);
         keyFile.set_integer("Performance", "PreviewDemosaicFromSidecar", prevdemo);
@@ -2429,6 +2465,8 @@ void Options::load(bool lightweight)
         printf("Cache directory (cacheBaseDir) = %s\n", cacheBaseDir.c_str());
     }
 
+    options.rtSettings.fftwWisdomFile = Glib::build_filename(cacheBaseDir, "fftw3f_wisdom");
+
     // Update profile's path and recreate it if necessary
     options.updatePaths();
 
@@ -287,6 +287,7 @@ public:
     std::vector<Glib::ustring> renameTemplates;
     bool renameUseTemplates;
     bool internalThumbIfUntouched;
+    bool deferThumbnailGeneration;
     bool overwriteOutputFile;
 
     std::vector<double> thumbnailZoomRatios;
@@ -327,9 +328,14 @@ public:
     // Performance options
     Glib::ustring clutsDir;
     int rgbDenoiseThreadLimit; // maximum number of threads for the denoising tool ; 0 = use the maximum available
+    bool rgbDenoiseStreamTiles; // opt-in: always denoise in tiles, so memory usage does not grow with image size
+    bool bakeRGBLUT; // apply the pixel local RGB tools of batch processing through a sampled 3D LUT
     int maxInspectorBuffers;   // maximum number of buffers (i.e. images) for the Inspector feature
     int inspectorDelay;
     int clutCacheSize;
+    int clutCacheMemory; // memory budget of the CLUT cache in MiB (Performance/ClutCacheMemory), the CLUT in use is always kept ; 0 = keep only that one
+    int waveletPoolMemory; // memory kept for reuse by the wavelet buffer pool in MiB (Performance/WaveletPoolMemory) ; 0 = free wavelet buffers right away
+    int flatFieldCacheMemory; // memory budget of the blurred flat field cache in MiB (Performance/FlatFieldCacheMemory), the map in use is always kept ; 0 = keep only that one
     bool filledProfile;  // Used as reminder for the ProfilePanel "mode"
     prevdemo_t prevdemo; // Demosaicing method used for the <100% preview
     bool serializeTiffRead;
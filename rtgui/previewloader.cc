@@ -22,6 +22,7 @@
 #include "filebrowserentry.h"
 #include "previewloader.h"
 #include "guiutils.h"
+#include "options.h"
 #include "threadutils.h"
 
 #ifdef _OPENMP
@@ -127,7 +128,7 @@ public:
             Thumbnail* tmb = nullptr;
             {
                 if (Glib::file_test(j.dir_entry_, Glib::FILE_TEST_EXISTS)) {
-                    tmb = cacheMgr->getEntry(j.dir_entry_);
+                    tmb = cacheMgr->getEntry(j.dir_entry_, options.deferThumbnailGeneration);
                 }
             }
 
@@ -26,9 +26,11 @@
 #include <iomanip>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "../rtengine/colortemp.h"
 #include "../rtengine/imagedata.h"
 #include "../rtengine/procparams.h"
+#include "../rtengine/rawimage.h"
 #include "../rtengine/rtthumbnail.h"
 #include <glib/gstdio.h>
 
@@ -45,6 +47,38 @@
 
 using namespace rtengine::procparams;
 
+namespace
+{
+
+// Checks the leading bytes of a JPEG, PNG or TIFF file, a cheap substitute for decoding it
+bool hasImageSignature (const Glib::ustring& fname, ThFileType format)
+{
+    unsigned char header[8] = {};
+
+    if (FILE* const f = g_fopen (fname.c_str (), "rb")) {
+        const std::size_t length = fread (header, 1, sizeof (header), f);
+        fclose (f);
+
+        switch (format) {
+            case FT_Jpeg:
+                return length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF;
+
+            case FT_Png:
+                return length == 8 && !memcmp (header, "\x89PNG\r\n\x1a\n", 8);
+
+            case FT_Tiff:
+                return length >= 4 && (!memcmp (header, "II*\0", 4) || !memcmp (header, "MM\0*", 4));
+
+            default:
+                break;
+        }
+    }
+
+    return false;
+}
+
+}
+
 Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, CacheImageData* cf) :
     fname(fname),
     cfs(*cf),
@@ -59,7 +93,8 @@ Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, CacheImageDat
     lastW(0),
     lastH(0),
     lastScale(0),
-    initial_(false)
+    initial_(false),
+    deferred_(false)
 {
 
     loadProcParams ();
@@ -84,7 +119,7 @@ Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, CacheImageDat
     tpp = nullptr;
 }
 
-Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, const std::string& md5) :
+Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, const std::string& md5, bool deferGeneration) :
     fname(fname),
     cachemgr(cm),
     ref(1),
@@ -97,13 +132,20 @@ Thumbnail::Thumbnail(CacheManager* cm, const Glib::ustring& fname, const std::st
     lastW(0),
     lastH(0),
     lastScale(0.0),
-    initial_(true)
+    initial_(true),
+    deferred_(deferGeneration)
 {
 
 
     cfs.md5 = md5;
     loadProcParams ();
-    _generateThumbnailImage ();
+
+    if (deferred_) {
+        _readMetadata ();
+    } else {
+        _generateThumbnailImage ();
+    }
+
     cfs.recentlySaved = false;
 
     initial_ = false;
@@ -122,6 +164,7 @@ void Thumbnail::_generateThumbnailImage ()
     lastImg = nullptr;
     tw = -1;
     th = options.maxThumbnailHeight;
+    const float placeholderRatio = deferred_ ? imgRatio : -1.f;
     imgRatio = -1.;
 
     // generate thumbnail image
@@ -164,7 +207,7 @@ void Thumbnail::_generateThumbnailImage ()
         rtengine::RawMetaDataLocation ri;
 
         rtengine::eSensorType sensorType = rtengine::ST_NONE;
-        if ( initial_ && options.internalThumbIfUntouched) {
+        if ( (initial_ || deferred_) && options.internalThumbIfUntouched) {
             quick = true;
             tpp = rtengine::Thumbnail::loadQuickFromRaw (fname, ri, sensorType, tw, th, 1, TRUE);
         }
@@ -187,10 +230,71 @@ void Thumbnail::_generateThumbnailImage ()
         _saveThumbnail ();
         cfs.supported = true;
 
-        cfs.save (getCacheFileName ("data", ".txt"));
+        if (cfs.save (getCacheFileName ("data", ".txt")) == 0) {
+            cachemgr->touchEntry (fname, cfs.md5);
+        }
 
         generateExifDateTimeStrings ();
+    } else if (deferred_) {
+        // already shown in the file browser, keep its placeholder size
+        imgRatio = placeholderRatio;
     }
+
+    deferred_ = false;
+}
+
+/*
+ * Fill the cache entry from the metadata of the file only, without decoding any image - NON PROTECTED
+ * The thumbnail image is generated by _loadThumbnail when it is first requested.
+ */
+void Thumbnail::_readMetadata ()
+{
+    tw = -1;
+    th = options.maxThumbnailHeight;
+
+    const std::string ext = getExtension(fname).lowercase();
+
+    if (ext.empty()) {
+        cfs.supported = false;
+        return;
+    }
+
+    int deg = 0;
+    cfs.supported = false;
+    cfs.exifValid = false;
+    cfs.timeValid = false;
+
+    // only a file the decoders accept is supported, its extension is not enough
+    if (ext == "jpg" || ext == "jpeg") {
+        cfs.format = FT_Jpeg;
+    } else if (ext == "png") {
+        cfs.format = FT_Png;
+    } else if (ext == "tif" || ext == "tiff") {
+        cfs.format = FT_Tiff;
+    } else {
+        cfs.format = FT_Raw;
+    }
+
+    if (cfs.format == FT_Raw) {
+        // reads the header only, like the calibration frame scans
+        rtengine::RawImage ri (fname);
+
+        if (ri.loadRaw (false) != 0) {
+            return;
+        }
+
+        deg = infoFromImage (fname, std::unique_ptr<rtengine::RawMetaDataLocation>(new rtengine::RawMetaDataLocation(ri.get_exifBase(), ri.get_ciffBase(), ri.get_ciffLen())));
+    } else if (!hasImageSignature (fname, cfs.format)) {
+        return;
+    } else if (cfs.format != FT_Png) {
+        deg = infoFromImage (fname);
+    }
+
+    // the aspect ratio is only known once the image is decoded, assume the usual 3:2 until then
+    imgRatio = deg == 90 || deg == 270 ? 2.f / 3.f : 3.f / 2.f;
+    cfs.supported = true;
+
+    generateExifDateTimeStrings ();
 }
 
 bool Thumbnail::isSupported ()
@@ -1182,6 +1286,12 @@ bool Thumbnail::isQuick() const
     return cfs.thumbImgType == CacheImageData::QUICK_THUMBNAIL;
 }
 
+bool Thumbnail::isDeferred() const
+{
+    // read by the file browser entries without holding mutex
+    return deferred_;
+}
+
 bool Thumbnail::isPParamsValid() const
 {
     return pparamsValid;
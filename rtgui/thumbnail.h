@@ -18,6 +18,7 @@
  */
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
 
@@ -75,6 +76,7 @@ class Thumbnail
     Glib::ustring   dateTimeString;
 
     bool            initial_;
+    std::atomic<bool> deferred_;        // only the metadata has been read, the thumbnail image is not generated yet
 
     // vector of listeners
     std::vector<ThumbnailListener*> listeners;
@@ -82,6 +84,7 @@ class Thumbnail
     void            _loadThumbnail (bool firstTrial = true);
     void            _saveThumbnail ();
     void            _generateThumbnailImage ();
+    void            _readMetadata ();
     int             infoFromImage (const Glib::ustring& fname, std::unique_ptr<rtengine::RawMetaDataLocation> rml = nullptr);
     void            loadThumbnail (bool firstTrial = true);
     void            generateExifDateTimeStrings ();
@@ -90,7 +93,7 @@ class Thumbnail
 
 public:
     Thumbnail (CacheManager* cm, const Glib::ustring& fname, CacheImageData* cf);
-    Thumbnail (CacheManager* cm, const Glib::ustring& fname, const std::string& md5);
+    Thumbnail (CacheManager* cm, const Glib::ustring& fname, const std::string& md5, bool deferGeneration = false);
     ~Thumbnail ();
 
     bool              hasProcParams () const;
@@ -107,6 +110,7 @@ public:
     void              notifylisterners_procParamsChanged(int whoChangedIt);
 
     bool              isQuick() const;
+    bool              isDeferred() const;
     bool              isPParamsValid() const;
     bool              isRecentlySaved () const;
     void              imageDeveloped ();